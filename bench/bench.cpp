@@ -0,0 +1,899 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "columnar.h"
+#include "lexer.h"
+#include "loadgen.h"
+#include "parser.h"
+#include "evaluator.h"
+#include "journal.h"
+#include "mappedfile.h"
+#include "native.h"
+#include "output.h"
+#include "parallelparser.h"
+#include "pipeline.h"
+#include "server.h"
+#include "shared.h"
+#include "workloads.h"
+
+/*
+ * This is the benchmark suite of the calculator.
+ *
+ * It generates the synthetic workloads (see "workloads.h"), and runs
+ * them through the Parser and Evaluator classes directly, in three
+ * phases that are timed separately:
+ *  > tokenize:  only lexing the input, counting the tokens.
+ *  > parse:     parsing the input into a list of instructions.
+ *  > evaluate:  executing the instructions one at a time, timing
+ *               each print on its own for the latency percentiles.
+ * The lexer workload checks the scan modes of the lexer instead: it
+ * lexes the same input in every mode the CPU supports, and reports the
+ * throughput of each, and whether its tokens are exactly the same as
+ * with the scalar mode (an "identical" of false is a bug).
+ * The parse workload parses a large mixed input on one thread, and in
+ * chunks on one thread per core (see "parallelparser.h"), and reports
+ * the throughput of each, and whether the instructions and register
+ * names are exactly the same.
+ * The large workload is a generated file, which is too big to keep
+ * all of its instructions in memory, so it is run end to end through
+ * the pipeline instead (the same way the calculator runs files).
+ * The shared workload runs threads that print and change the same
+ * registers (see "shared.h"), 95% prints and 5% changes, with one
+ * thread, two, four and so on up to the number of cores, and reports
+ * the throughput of each, and how it scales from one thread.
+ * The columns workload runs a program over a seed table in columnar
+ * mode (see "columnar.h"), with the kernels of every mode the CPU
+ * supports, and with native code (see "native.h", if there is a
+ * compiler), and reports the rows per second of each, and whether its
+ * output is exactly the same as with the scalar kernels. It also runs
+ * some of the rows one at a time, as separate runs of the calculator
+ * would, to compare with, and checks that they print the same values.
+ * The journal workload runs a graph setup (see "workloads.h") with a
+ * journal (see "journal.h"), a line at a time as a console session
+ * would, syncing every line and with a window of 10 ms, and reports
+ * the lines per second of each. It then replays the journal into a new
+ * session, reports the operations per second of the replay, and checks
+ * that all registers have the same values as in the original session.
+ * The server workload runs the server mode (see "server.h") under the
+ * load generator (see "loadgen.h"): a server on a socket, and many
+ * clients sending requests in a closed loop. It reports the requests
+ * per second, and the percentiles of the request latency.
+ *
+ * Each workload is run in its own process (when fork is available),
+ * so that the peak memory use reported is that of the workload only.
+ * The results are written to the console as one JSON object per line,
+ * which makes it easy to store them and compare them between versions.
+ * If any of the checks fails (an "identical" or "binary_identical" of
+ * false), or a workload crashes, the benchmark says so on stderr and
+ * exits with status 1, so a run in a script or by 'make bench' fails.
+ * The output of the evaluator itself is discarded.
+ *
+ * # Options
+ *  > --scale <f>      Multiply the size of all workloads by f (default 1).
+ *  > --large-mb <n>   Size of the large file workload in megabytes (default 64).
+ *                     (Sizes of several gigabytes are supported.)
+ *  > --only <name>    Only run the workload with the given name.
+ *  > --threads <n>    Number of threads for the evaluator (default 1).
+ *  > --clients <n>    Number of clients of the server workload (default 1000).
+ *  > --socket <path>  Run the server workload against the server listening
+ *                     at path (such as 'run.o --serve path'), instead of
+ *                     one started by the benchmark itself.
+ */
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/* Options of the benchmark run. */
+struct BenchOptions {
+    double scale;
+    uint64_t largeMegabytes;
+    std::string only;
+    unsigned threads;
+    size_t clients;
+    std::string socket;
+};
+
+/* Stream buffer that throws away everything written to it. */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+/* Output of the evaluators, which throws everything away (it is
+ * still formatted and buffered, as it would be for the console). */
+Output &discardedOutput() {
+    static NullBuffer buffer;
+    static std::ostream stream(&buffer);
+    static Output output(stream);
+    return output;
+}
+
+// Whether a check of this workload has failed (see checked)
+bool checkFailed = false;
+
+/* Return a check result as JSON, remembering if it failed. */
+const char *checked(bool passed) {
+    if (!passed) {
+        checkFailed = true;
+    }
+    return passed ? "true" : "false";
+}
+
+/* Seconds elapsed since the given time. */
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Peak resident set size of this process, in kilobytes. */
+long peakMemoryKilobytes() {
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+/* Return the given percentile of the sorted samples. */
+uint64_t percentile(const std::vector<uint64_t> &sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+/* Rate of the given count per second, guarding against zero time. */
+double rate(double count, double seconds) {
+    return seconds > 0 ? count / seconds : 0;
+}
+
+/* Count the tokens in the buffer (folding it, as the parser would). */
+size_t countTokens(char *begin, char *end) {
+    Lexer lexer(begin, end);
+    Token token;
+    size_t tokens = 0;
+    while (lexer.next(token)) {
+        ++tokens;
+    }
+    return tokens;
+}
+
+/* A token, as its kind and position in the buffer. */
+struct TokenPosition {
+    TokenKind kind;
+    size_t offset;
+    size_t length;
+
+    bool operator==(const TokenPosition &other) const {
+        return kind == other.kind && offset == other.offset && length == other.length;
+    }
+};
+
+/* Lex the input in the given scan mode, returning the tokens and the
+ * folded buffer. */
+std::vector<TokenPosition> lexTokens(const std::string &input, ScanMode mode, std::string &folded) {
+    folded = input;
+    char *begin = &folded[0];
+    Lexer lexer(begin, begin + folded.size(), mode);
+    std::vector<TokenPosition> tokens;
+    Token token;
+    while (lexer.next(token)) {
+        TokenPosition position = {token.kind, static_cast<size_t>(token.text - begin), token.length};
+        tokens.push_back(position);
+    }
+    return tokens;
+}
+
+/* Lex the input in every scan mode the CPU supports, and write the
+ * throughput of each mode, and whether it gives the same tokens (and
+ * the same folded buffer) as the scalar mode. */
+void runScanModes(double scale, std::ostream &report) {
+    std::string input;
+    Workloads::mixed(input, static_cast<size_t>(scale * 1000000), 1);
+    Workloads::noisy(input, static_cast<size_t>(scale * 1000000), 1);
+
+    std::string expectedBuffer;
+    std::vector<TokenPosition> expected = lexTokens(input, SCAN_SCALAR, expectedBuffer);
+
+    report << "{\"workload\":\"lexer\""
+           << ",\"bytes\":" << input.size()
+           << ",\"tokens\":" << expected.size()
+           << ",\"best\":\"" << Lexer::scanModeName(Lexer::bestScanMode()) << "\"";
+    const ScanMode modes[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+    for (ScanMode mode : modes) {
+        if (!Lexer::supportsScanMode(mode)) continue;
+        std::string buffer = input;
+        Clock::time_point start = Clock::now();
+        size_t tokens = 0;
+        {
+            Lexer lexer(&buffer[0], &buffer[0] + buffer.size(), mode);
+            Token token;
+            while (lexer.next(token)) {
+                ++tokens;
+            }
+        }
+        double seconds = secondsSince(start);
+
+        std::string folded;
+        bool identical = lexTokens(input, mode, folded) == expected && folded == expectedBuffer;
+        report << ",\"" << Lexer::scanModeName(mode) << "\":{"
+               << "\"tokenize_seconds\":" << seconds
+               << ",\"tokens_per_sec\":" << rate(tokens, seconds)
+               << ",\"bytes_per_sec\":" << rate(input.size(), seconds)
+               << ",\"identical\":" << checked(identical) << "}";
+    }
+    report << ",\"peak_rss_kb\":" << peakMemoryKilobytes() << "}" << std::endl;
+}
+
+/* Run a workload that fits in memory, in separate phases, and write
+ * its results as a JSON line to the given stream. */
+void runInMemory(const std::string &name, std::string &input, unsigned threads, std::ostream &report) {
+    char *begin = &input[0];
+    char *end = begin + input.size();
+
+    // Tokenize
+    Clock::time_point start = Clock::now();
+    size_t tokens = countTokens(begin, end);
+    double tokenizeSeconds = secondsSince(start);
+
+    // Parse
+    Symbols symbols;
+    Parser parser(symbols);
+    Instructions instructions;
+    start = Clock::now();
+    parser.parse(instructions, begin, end);
+    double parseSeconds = secondsSince(start);
+    size_t count = instructions.size();
+
+    // Evaluate, one instruction at a time
+    Evaluator evaluator(symbols);
+    evaluator.setThreads(threads);
+    evaluator.setOutput(discardedOutput());
+    std::vector<uint64_t> latencies;
+    Instructions single;
+    double evaluateSeconds = 0;
+    while (!instructions.empty()) {
+        bool print = instructions.front().op == PRINT;
+        single.push(instructions.front());
+        instructions.pop();
+        start = Clock::now();
+        bool running = evaluator.execute(single);
+        Clock::duration elapsed = Clock::now() - start;
+        evaluateSeconds += std::chrono::duration<double>(elapsed).count();
+        if (print) {
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+        if (!running) break;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    report << "{\"workload\":\"" << name << "\""
+           << ",\"bytes\":" << input.size()
+           << ",\"tokens\":" << tokens
+           << ",\"instructions\":" << count
+           << ",\"prints\":" << latencies.size()
+           << ",\"tokenize_seconds\":" << tokenizeSeconds
+           << ",\"parse_seconds\":" << parseSeconds
+           << ",\"evaluate_seconds\":" << evaluateSeconds
+           << ",\"tokens_per_sec\":" << rate(tokens, tokenizeSeconds)
+           << ",\"instructions_per_sec\":" << rate(count, parseSeconds)
+           << ",\"prints_per_sec\":" << rate(latencies.size(), evaluateSeconds)
+           << ",\"print_latency_ns\":{\"p50\":" << percentile(latencies, 0.50)
+           << ",\"p90\":" << percentile(latencies, 0.90)
+           << ",\"p99\":" << percentile(latencies, 0.99)
+           << ",\"max\":" << (latencies.empty() ? 0 : latencies.back()) << "}"
+           << ",\"peak_rss_kb\":" << peakMemoryKilobytes()
+           << "}" << std::endl;
+}
+
+/* Run the large file workload end to end, and write its results. */
+void runLargeFile(uint64_t megabytes, unsigned threads, std::ostream &report) {
+    std::string filename = "bench_large.txt";
+    if (!Workloads::largeFile(filename, megabytes << 20)) {
+        report << "{\"workload\":\"large\",\"error\":\"could not write " << filename << "\"}" << std::endl;
+        return;
+    }
+
+    // Count the tokens on one mapping, and run the file on a fresh one
+    size_t tokens;
+    size_t bytes;
+    double tokenizeSeconds;
+    {
+        MappedFile file;
+        file.open(filename);
+        bytes = file.size();
+        Clock::time_point start = Clock::now();
+        tokens = countTokens(file.begin(), file.end());
+        tokenizeSeconds = secondsSince(start);
+    }
+
+    Symbols symbols;
+    Parser parser(symbols);
+    Evaluator evaluator(symbols);
+    evaluator.setThreads(threads);
+    evaluator.setOutput(discardedOutput());
+    MappedFile file;
+    file.open(filename);
+    Clock::time_point start = Clock::now();
+    Pipeline(parser, evaluator).run(file.begin(), file.end());
+    double totalSeconds = secondsSince(start);
+    std::remove(filename.c_str());
+
+    report << "{\"workload\":\"large\""
+           << ",\"bytes\":" << bytes
+           << ",\"tokens\":" << tokens
+           << ",\"tokenize_seconds\":" << tokenizeSeconds
+           << ",\"total_seconds\":" << totalSeconds
+           << ",\"tokens_per_sec\":" << rate(tokens, tokenizeSeconds)
+           << ",\"bytes_per_sec\":" << rate(bytes, totalSeconds)
+           << ",\"peak_rss_kb\":" << peakMemoryKilobytes()
+           << "}" << std::endl;
+}
+
+/* Return the instructions of a list as text, with the register names
+ * and messages, for comparing what two parsers made of an input. */
+std::string describe(Instructions &instructions, const Symbols &symbols) {
+    std::string text;
+    while (!instructions.empty()) {
+        const Instruction &instruction = instructions.front();
+        text += std::to_string(instruction.op) + ' ';
+        if (instruction.op == ERROR) {
+            text += symbols.message(instruction.reg);
+        } else if (instruction.op != QUIT) {
+            text += symbols.name(instruction.reg) + ' ';
+            text += instruction.kind == REFERENCE ? symbols.name(static_cast<RegisterId>(instruction.value))
+                  : instruction.kind == BIG_LITERAL ? symbols.number(static_cast<uint32_t>(instruction.value))
+                  : std::to_string(instruction.value);
+        }
+        text += '\n';
+        instructions.pop();
+    }
+    return text;
+}
+
+/* Run the parallel parse workload, and write its results. */
+void runParallelParse(double scale, std::ostream &report) {
+    std::string input;
+    Workloads::mixed(input, static_cast<size_t>(scale * 4000000), 1);
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // On one thread
+    std::string buffer = input;
+    Symbols serialSymbols;
+    Instructions serial;
+    Clock::time_point start = Clock::now();
+    Parser(serialSymbols).parse(serial, &buffer[0], &buffer[0] + buffer.size());
+    double serialSeconds = secondsSince(start);
+    size_t count = serial.size();
+
+    // In chunks, a window at a time
+    buffer = input;
+    Symbols parallelSymbols;
+    Instructions parallel;
+    start = Clock::now();
+    {
+        ParallelParser parser(parallelSymbols, threads);
+        char *at = &buffer[0];
+        char *end = at + buffer.size();
+        while (at < end) {
+            at = parser.parse(parallel, at, end);
+        }
+    }
+    double parallelSeconds = secondsSince(start);
+
+    bool identical = parallel.size() == count && serialSymbols.size() == parallelSymbols.size() &&
+                     describe(serial, serialSymbols) == describe(parallel, parallelSymbols);
+    report << "{\"workload\":\"parse\""
+           << ",\"bytes\":" << input.size()
+           << ",\"instructions\":" << count
+           << ",\"threads\":" << threads
+           << ",\"serial_seconds\":" << serialSeconds
+           << ",\"parallel_seconds\":" << parallelSeconds
+           << ",\"serial_bytes_per_sec\":" << rate(input.size(), serialSeconds)
+           << ",\"parallel_bytes_per_sec\":" << rate(input.size(), parallelSeconds)
+           << ",\"speedup\":" << (parallelSeconds > 0 ? serialSeconds / parallelSeconds : 0)
+           << ",\"identical\":" << checked(identical)
+           << ",\"peak_rss_kb\":" << peakMemoryKilobytes()
+           << "}" << std::endl;
+}
+
+/* Print every register of a session (by name, in the order of the
+ * given names), for comparing two sessions. */
+std::string printAll(const Symbols &names, Symbols &symbols, Evaluator &evaluator) {
+    std::string text;
+    Output output(text);
+    evaluator.setOutput(output);
+    Instructions prints;
+    for (size_t id = 0; id < names.size(); ++id) {
+        Instruction print = {PRINT, REFERENCE, symbols.intern(names.name(static_cast<RegisterId>(id))), 0};
+        prints.push(print);
+    }
+    evaluator.execute(prints);
+    output.sync();
+    evaluator.setOutput(discardedOutput());
+    return text;
+}
+
+/* Run the journal workload, and write its results. */
+void runJournal(double scale, std::ostream &report) {
+#ifndef _WIN32
+    std::string filename = "/tmp/regcalc-bench-" + std::to_string(getpid()) + ".journal";
+    std::string input;
+    Workloads::graph(input, static_cast<size_t>(scale * 100000) + 1, 1);
+
+    report << "{\"workload\":\"journal\"";
+    std::string expected;
+    Symbols names;
+    const unsigned windows[] = {0, 10};
+    for (unsigned window : windows) {
+        // A line (one instruction) per call of the evaluator, as typed
+        // into the console; syncing every line is only done for a part
+        std::remove(filename.c_str());
+        std::string buffer = input;
+        Symbols symbols;
+        Parser parser(symbols);
+        Evaluator evaluator(symbols);
+        evaluator.setOutput(discardedOutput());
+        size_t lines = 0;
+        size_t limit = window == 0 ? 2000 : SIZE_MAX;
+        Clock::time_point start = Clock::now();
+        {
+            Journal journal(symbols);
+            std::string error;
+            if (!journal.open(filename, evaluator, std::chrono::milliseconds(window), error)) {
+                report << ",\"error\":\"" << error << "\"}" << std::endl;
+                return;
+            }
+            evaluator.setJournal(journal);
+            Instructions instructions;
+            char *at = &buffer[0];
+            char *end = at + buffer.size();
+            while (at < end && lines < limit) {
+                at = parser.parse(instructions, at, end, 1);
+                lines += instructions.size();
+                evaluator.execute(instructions);
+            }
+        }
+        double seconds = secondsSince(start);
+        report << ",\"window_" << window << "_lines\":" << lines
+               << ",\"window_" << window << "_lines_per_sec\":" << rate(lines, seconds);
+        if (window != 0) {
+            for (size_t id = 0; id < symbols.size(); ++id) {
+                names.intern(symbols.name(static_cast<RegisterId>(id)));
+            }
+            expected = printAll(names, symbols, evaluator);
+        }
+    }
+
+    // Replay the whole journal into a new session
+    Symbols symbols;
+    Evaluator evaluator(symbols);
+    evaluator.setOutput(discardedOutput());
+    Clock::time_point start = Clock::now();
+    uint64_t replayed = 0;
+    {
+        Journal journal(symbols);
+        std::string error;
+        journal.open(filename, evaluator, std::chrono::milliseconds(0), error);
+        replayed = journal.replayed();
+    }
+    double seconds = secondsSince(start);
+    bool identical = printAll(names, symbols, evaluator) == expected;
+    std::remove(filename.c_str());
+
+    report << ",\"replayed\":" << replayed
+           << ",\"replay_seconds\":" << seconds
+           << ",\"replay_ops_per_sec\":" << rate(replayed, seconds)
+           << ",\"identical\":" << checked(identical)
+           << ",\"peak_rss_kb\":" << peakMemoryKilobytes()
+           << "}" << std::endl;
+#else
+    (void) scale;
+    (void) report;
+#endif
+}
+
+/* Run the shared registers workload, and write its results. */
+void runShared(double scale, std::ostream &report) {
+    size_t registers = static_cast<size_t>(scale * 10000) + 1;
+    size_t lines = static_cast<size_t>(scale * 200000) + 1;
+    unsigned cores = std::max(2u, std::thread::hardware_concurrency());
+
+    report << "{\"workload\":\"shared\""
+           << ",\"registers\":" << registers
+           << ",\"lines_per_thread\":" << lines
+           << ",\"threads\":{";
+    double single = 0;
+    for (unsigned threads = 1; threads <= cores; threads *= 2) {
+        // Parse the graph and the lines of every thread up front (the
+        // names are interned in one symbols object, by this thread)
+        Symbols symbols;
+        Parser parser(symbols);
+        std::string setup;
+        Workloads::graph(setup, registers, 1);
+        Instructions graph;
+        parser.parse(graph, &setup[0], &setup[0] + setup.size());
+        std::vector<std::unique_ptr<Instructions>> scripts;
+        for (unsigned i = 0; i < threads; ++i) {
+            std::string input;
+            Workloads::reads(input, lines, registers, i + 2);
+            scripts.emplace_back(new Instructions());
+            parser.parse(*scripts.back(), &input[0], &input[0] + input.size());
+        }
+
+        SharedRegisters shared;
+        {
+            Evaluator evaluator(symbols);
+            evaluator.setOutput(discardedOutput());
+            evaluator.share(shared);
+            evaluator.execute(graph);
+        }
+
+        // Run the lines of each thread on its own evaluator (and output)
+        Clock::time_point start = Clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threads; ++i) {
+            Instructions *script = scripts[i].get();
+            workers.emplace_back([&symbols, &shared, script] {
+                NullBuffer buffer;
+                std::ostream stream(&buffer);
+                Output output(stream);
+                Evaluator evaluator(symbols);
+                evaluator.setOutput(output);
+                evaluator.share(shared);
+                evaluator.execute(*script);
+            });
+        }
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        double seconds = secondsSince(start);
+        double perSecond = rate(static_cast<double>(lines) * threads, seconds);
+        if (threads == 1) {
+            single = perSecond;
+        }
+        report << (threads == 1 ? "" : ",") << "\"" << threads << "\":{"
+               << "\"seconds\":" << seconds
+               << ",\"lines_per_sec\":" << perSecond
+               << ",\"scaling\":" << (single > 0 ? perSecond / single : 0) << "}";
+    }
+    report << "},\"peak_rss_kb\":" << peakMemoryKilobytes() << "}" << std::endl;
+}
+
+/* Run a program once per row of a seed table, as a separate run of
+ * the calculator would, and return the output of the rows (in the
+ * format of the columnar mode). */
+std::string runRows(const std::string &program, const Seeds &seeds, size_t rows) {
+    std::string table;
+    for (size_t row = 0; row < rows; ++row) {
+        std::string input;
+        for (size_t column = 0; column < seeds.names.size(); ++column) {
+            int64_t value = seeds.columns[column][row];
+            input += seeds.names[column] + (value < 0 ? " subtract " : " add ");
+            input += std::to_string(value).substr(value < 0 ? 1 : 0) + '\n';
+        }
+        input += program;
+        std::string printed;
+        {
+            Symbols symbols;
+            Instructions instructions;
+            Parser(symbols).parse(instructions, &input[0], &input[0] + input.size());
+            Output output(printed);
+            Evaluator evaluator(symbols);
+            evaluator.setOutput(output);
+            evaluator.execute(instructions);
+            output.flush();
+        }
+        std::replace(printed.begin(), printed.end(), '\n', ',');
+        printed.back() = '\n';
+        table += printed;
+    }
+    return table;
+}
+
+/* Run the columnar workload, and write its results. */
+void runColumns(double scale, std::ostream &report) {
+    size_t rows = static_cast<size_t>(scale * 1000000) + 1;
+    size_t registers = 200;
+    size_t columns = 8;
+
+    // A graph, with seed columns for its first registers, and prints of
+    // its last registers (written to files, as the calculator reads them)
+    std::string program;
+    Workloads::graph(program, registers, 1);
+    for (size_t i = registers - 8; i < registers; ++i) {
+        program += "print g" + std::to_string(i) + '\n';
+    }
+    std::string csv;
+    Workloads::table(csv, rows, columns, 1);
+    std::string filename = "bench_columns.csv";
+    std::string binary = "bench_columns.bin";
+    FILE *file = std::fopen(filename.c_str(), "wb");
+    if (!file || std::fwrite(csv.data(), 1, csv.size(), file) != csv.size()) {
+        report << "{\"workload\":\"columns\",\"error\":\"could not write " << filename << "\"}" << std::endl;
+        if (file) std::fclose(file);
+        return;
+    }
+    std::fclose(file);
+
+    // Read the table as CSV, and again from its binary form
+    Seeds seeds;
+    std::string error;
+    Clock::time_point start = Clock::now();
+    seeds.read(filename, error);
+    double csvSeconds = secondsSince(start);
+    seeds.writeBinary(binary);
+    Seeds reread;
+    start = Clock::now();
+    reread.read(binary, error);
+    double binarySeconds = secondsSince(start);
+    bool binaryIdentical = reread.names == seeds.names && reread.columns == seeds.columns;
+    std::remove(filename.c_str());
+    std::remove(binary.c_str());
+
+    report << "{\"workload\":\"columns\""
+           << ",\"rows\":" << rows
+           << ",\"registers\":" << registers
+           << ",\"seed_columns\":" << columns
+           << ",\"read_csv_seconds\":" << csvSeconds
+           << ",\"read_binary_seconds\":" << binarySeconds
+           << ",\"binary_identical\":" << checked(binaryIdentical)
+           << ",\"best\":\"" << Columnar::kernelModeName(Columnar::bestKernelMode()) << "\"";
+    std::string expected;
+    const KernelMode modes[] = {KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2};
+    for (KernelMode mode : modes) {
+        if (!Columnar::supportsKernelMode(mode)) continue;
+        std::string table;
+        Symbols symbols;
+        std::vector<RegisterId> seedRegisters;
+        for (const std::string &name : seeds.names) {
+            seedRegisters.push_back(symbols.intern(name));
+        }
+        Instructions instructions;
+        Parser(symbols).parse(instructions, &program[0], &program[0] + program.size());
+        start = Clock::now();
+        {
+            Output output(table);
+            Columnar columnar(symbols, output);
+            columnar.setKernelMode(mode);
+            columnar.compile(instructions, seedRegisters);
+            columnar.run(seeds);
+            output.flush();
+        }
+        double seconds = secondsSince(start);
+        if (mode == KERNEL_SCALAR) {
+            expected = table;
+        }
+        report << ",\"" << Columnar::kernelModeName(mode) << "\":{"
+               << "\"seconds\":" << seconds
+               << ",\"rows_per_sec\":" << rate(rows, seconds)
+               << ",\"identical\":" << checked(table == expected) << "}";
+    }
+
+    // The same with native code (the time to compile it is apart)
+    {
+        std::string table;
+        Symbols symbols;
+        std::vector<RegisterId> seedRegisters;
+        for (const std::string &name : seeds.names) {
+            seedRegisters.push_back(symbols.intern(name));
+        }
+        Instructions instructions;
+        Parser(symbols).parse(instructions, &program[0], &program[0] + program.size());
+        Output output(table);
+        Columnar columnar(symbols, output);
+        columnar.compile(instructions, seedRegisters);
+        std::string source;
+        columnar.emit(source);
+        std::string library = "bench_columns.so";
+        NativeLibrary native;
+        start = Clock::now();
+        bool loaded = native.load(library, source, error);
+        double compileSeconds = secondsSince(start);
+        std::remove(library.c_str());
+        std::remove((library + ".cpp").c_str());
+        std::remove((library + ".fingerprint").c_str());
+        if (loaded) {
+            columnar.setNative(native.function());
+            start = Clock::now();
+            columnar.run(seeds);
+            output.flush();
+            double seconds = secondsSince(start);
+            report << ",\"native\":{"
+                   << "\"compile_seconds\":" << compileSeconds
+                   << ",\"seconds\":" << seconds
+                   << ",\"rows_per_sec\":" << rate(rows, seconds)
+                   << ",\"identical\":" << checked(table == expected) << "}";
+        } else {
+            report << ",\"native\":{\"error\":\"" << error << "\"}";
+        }
+    }
+
+    // The first rows one at a time (after the header of the table)
+    size_t sample = std::min<size_t>(rows, 2000);
+    start = Clock::now();
+    std::string table = runRows(program, seeds, sample);
+    double seconds = secondsSince(start);
+    size_t header = expected.find('\n') + 1;
+    bool identical = expected.compare(header, table.size(), table) == 0;
+    report << ",\"per_row\":{"
+           << "\"rows\":" << sample
+           << ",\"seconds\":" << seconds
+           << ",\"rows_per_sec\":" << rate(sample, seconds)
+           << ",\"identical\":" << checked(identical) << "}"
+           << ",\"peak_rss_kb\":" << peakMemoryKilobytes() << "}" << std::endl;
+}
+
+/* Run the server workload, and write its results. */
+void runServer(const BenchOptions &options, std::ostream &report) {
+#ifndef _WIN32
+    // The server and the clients each need a descriptor per connection
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+
+    // Start a server on a thread, unless there is one already
+    std::string path = options.socket.empty() ? "bench_server.sock" : options.socket;
+    std::unique_ptr<Server> server;
+    std::thread serving;
+    if (options.socket.empty()) {
+        server.reset(new Server(path));
+        if (!server->listen()) {
+            report << "{\"workload\":\"server\",\"error\":\"could not listen on " << path << "\"}" << std::endl;
+            return;
+        }
+        serving = std::thread(&Server::run, server.get());
+    }
+
+    LoadGenerator::Result result;
+    size_t requests = std::max<size_t>(1, static_cast<size_t>(options.scale * 100));
+    bool connected = LoadGenerator::run(path, options.clients, requests, result);
+    if (server) {
+        server->stop();
+        serving.join();
+    }
+    if (!connected) {
+        report << "{\"workload\":\"server\",\"error\":\"could not connect to " << path << "\"}" << std::endl;
+        return;
+    }
+    std::sort(result.latencies.begin(), result.latencies.end());
+
+    report << "{\"workload\":\"server\""
+           << ",\"clients\":" << result.clients
+           << ",\"requests\":" << result.requests
+           << ",\"errors\":" << result.errors
+           << ",\"seconds\":" << result.seconds
+           << ",\"requests_per_sec\":" << rate(result.requests, result.seconds)
+           << ",\"request_latency_ns\":{\"p50\":" << percentile(result.latencies, 0.50)
+           << ",\"p90\":" << percentile(result.latencies, 0.90)
+           << ",\"p99\":" << percentile(result.latencies, 0.99)
+           << ",\"max\":" << (result.latencies.empty() ? 0 : result.latencies.back()) << "}"
+           << ",\"peak_rss_kb\":" << peakMemoryKilobytes()
+           << "}" << std::endl;
+}
+
+/* Generate and run the workload with the given name. */
+void runWorkload(const std::string &name, const BenchOptions &options, std::ostream &report) {
+    if (name == "large") {
+        runLargeFile(options.largeMegabytes, options.threads, report);
+        return;
+    }
+    if (name == "shared") {
+        runShared(options.scale, report);
+        return;
+    }
+    if (name == "columns") {
+        runColumns(options.scale, report);
+        return;
+    }
+    if (name == "server") {
+        runServer(options, report);
+        return;
+    }
+    if (name == "lexer") {
+        runScanModes(options.scale, report);
+        return;
+    }
+    if (name == "parse") {
+        runParallelParse(options.scale, report);
+        return;
+    }
+    if (name == "journal") {
+        runJournal(options.scale, report);
+        return;
+    }
+    std::string input;
+    double scale = options.scale;
+    if (name == "chain") Workloads::chain(input, static_cast<size_t>(scale * 1000000));
+    else if (name == "fanin") Workloads::fanin(input, static_cast<size_t>(scale * 1000000));
+    else if (name == "diamond") Workloads::diamond(input, static_cast<size_t>(scale * 50000));
+    else if (name == "distinct") Workloads::distinct(input, static_cast<size_t>(scale * 1000000));
+    else if (name == "prints") Workloads::prints(input, static_cast<size_t>(scale * 1000000));
+    else if (name == "mixed") Workloads::mixed(input, static_cast<size_t>(scale * 1000000), 1);
+    runInMemory(name, input, options.threads, report);
+}
+
+/* Read the benchmark options. Returns false if they are invalid. */
+bool parseBenchOptions(int argc, char *argv[], BenchOptions &out) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (i + 1 >= argc) return false;
+        if (argument == "--scale") {
+            out.scale = std::atof(argv[++i]);
+        } else if (argument == "--large-mb") {
+            out.largeMegabytes = std::strtoull(argv[++i], nullptr, 10);
+        } else if (argument == "--only") {
+            out.only = argv[++i];
+        } else if (argument == "--threads") {
+            out.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--clients") {
+            out.clients = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (argument == "--socket") {
+            out.socket = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return out.scale > 0 && out.threads > 0 && out.clients > 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options = {1.0, 64, "", 1, 1000, ""};
+    if (!parseBenchOptions(argc, argv, options)) {
+        std::cerr << "Usage: bench.o [--scale f] [--large-mb n] [--only name] [--threads n] [--clients n] [--socket path]" << std::endl;
+        return 1;
+    }
+
+    // (The output of the evaluators is discarded, see discardedOutput)
+    std::ostream &report = std::cout;
+    bool failed = false;
+
+    const char *names[] = {"chain", "fanin", "diamond", "distinct", "prints", "mixed", "lexer", "parse", "journal", "shared", "columns", "server", "large"};
+    for (const char *name : names) {
+        if (!options.only.empty() && options.only != name) continue;
+#ifndef _WIN32
+        // Run each workload in a child process, for its own peak memory
+        report.flush();
+        pid_t child = fork();
+        if (child == 0) {
+            runWorkload(name, options, report);
+            report.flush();
+            _exit(checkFailed ? 1 : 0);
+        }
+        int status;
+        waitpid(child, &status, 0);
+        bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+        checkFailed = false;
+        runWorkload(name, options, report);
+        bool passed = !checkFailed;
+#endif
+        if (!passed) {
+            std::cerr << "The " << name << " workload failed." << std::endl;
+            failed = true;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "loadgen.h"
+
+#ifdef __linux__
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// The request of every client, and how long to wait for a response
+const char REQUEST[] = "r add 1\nprint r\n";
+const int TIMEOUT_MILLISECONDS = 10000;
+
+/* A client, and its request in flight. */
+struct Client {
+    int socket;
+    size_t answered;
+    std::string response;
+    Clock::time_point sent;
+};
+
+/* Connect to the socket at path. Returns the (non-blocking) socket, or
+ * -1 if the connection failed. */
+int connectTo(const std::string &path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket < 0) {
+        return -1;
+    }
+    if (connect(socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        close(socket);
+        return -1;
+    }
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+    return socket;
+}
+
+/* Send the request of a client. Returns false if it failed. (The
+ * request is tiny, and the socket is empty when it is sent, so it is
+ * always taken in one piece.) */
+bool sendRequest(Client &client) {
+    client.response.clear();
+    client.sent = Clock::now();
+    ssize_t written = send(client.socket, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL);
+    return written == static_cast<ssize_t>(sizeof(REQUEST) - 1);
+}
+
+}
+
+bool LoadGenerator::run(const std::string &path, size_t clients, size_t requests, Result &out) {
+    out.clients = 0;
+    out.requests = 0;
+    out.errors = 0;
+    out.seconds = 0;
+    out.latencies.clear();
+    out.latencies.reserve(clients * requests);
+
+    int poller = epoll_create1(EPOLL_CLOEXEC);
+    if (poller < 0) {
+        return false;
+    }
+    std::unique_ptr<Client[]> all(new Client[clients]);
+    for (size_t i = 0; i < clients; ++i) {
+        Client &client = all[i];
+        client.socket = connectTo(path);
+        client.answered = 0;
+        if (client.socket < 0) {
+            ++out.errors;
+            continue;
+        }
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &client;
+        epoll_ctl(poller, EPOLL_CTL_ADD, client.socket, &event);
+        ++out.clients;
+    }
+    if (out.clients == 0) {
+        close(poller);
+        return false;
+    }
+
+    // Start all clients, and answer each response with the next request
+    size_t active = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < clients; ++i) {
+        Client &client = all[i];
+        if (client.socket < 0) continue;
+        if (requests > 0 && sendRequest(client)) {
+            ++active;
+        } else {
+            out.errors += requests > 0 ? 1 : 0;
+            close(client.socket);
+            client.socket = -1;
+        }
+    }
+
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    char chunk[4096];
+    while (active > 0) {
+        int count = epoll_wait(poller, events, MAX_EVENTS, TIMEOUT_MILLISECONDS);
+        if (count == 0) {
+            // (The server stopped answering: the rest have failed)
+            out.errors += active;
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            Client &client = *static_cast<Client *>(events[i].data.ptr);
+            ssize_t received = recv(client.socket, chunk, sizeof(chunk), 0);
+            if (received < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            bool failed = received <= 0;
+            if (!failed) {
+                client.response.append(chunk, static_cast<size_t>(received));
+                if (client.response.back() != '\n') continue;
+                Clock::duration latency = Clock::now() - client.sent;
+                ++client.answered;
+                if (client.response == std::to_string(client.answered) + "\n") {
+                    ++out.requests;
+                    out.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+                    if (client.answered < requests && sendRequest(client)) continue;
+                    failed = client.answered < requests;
+                } else {
+                    failed = true;
+                }
+            }
+            // The client is done (or has failed)
+            out.errors += failed ? 1 : 0;
+            --active;
+            epoll_ctl(poller, EPOLL_CTL_DEL, client.socket, nullptr);
+            close(client.socket);
+            client.socket = -1;
+        }
+    }
+    out.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (size_t i = 0; i < clients; ++i) {
+        if (all[i].socket >= 0) close(all[i].socket);
+    }
+    close(poller);
+    return true;
+}
+
+#else
+
+bool LoadGenerator::run(const std::string &, size_t, size_t, Result &out) {
+    out = Result();
+    return false;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * This file contains the load generator for the server mode of the
+ * calculator (see "server.h").
+ *
+ * It opens a number of connections to the socket of a server, and runs
+ * them as closed-loop clients: each client sends a request, waits for
+ * its response, and sends the next one right away. A request is a line
+ * changing the client's register, followed by a line printing it
+ *       r add 1
+ *       print r
+ * so the response is the one line with the new value, which is also
+ * checked (a session that answers wrongly, or not at all, is counted as
+ * an error). The latency of every request is measured, from sending it
+ * to receiving the whole response.
+ *   All clients are driven by one thread, with an epoll event loop, so
+ * thousands of them can run at once. Load generation needs epoll, so
+ * it is only available on Linux.
+ */
+namespace LoadGenerator {
+
+/* Results of a load generator run. */
+struct Result {
+    size_t clients;             // Clients that connected
+    size_t requests;            // Requests answered correctly
+    size_t errors;              // Wrong responses, and failed clients
+    double seconds;             // Time from the first request to the last
+    std::vector<uint64_t> latencies;    // Of each request, in nanoseconds
+};
+
+/* Connect the given number of clients to the server listening on the
+ * socket at path, and run the given number of requests on each. Returns
+ * false if no client could connect. */
+bool run(const std::string &path, size_t clients, size_t requests, Result &out);
+
+}
+
+#endif // LOADGEN_H
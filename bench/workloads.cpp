@@ -0,0 +1,225 @@
+#include <fstream>
+
+#include "workloads.h"
+
+namespace {
+
+/* Append a register name with the given prefix and number. */
+void appendRegister(std::string &out, const char *prefix, size_t number) {
+    out += prefix;
+    out += std::to_string(number);
+}
+
+/* Small, fast pseudo random generator (xorshift), so that the
+ * workloads are the same on every run. */
+uint64_t nextRandom(uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+}
+
+namespace Workloads {
+
+void chain(std::string &out, size_t n) {
+    for (size_t i = 1; i < n; ++i) {
+        appendRegister(out, "r", i);
+        out += " add ";
+        appendRegister(out, "r", i + 1);
+        out += '\n';
+    }
+    for (size_t i = 0; i < 16; ++i) {
+        appendRegister(out, "r", n);
+        out += " add 1\nprint r1\n";
+    }
+}
+
+void fanin(std::string &out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        appendRegister(out, "leaf", i);
+        out += " add ";
+        out += std::to_string(i % 1000);
+        out += "\ntotal add ";
+        appendRegister(out, "leaf", i);
+        out += '\n';
+    }
+    for (size_t i = 0; i < 16; ++i) {
+        appendRegister(out, "leaf", (i * 7919) % n);
+        out += " add 1\nprint total\n";
+    }
+}
+
+void diamond(std::string &out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const char *sides[] = {"left", "right"};
+        for (const char *side : sides) {
+            for (const char *below : sides) {
+                appendRegister(out, side, i);
+                out += " add ";
+                appendRegister(out, below, i + 1);
+                out += '\n';
+            }
+        }
+    }
+    for (size_t i = 0; i < 16; ++i) {
+        appendRegister(out, "left", n);
+        out += " add 1\n";
+        appendRegister(out, "right", n);
+        out += " add 1\nprint left0\n";
+    }
+}
+
+void distinct(std::string &out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        appendRegister(out, "x", i);
+        out += " add 7\n";
+        appendRegister(out, "x", i);
+        out += " multiply 3\n";
+        appendRegister(out, "x", i);
+        out += " subtract 1\n";
+    }
+    for (size_t i = 0; i < n; i += n / 16 + 1) {
+        out += "print ";
+        appendRegister(out, "x", i);
+        out += '\n';
+    }
+}
+
+void prints(std::string &out, size_t n) {
+    out += "a add 1\nb add a\nb multiply 2\nc add b\nc add a\n";
+    for (size_t i = 0; i < n; ++i) {
+        if (i % 64 == 0) {
+            out += "a add 1\n";
+        }
+        out += (i % 2) ? "print c\n" : "print b\n";
+    }
+}
+
+void mixed(std::string &out, size_t n, uint64_t seed) {
+    uint64_t state = seed | 1;
+    const char *operands[] = {" add ", " subtract ", " multiply "};
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t random = nextRandom(state);
+        size_t reg = random % 4096;
+        switch ((random >> 16) % 8) {
+            case 0:
+                out += "print ";
+                appendRegister(out, "m", reg);
+                break;
+            case 1:
+                appendRegister(out, "m", reg);
+                out += operands[(random >> 24) % 2];
+                appendRegister(out, "m", (random >> 32) % 4096);
+                break;
+            default:
+                appendRegister(out, "m", reg);
+                out += operands[(random >> 24) % 3];
+                out += std::to_string((random >> 32) % 100);
+                break;
+        }
+        out += '\n';
+    }
+}
+
+void graph(std::string &out, size_t n, uint64_t seed) {
+    uint64_t state = seed | 1;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t random = nextRandom(state);
+        appendRegister(out, "g", i);
+        out += " add ";
+        out += std::to_string(random % 100);
+        out += '\n';
+        if (i > 0) {
+            appendRegister(out, "g", i);
+            out += " add ";
+            appendRegister(out, "g", (random >> 8) % i);
+            out += '\n';
+        }
+    }
+}
+
+void reads(std::string &out, size_t n, size_t registers, uint64_t seed) {
+    uint64_t state = seed | 1;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t random = nextRandom(state);
+        size_t reg = (random >> 8) % registers;
+        if (random % 100 < 95) {
+            out += "print ";
+            appendRegister(out, "g", reg);
+        } else {
+            appendRegister(out, "g", reg);
+            out += " add 1";
+        }
+        out += '\n';
+    }
+}
+
+void table(std::string &out, size_t n, size_t columns, uint64_t seed) {
+    for (size_t column = 0; column < columns; ++column) {
+        if (column > 0) out += ',';
+        appendRegister(out, "g", column);
+    }
+    out += '\n';
+    uint64_t state = seed | 1;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t column = 0; column < columns; ++column) {
+            uint64_t random = nextRandom(state);
+            if (column > 0) out += ',';
+            out += std::to_string(static_cast<int64_t>(random % 2000001) - 1000000);
+        }
+        out += '\n';
+    }
+}
+
+void noisy(std::string &out, size_t n, uint64_t seed) {
+    // Tokens are mostly short, with some long enough to span several
+    // blocks of the lexer, and separated by runs of any whitespace.
+    uint64_t state = seed | 1;
+    const char whitespace[] = " \t\n\v\f\r";
+    const char keywords[][9] = {"ADD", "Subtract", "mUlTiPlY", "print", "QUIT"};
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t random = nextRandom(state);
+        if (random % 16 == 0) {
+            out += keywords[(random >> 8) % 5];
+        } else {
+            size_t length = (random >> 8) % 32 == 0 ? 1 + (random >> 16) % 200 : 1 + (random >> 16) % 8;
+            for (size_t j = 0; j < length; ++j) {
+                // Mostly letters of both cases and digits, sometimes any byte
+                uint64_t pick = nextRandom(state);
+                switch (pick % 8) {
+                    case 0:  out += static_cast<char>('0' + (pick >> 8) % 10); break;
+                    case 1:
+                    case 2:  out += static_cast<char>('A' + (pick >> 8) % 26); break;
+                    case 7:  out += static_cast<char>((pick >> 8) % 32 == 0 ? (pick >> 16) % 256 : 'x'); break;
+                    default: out += static_cast<char>('a' + (pick >> 8) % 26); break;
+                }
+            }
+        }
+        size_t spaces = 1 + (random >> 32) % 3;
+        for (size_t j = 0; j < spaces; ++j) {
+            out += whitespace[(random >> (40 + 4 * j)) % 6];
+        }
+    }
+}
+
+bool largeFile(const std::string &filename, uint64_t bytes) {
+    // Write blocks of mixed instructions (with different seeds, so
+    // that the registers keep changing), until the file is large enough.
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (file.fail()) {
+        return false;
+    }
+    std::string block;
+    uint64_t written = 0;
+    for (uint64_t seed = 1; written < bytes; ++seed) {
+        block.clear();
+        mixed(block, 100000, seed);
+        file.write(block.data(), static_cast<std::streamsize>(block.size()));
+        written += block.size();
+    }
+    return !file.fail();
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * This file contains generators for the synthetic workloads used by
+ * the benchmarks. Each generator appends a calculator script to the
+ * given string, sized by the parameter 'n'.
+ *
+ * The workloads are:
+ *  > chain:     a linear chain of n registers (r1 add r2, r2 add r3, ...),
+ *               printed from the top after every change at the bottom.
+ *  > fanin:     one register adding up n other registers.
+ *  > diamond:   n layers of two registers, each using both registers of
+ *               the layer below (the number of paths doubles per layer).
+ *  > distinct:  n distinct registers, each with a few literal operations.
+ *  > prints:    a few registers, printed n times (with some changes).
+ *  > mixed:     a random mix of operations and prints on a pool of
+ *               registers, which is also used for the large file input.
+ *  > graph:     n registers, each with a literal and (except the first)
+ *               a reference to a random register before it, so the
+ *               dependency chains are short but overlapping.
+ *  > reads:     n random lines on the registers of a graph workload of
+ *               the given size, of which 95% print a register and 5%
+ *               add to one (for the shared registers workload).
+ *  > table:     a seed table (see "columnar.h") in CSV, with a column
+ *               for each of the first registers of a graph workload,
+ *               and n rows of random values.
+ *  > noisy:     n random tokens of mixed case letters, digits and other
+ *               bytes, separated by all kinds of whitespace (only for
+ *               the lexer, it is not a valid script).
+ */
+namespace Workloads {
+
+void chain(std::string &out, size_t n);
+void fanin(std::string &out, size_t n);
+void diamond(std::string &out, size_t n);
+void distinct(std::string &out, size_t n);
+void prints(std::string &out, size_t n);
+void mixed(std::string &out, size_t n, uint64_t seed);
+void graph(std::string &out, size_t n, uint64_t seed);
+void reads(std::string &out, size_t n, size_t registers, uint64_t seed);
+void table(std::string &out, size_t n, size_t columns, uint64_t seed);
+void noisy(std::string &out, size_t n, uint64_t seed);
+
+/* Write a file of (at least) the given size, made of mixed workload
+ * blocks. Returns false if the file could not be written. */
+bool largeFile(const std::string &filename, uint64_t bytes);
+
+}
+
+#endif // WORKLOADS_H
@@ -0,0 +1,154 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "batch.h"
+#include "evaluator.h"
+#include "mappedfile.h"
+#include "output.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "threadpool.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/* Seconds elapsed since the given time. */
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+}
+
+Batch::Batch(const std::vector<std::string> &filenames, const std::string &outputDir)
+    : outputDir(outputDir), next(0), seconds(0) {
+    for (const std::string &filename : filenames) {
+        std::unique_ptr<Job> job(new Job());
+        job->filename = filename;
+        job->opened = false;
+        job->written = true;
+        job->done = false;
+        job->seconds = 0;
+        job->bytes = 0;
+        jobs.push_back(std::move(job));
+    }
+}
+
+bool Batch::readManifest(const std::string &manifest, std::vector<std::string> &filenames) {
+    std::ifstream file(manifest);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        // Trim the whitespace around the name (and a '\r' line ending)
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos) continue;
+        size_t last = line.find_last_not_of(" \t\r");
+        filenames.push_back(line.substr(first, last - first + 1));
+    }
+    return true;
+}
+
+void Batch::run(unsigned threads) {
+    Clock::time_point start = Clock::now();
+    std::vector<uint32_t> items;
+    for (uint32_t i = 0; i < jobs.size(); ++i) {
+        items.push_back(i);
+    }
+    ThreadPool pool(threads);
+    pool.run(&Batch::runTask, this, items);
+    seconds = secondsSince(start);
+}
+
+void Batch::runTask(void *context, uint32_t item) {
+    Batch &batch = *static_cast<Batch *>(context);
+    Job &job = *batch.jobs[item];
+
+    if (batch.outputDir.empty()) {
+        batch.runFile(job, job.output);
+    } else {
+        // (A file whose output cannot be written is not run at all)
+        std::ofstream file(batch.outputName(job.filename));
+        if (file.is_open()) {
+            batch.runFile(job, file);
+            file.close();
+        }
+        job.written = static_cast<bool>(file);
+    }
+    batch.finish(item);
+}
+
+void Batch::runFile(Job &job, std::ostream &stream) {
+    Clock::time_point start = Clock::now();
+
+    // A session of its own, as if the file was run on its own
+    // (with its output buffered, and written to the stream when done)
+    Output out(stream);
+    out.setPolicy(FLUSH_FULL);
+    MappedFile file;
+    job.opened = file.open(job.filename);
+    if (!job.opened) {
+        out << "Could not open file: " << job.filename << '\n';
+    } else {
+        out << "Reading from file: " << job.filename << '\n';
+        job.bytes = file.size();
+        Symbols symbols;
+        Parser parser(symbols);
+        Evaluator evaluator(symbols);
+        evaluator.setOutput(out);
+        Pipeline(parser, evaluator).runSerial(file.begin(), file.end());
+    }
+
+    job.seconds = secondsSince(start);
+}
+
+void Batch::finish(size_t index) {
+    std::lock_guard<std::mutex> guard(lock);
+    jobs[index]->done = true;
+    Output &console = Output::console();
+    while (next < jobs.size() && jobs[next]->done) {
+        std::ostringstream &output = jobs[next]->output;
+        if (outputDir.empty()) {
+            console << output.str();
+            output.str(std::string());
+        }
+        ++next;
+    }
+    console.flush();
+}
+
+std::string Batch::outputName(const std::string &filename) const {
+    // The path of the input file, flattened into one name, so that
+    // files with the same name in different directories do not clash
+    std::string name = filename;
+    for (char &c : name) {
+        if (c == '/' || c == '\\' || c == ':') c = '_';
+    }
+    return outputDir + "/" + name + ".out";
+}
+
+void Batch::summary(std::ostream &out) const {
+    double total = 0;
+    size_t failed = 0;
+    out << "Batch summary:" << std::endl;
+    for (const std::unique_ptr<Job> &job : jobs) {
+        out << "  " << std::fixed << std::setprecision(6) << job->seconds << " s  ";
+        if (!job->written) {
+            out << std::setw(12) << "-" << "        " << job->filename << " (could not write "
+                << outputName(job->filename) << ")" << std::endl;
+            ++failed;
+        } else if (job->opened) {
+            out << std::setw(12) << job->bytes << " bytes  " << job->filename << std::endl;
+        } else {
+            out << std::setw(12) << "-" << "        " << job->filename << " (could not open)" << std::endl;
+            ++failed;
+        }
+        total += job->seconds;
+    }
+    out << "  " << jobs.size() << " files (" << failed << " failed), "
+        << total << " s in the files, " << seconds << " s in total" << std::endl;
+    out << std::defaultfloat;
+}
@@ -0,0 +1,94 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * This class runs many input files in one process (batch mode),
+ * spread over the cores.
+ *
+ * Each file is run in a session of its own, with its own symbols,
+ * parser and evaluator, so the files are independent of each other,
+ * exactly as if each was run by a separate calculator process (a
+ * quit instruction only ends its own file). The files are the tasks
+ * of a job on a thread pool (see "threadpool.h"), so the cores take
+ * files off each other's queues until all are done.
+ *   The output of each file is written either to a file of its own
+ * in an output directory, or to a buffer of its own. The buffers are
+ * written to the console in the order the files were given, each as
+ * soon as the files before it are done, so the console output is the
+ * same however the files are spread over the threads (and the same as
+ * running the calculator on each file in turn).
+ *   The time spent on each file is measured, and a summary of the
+ * times is written when the batch is done, with the files that could
+ * not be opened, or whose output file could not be written (which are
+ * counted as failed).
+ */
+class Batch {
+
+private:
+
+    // A file of the batch, and what happened when running it
+    struct Job {
+        std::string filename;
+        std::ostringstream output;  // Output (when writing to the console)
+        bool opened;                // Whether the file could be opened
+        bool written;               // Whether its output file could be written
+        bool done;
+        double seconds;             // Time spent running the file
+        size_t bytes;               // Size of the file
+    };
+
+    std::vector<std::unique_ptr<Job>> jobs;
+
+    // Directory for the output files (empty for the console)
+    std::string outputDir;
+
+    // Guards writing the buffered output to the console
+    std::mutex lock;
+
+    // Index of the next job to write to the console
+    size_t next;
+
+    // Wall clock time of the whole batch
+    double seconds;
+
+public:
+
+    /* Create a batch of the given files. If an output directory is
+     * given, the output of each file is written to a file in it. */
+    Batch(const std::vector<std::string> &filenames, const std::string &outputDir);
+
+    /* Read the file names listed in a manifest (one per line, blank
+     * lines are skipped), and add them to the list. Returns false
+     * if the manifest could not be opened. */
+    static bool readManifest(const std::string &manifest, std::vector<std::string> &filenames);
+
+    /* Run all files, on the given number of threads. */
+    void run(unsigned threads);
+
+    /* Write the time spent on each file, and in total. */
+    void summary(std::ostream &out) const;
+
+private:
+
+    /* Run the file of one job (a task of the thread pool). */
+    static void runTask(void *context, uint32_t item);
+
+    /* Run the file of the given job, writing its output to 'stream'. */
+    void runFile(Job &job, std::ostream &stream);
+
+    /* Mark a job as done, and write the output of all jobs that
+     * are next in order and done to the console. */
+    void finish(size_t index);
+
+    /* Return the name of the output file of the given input file. */
+    std::string outputName(const std::string &filename) const;
+
+};
+
+#endif // BATCH_H
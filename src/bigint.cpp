@@ -0,0 +1,228 @@
+#include <algorithm>
+
+#include "bigint.h"
+
+BigInt::BigInt() : negative(false) {
+}
+
+BigInt::BigInt(int64_t value) {
+    // (The magnitude is computed unsigned, so INT64_MIN works too)
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    assign(value < 0, &magnitude, 1);
+}
+
+#ifdef HAVE_INT128
+BigInt::BigInt(Int128 value) {
+    typedef unsigned __int128 UInt128;
+    UInt128 magnitude = value < 0 ? 0 - static_cast<UInt128>(value) : static_cast<UInt128>(value);
+    uint64_t parts[2] = {static_cast<uint64_t>(magnitude), static_cast<uint64_t>(magnitude >> 64)};
+    assign(value < 0, parts, 2);
+}
+#endif
+
+void BigInt::assign(bool negative, const uint64_t *parts, size_t count) {
+    this->negative = negative;
+    limbs.clear();
+    for (size_t i = 0; i < count; ++i) {
+        limbs.push_back(static_cast<uint32_t>(parts[i]));
+        limbs.push_back(static_cast<uint32_t>(parts[i] >> 32));
+    }
+    trim();
+}
+
+bool BigInt::parse(const char *text, size_t length, BigInt &out) {
+    if (length == 0) {
+        return false;
+    }
+    out = BigInt();
+    // Multiply by ten and add each digit, in place
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        uint64_t carry = static_cast<uint64_t>(text[i] - '0');
+        for (uint32_t &limb : out.limbs) {
+            uint64_t product = static_cast<uint64_t>(limb) * 10 + carry;
+            limb = static_cast<uint32_t>(product);
+            carry = product >> 32;
+        }
+        if (carry) {
+            out.limbs.push_back(static_cast<uint32_t>(carry));
+        }
+    }
+    out.trim();
+    return true;
+}
+
+int BigInt::compareMagnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+    if (a.size() != b.size()) {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (size_t i = a.size(); i > 0; --i) {
+        if (a[i - 1] != b[i - 1]) {
+            return a[i - 1] < b[i - 1] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+void BigInt::addMagnitude(std::vector<uint32_t> &a, const std::vector<uint32_t> &b) {
+    if (a.size() < b.size()) {
+        a.resize(b.size(), 0);
+    }
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < b.size(); ++i) {
+        uint64_t total = static_cast<uint64_t>(a[i]) + b[i] + carry;
+        a[i] = static_cast<uint32_t>(total);
+        carry = total >> 32;
+    }
+    for (; carry && i < a.size(); ++i) {
+        uint64_t total = static_cast<uint64_t>(a[i]) + carry;
+        a[i] = static_cast<uint32_t>(total);
+        carry = total >> 32;
+    }
+    if (carry) {
+        a.push_back(static_cast<uint32_t>(carry));
+    }
+}
+
+void BigInt::subtractMagnitude(std::vector<uint32_t> &a, const std::vector<uint32_t> &b, bool reverse) {
+    if (a.size() < b.size()) {
+        a.resize(b.size(), 0);
+    }
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        int64_t x = a[i];
+        int64_t y = i < b.size() ? b[i] : 0;
+        int64_t total = (reverse ? y - x : x - y) - borrow;
+        borrow = total < 0 ? 1 : 0;
+        a[i] = static_cast<uint32_t>(total + (borrow << 32));
+    }
+}
+
+void BigInt::add(const BigInt &other, bool negativeOther) {
+    if (negative == negativeOther) {
+        addMagnitude(limbs, other.limbs);
+    } else if (compareMagnitude(limbs, other.limbs) >= 0) {
+        subtractMagnitude(limbs, other.limbs, false);
+    } else {
+        subtractMagnitude(limbs, other.limbs, true);
+        negative = negativeOther;
+    }
+    trim();
+}
+
+BigInt &BigInt::operator+=(const BigInt &other) {
+    add(other, other.negative);
+    return *this;
+}
+
+BigInt &BigInt::operator-=(const BigInt &other) {
+    add(other, !other.negative);
+    return *this;
+}
+
+BigInt BigInt::operator+(const BigInt &other) const {
+    BigInt result(*this);
+    result += other;
+    return result;
+}
+
+BigInt BigInt::operator-(const BigInt &other) const {
+    BigInt result(*this);
+    result -= other;
+    return result;
+}
+
+BigInt BigInt::operator*(const BigInt &other) const {
+    BigInt result;
+    if (limbs.empty() || other.limbs.empty()) {
+        return result;
+    }
+    result.limbs.assign(limbs.size() + other.limbs.size(), 0);
+    for (size_t i = 0; i < limbs.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < other.limbs.size(); ++j) {
+            uint64_t total = static_cast<uint64_t>(limbs[i]) * other.limbs[j] + result.limbs[i + j] + carry;
+            result.limbs[i + j] = static_cast<uint32_t>(total);
+            carry = total >> 32;
+        }
+        result.limbs[i + other.limbs.size()] = static_cast<uint32_t>(carry);
+    }
+    result.negative = negative != other.negative;
+    result.trim();
+    return result;
+}
+
+bool BigInt::fitsInt64() const {
+    // The magnitude must be below 2^63 (or equal to it, if negative)
+    if (limbs.size() <= 1) return true;
+    if (limbs.size() > 2) return false;
+    if (limbs[1] < 0x80000000u) return true;
+    return negative && limbs[1] == 0x80000000u && limbs[0] == 0;
+}
+
+int64_t BigInt::toInt64() const {
+    uint64_t magnitude = 0;
+    for (size_t i = limbs.size(); i > 0; --i) {
+        magnitude = (magnitude << 32) | limbs[i - 1];
+    }
+    return static_cast<int64_t>(negative ? 0 - magnitude : magnitude);
+}
+
+#ifdef HAVE_INT128
+bool BigInt::fitsInt128() const {
+    if (limbs.size() <= 3) return true;
+    if (limbs.size() > 4) return false;
+    if (limbs[3] < 0x80000000u) return true;
+    return negative && limbs[3] == 0x80000000u && limbs[2] == 0 && limbs[1] == 0 && limbs[0] == 0;
+}
+
+Int128 BigInt::toInt128() const {
+    typedef unsigned __int128 UInt128;
+    UInt128 magnitude = 0;
+    for (size_t i = limbs.size(); i > 0; --i) {
+        magnitude = (magnitude << 32) | limbs[i - 1];
+    }
+    return static_cast<Int128>(negative ? 0 - magnitude : magnitude);
+}
+#endif
+
+std::string BigInt::str() const {
+    if (limbs.empty()) {
+        return "0";
+    }
+    // Divide by 10^9 repeatedly, collecting the remainders as digits
+    std::vector<uint32_t> rest = limbs;
+    std::string digits;
+    while (!rest.empty()) {
+        uint64_t remainder = 0;
+        for (size_t i = rest.size(); i > 0; --i) {
+            uint64_t current = (remainder << 32) | rest[i - 1];
+            rest[i - 1] = static_cast<uint32_t>(current / 1000000000u);
+            remainder = current % 1000000000u;
+        }
+        while (!rest.empty() && rest.back() == 0) {
+            rest.pop_back();
+        }
+        for (int i = 0; i < 9 && (remainder != 0 || !rest.empty()); ++i) {
+            digits += static_cast<char>('0' + remainder % 10);
+            remainder /= 10;
+        }
+    }
+    if (negative) {
+        digits += '-';
+    }
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+void BigInt::trim() {
+    while (!limbs.empty() && limbs.back() == 0) {
+        limbs.pop_back();
+    }
+    if (limbs.empty()) {
+        negative = false;
+    }
+}
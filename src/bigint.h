@@ -0,0 +1,90 @@
+#ifndef BIGINT_H
+#define BIGINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * This class is an arbitrary precision integer, used for the values
+ * that do not fit in 128 bits (see "number.h").
+ *
+ * The integer is stored as a sign and a magnitude, which is a list of
+ * 32-bit limbs (least significant first, without leading zero limbs,
+ * so zero has no limbs). The arithmetic is the schoolbook method,
+ * which is simple and fast enough for the sizes of numbers that the
+ * calculator reaches in practice.
+ */
+
+#if defined(__SIZEOF_INT128__)
+#define HAVE_INT128 1
+typedef __int128 Int128;
+#endif
+
+class BigInt {
+
+private:
+
+    bool negative;
+    std::vector<uint32_t> limbs;
+
+public:
+
+    /* Create a big integer with the value zero. */
+    BigInt();
+
+    /* Create a big integer with the given value. */
+    explicit BigInt(int64_t value);
+#ifdef HAVE_INT128
+    explicit BigInt(Int128 value);
+#endif
+
+    /* Read a number from the given decimal digits. Returns false
+     * if the text is empty or has anything but digits. */
+    static bool parse(const char *text, size_t length, BigInt &out);
+
+    /* Arithmetic (sums can also be done in place, which reuses the
+     * limbs of the number). */
+    BigInt &operator+=(const BigInt &other);
+    BigInt &operator-=(const BigInt &other);
+    BigInt operator+(const BigInt &other) const;
+    BigInt operator-(const BigInt &other) const;
+    BigInt operator*(const BigInt &other) const;
+
+    /* Return whether the value fits in a 64-bit integer, and the
+     * value as a 64-bit integer (if it fits). */
+    bool fitsInt64() const;
+    int64_t toInt64() const;
+
+#ifdef HAVE_INT128
+    /* Same as above, for 128-bit integers. */
+    bool fitsInt128() const;
+    Int128 toInt128() const;
+#endif
+
+    /* Return the value in decimal. */
+    std::string str() const;
+
+private:
+
+    /* Build from a sign and the magnitude, given as 64-bit parts. */
+    void assign(bool negative, const uint64_t *parts, size_t count);
+
+    /* Compare the magnitudes of two numbers (-1, 0 or 1). */
+    static int compareMagnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b);
+
+    /* Add magnitudes, or subtract the smaller from the larger
+     * (a - b, or b - a if 'reverse'), storing the result in 'a'. */
+    static void addMagnitude(std::vector<uint32_t> &a, const std::vector<uint32_t> &b);
+    static void subtractMagnitude(std::vector<uint32_t> &a, const std::vector<uint32_t> &b, bool reverse);
+
+    /* Add a number with the given sign (used for both + and -). */
+    void add(const BigInt &other, bool negativeOther);
+
+    /* Remove leading zero limbs (and the sign of zero). */
+    void trim();
+
+};
+
+#endif // BIGINT_H
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "bytecode.h"
+#include "number.h"
+
+namespace {
+
+/* The interpreter loop. Called with a null 'labels' pointer it runs
+ * the code from 'pc' (see Bytecode::run). Otherwise it only stores
+ * the table of handler addresses in 'labels', which is needed for
+ * compiling threaded code (the addresses are only known in here). */
+Bytecode::Status interpret(const Word *code, size_t &pc, int64_t &acc,
+                           const int64_t *values, const uint8_t *evaluated,
+                           uint64_t &reads, Opcode &stopped, const void *const **labels) {
+#ifdef BYTECODE_THREADED
+    static const void *const handlers[] = {
+        &&affine, &&add_reg, &&sub_reg, &&mul_reg, &&add_num, &&sub_num, &&mul_num, &&halt
+    };
+    if (labels) {
+        *labels = handlers;
+        return Bytecode::FINISHED;
+    }
+
+    const Word *ip = code + pc;
+    int64_t a = acc;
+    int64_t t;
+    uint64_t r = 0;
+    uint64_t slot;
+    Bytecode::Status status;
+    Opcode opcode;
+
+    // Jump straight to the handler of the next instruction; a handler
+    // that cannot run its instruction leaves with its opcode, so the
+    // caller can resume there without looking it up
+    #define DISPATCH() goto *ip->label
+    #define LEAVE(op, exit) do { opcode = op; goto exit; } while (0)
+
+    DISPATCH();
+
+affine:
+    if (!checkedMultiply(a, ip[1].value, t) || !checkedAdd(t, ip[2].value, t)) LEAVE(AFFINE, widen);
+    a = t;
+    ip += 3;
+    DISPATCH();
+add_reg:
+    slot = ip[1].slot;
+    if (evaluated[slot] != EVALUATED) LEAVE(ADD_REG, unavailable);
+    if (!checkedAdd(a, values[slot], t)) LEAVE(ADD_REG, widen);
+    a = t;
+    ++r;
+    ip += 2;
+    DISPATCH();
+sub_reg:
+    slot = ip[1].slot;
+    if (evaluated[slot] != EVALUATED) LEAVE(SUB_REG, unavailable);
+    if (!checkedSubtract(a, values[slot], t)) LEAVE(SUB_REG, widen);
+    a = t;
+    ++r;
+    ip += 2;
+    DISPATCH();
+mul_reg:
+    slot = ip[1].slot;
+    if (evaluated[slot] != EVALUATED) LEAVE(MUL_REG, unavailable);
+    if (!checkedMultiply(a, values[slot], t)) LEAVE(MUL_REG, widen);
+    a = t;
+    ++r;
+    ip += 2;
+    DISPATCH();
+
+    // (Operations on numbers of more than 64 bits are never fast)
+add_num:
+    LEAVE(ADD_NUM, widen);
+sub_num:
+    LEAVE(SUB_NUM, widen);
+mul_num:
+    LEAVE(MUL_NUM, widen);
+
+    #undef LEAVE
+    #undef DISPATCH
+
+halt:
+    opcode = HALT;
+    status = Bytecode::FINISHED;
+    goto stop;
+unavailable:
+    status = evaluated[slot] == NOT_EVALUATED ? Bytecode::BLOCKED : Bytecode::WIDENED;
+    goto stop;
+widen:
+    status = Bytecode::WIDENED;
+stop:
+    pc = static_cast<size_t>(ip - code);
+    acc = a;
+    reads += r;
+    stopped = opcode;
+    return status;
+#else
+    (void) labels;
+    const Word *ip = code + pc;
+    int64_t a = acc;
+    int64_t t;
+    uint64_t r = 0;
+    uint64_t slot;
+    Bytecode::Status status;
+    while (true) {
+        switch (static_cast<Opcode>(ip->opcode)) {
+            case AFFINE:
+                if (!checkedMultiply(a, ip[1].value, t) || !checkedAdd(t, ip[2].value, t)) goto widen;
+                a = t;
+                ip += 3;
+                continue;
+            case ADD_REG:
+                slot = ip[1].slot;
+                if (evaluated[slot] != EVALUATED) goto unavailable;
+                if (!checkedAdd(a, values[slot], t)) goto widen;
+                a = t;
+                ++r;
+                break;
+            case SUB_REG:
+                slot = ip[1].slot;
+                if (evaluated[slot] != EVALUATED) goto unavailable;
+                if (!checkedSubtract(a, values[slot], t)) goto widen;
+                a = t;
+                ++r;
+                break;
+            case MUL_REG:
+                slot = ip[1].slot;
+                if (evaluated[slot] != EVALUATED) goto unavailable;
+                if (!checkedMultiply(a, values[slot], t)) goto widen;
+                a = t;
+                ++r;
+                break;
+            case HALT:
+                status = Bytecode::FINISHED;
+                goto stop;
+            default:
+                goto widen;
+        }
+        ip += 2;
+    }
+unavailable:
+    status = evaluated[slot] == NOT_EVALUATED ? Bytecode::BLOCKED : Bytecode::WIDENED;
+    goto stop;
+widen:
+    status = Bytecode::WIDENED;
+stop:
+    pc = static_cast<size_t>(ip - code);
+    acc = a;
+    reads += r;
+    stopped = static_cast<Opcode>(ip->opcode);
+    return status;
+#endif
+}
+
+#ifdef BYTECODE_THREADED
+/* Return the table of handler addresses of the interpreter. */
+const void *const *handlerTable() {
+    const void *const *labels = nullptr;
+    size_t pc = 0;
+    int64_t acc = 0;
+    uint64_t reads = 0;
+    Opcode stopped;
+    interpret(nullptr, pc, acc, nullptr, nullptr, reads, stopped, &labels);
+    return labels;
+}
+
+/* The opcodes of the handler addresses, for finding the opcode of a
+ * word without searching. The handlers are close together, so the
+ * offset of an address from the lowest one, shifted right as far as
+ * the handlers stay apart, indexes a small table. */
+struct HandlerIndex {
+    uintptr_t base;
+    unsigned shift;
+    std::vector<uint8_t> opcodes;   // Opcode at each index, or NO_OPCODE
+
+    static const uint8_t NO_OPCODE = 0xff;
+
+    HandlerIndex() : base(UINTPTR_MAX), shift(0) {
+        const void *const *labels = handlerTable();
+        uintptr_t top = 0;
+        for (int opcode = AFFINE; opcode <= HALT; ++opcode) {
+            base = std::min(base, reinterpret_cast<uintptr_t>(labels[opcode]));
+            top = std::max(top, reinterpret_cast<uintptr_t>(labels[opcode]));
+        }
+        while (shift < 16 && distinct(labels, shift + 1)) {
+            ++shift;
+        }
+        opcodes.assign(((top - base) >> shift) + 1, NO_OPCODE);
+        for (int opcode = AFFINE; opcode <= HALT; ++opcode) {
+            opcodes[(reinterpret_cast<uintptr_t>(labels[opcode]) - base) >> shift] = static_cast<uint8_t>(opcode);
+        }
+    }
+
+    /* Return whether all handlers have distinct indexes with the given shift. */
+    bool distinct(const void *const *labels, unsigned bits) const {
+        for (int i = AFFINE; i <= HALT; ++i) {
+            for (int j = AFFINE; j < i; ++j) {
+                if ((reinterpret_cast<uintptr_t>(labels[i]) - base) >> bits ==
+                    (reinterpret_cast<uintptr_t>(labels[j]) - base) >> bits) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+const uint8_t HandlerIndex::NO_OPCODE;
+#endif
+
+/* Return the number of words of the instruction with the given opcode. */
+size_t instructionLength(Opcode opcode) {
+    switch (opcode) {
+        case AFFINE: return 3;
+        case HALT:   return 1;
+        default:     return 2;
+    }
+}
+
+/* Return the word for the given opcode. */
+Word opcodeWord(Opcode opcode) {
+    Word word;
+#ifdef BYTECODE_THREADED
+    static const void *const *labels = handlerTable();
+    word.label = labels[opcode];
+#else
+    word.opcode = opcode;
+#endif
+    return word;
+}
+
+/* Return the opcode of the given opcode word. */
+Opcode wordOpcode(Word word) {
+#ifdef BYTECODE_THREADED
+    static const HandlerIndex index;
+    size_t at = (reinterpret_cast<uintptr_t>(word.label) - index.base) >> index.shift;
+    return at < index.opcodes.size() && index.opcodes[at] != HandlerIndex::NO_OPCODE
+        ? static_cast<Opcode>(index.opcodes[at]) : HALT;
+#else
+    return static_cast<Opcode>(word.opcode);
+#endif
+}
+
+/* Return the operand of an arithmetic opcode. */
+Operand opcodeOperand(Opcode opcode) {
+    switch (opcode) {
+        case SUB_REG:
+        case SUB_NUM:
+            return SUBTRACT;
+        case MUL_REG:
+        case MUL_NUM:
+            return MULTIPLY;
+        default:
+            return ADD;
+    }
+}
+
+/* Append the identity map x -> 1 * x + 0, followed by a HALT. */
+void appendIdentity(Program &program) {
+    Word one, zero;
+    one.value = 1;
+    zero.value = 0;
+    program.push_back(opcodeWord(AFFINE));
+    program.push_back(one);
+    program.push_back(zero);
+    program.push_back(opcodeWord(HALT));
+}
+
+}
+
+namespace Bytecode {
+
+void append(Program &program, Operand op, ValueKind kind, int64_t value) {
+    // A new program starts with the identity map
+    if (program.empty()) {
+        appendIdentity(program);
+    }
+
+    // A constant is composed into the AFFINE before the HALT:
+    // a*x + b becomes a*x + (b + c), a*x + (b - c) or (a*c)*x + (b*c).
+    // If that overflows, a new AFFINE is started (which a single
+    // constant can never overflow).
+    if (kind == LITERAL) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            int64_t a = program[program.size() - 3].value;
+            int64_t b = program[program.size() - 2].value;
+            bool fits;
+            switch (op) {
+                case SUBTRACT: fits = checkedSubtract(b, value, b); break;
+                case MULTIPLY: fits = checkedMultiply(a, value, a) && checkedMultiply(b, value, b); break;
+                default:       fits = checkedAdd(b, value, b); break;
+            }
+            if (fits) {
+                program[program.size() - 3].value = a;
+                program[program.size() - 2].value = b;
+                return;
+            }
+            program.pop_back();
+            appendIdentity(program);
+        }
+        return;
+    }
+
+    // Replace the HALT at the end with the instruction reading the
+    // register (or big constant), followed by an identity map, and
+    // end with a new HALT.
+    Opcode opcode;
+    switch (op) {
+        case SUBTRACT: opcode = (kind == REFERENCE) ? SUB_REG : SUB_NUM; break;
+        case MULTIPLY: opcode = (kind == REFERENCE) ? MUL_REG : MUL_NUM; break;
+        default:       opcode = (kind == REFERENCE) ? ADD_REG : ADD_NUM; break;
+    }
+    Word argument;
+    argument.slot = static_cast<uint64_t>(value);
+    program.pop_back();
+    program.push_back(opcodeWord(opcode));
+    program.push_back(argument);
+    appendIdentity(program);
+}
+
+Status run(const Program &program, size_t &pc, int64_t &acc,
+           const int64_t *values, const uint8_t *evaluated, uint64_t &reads, Opcode &opcode) {
+    return interpret(program.data(), pc, acc, values, evaluated, reads, opcode, nullptr);
+}
+
+Status runWide(const Program &program, size_t &pc, Opcode &opcode, Number &acc,
+               const int64_t *values, const uint8_t *evaluated,
+               const std::unique_ptr<Number> *wideValues, const Number *constants,
+               uint64_t &reads) {
+    // The same as run(), but on numbers of any size, instruction by
+    // instruction (this is the slow path, so it is kept simple).
+    while (true) {
+        switch (opcode) {
+            case AFFINE:
+                // (Most maps are the identity between two reads, which
+                // costs nothing on 64 bits but a pass over a big number)
+                if (program[pc + 1].value != 1) {
+                    acc.apply(MULTIPLY, Number(program[pc + 1].value));
+                }
+                if (program[pc + 2].value != 0) {
+                    acc.apply(ADD, Number(program[pc + 2].value));
+                }
+                break;
+            case ADD_REG:
+            case SUB_REG:
+            case MUL_REG: {
+                uint64_t slot = program[pc + 1].slot;
+                if (evaluated[slot] == NOT_EVALUATED) {
+                    return BLOCKED;
+                }
+                if (evaluated[slot] == EVALUATED_WIDE) {
+                    acc.apply(opcodeOperand(opcode), *wideValues[slot]);
+                } else {
+                    acc.apply(opcodeOperand(opcode), Number(values[slot]));
+                }
+                ++reads;
+                break;
+            }
+            case ADD_NUM:
+            case SUB_NUM:
+            case MUL_NUM:
+                acc.apply(opcodeOperand(opcode), constants[program[pc + 1].slot]);
+                break;
+            case HALT:
+                return FINISHED;
+        }
+        pc += instructionLength(opcode);
+        opcode = wordOpcode(program[pc]);
+    }
+}
+
+RegisterId registerAt(const Program &program, size_t pc) {
+    return static_cast<RegisterId>(program[pc + 1].slot);
+}
+
+size_t references(const Program &program, std::vector<RegisterId> &out) {
+    size_t instructions = 0;
+    size_t pc = 0;
+    while (pc < program.size()) {
+        Opcode opcode = wordOpcode(program[pc]);
+        if (opcode == ADD_REG || opcode == SUB_REG || opcode == MUL_REG) {
+            out.push_back(registerAt(program, pc));
+        }
+        ++instructions;
+        pc += instructionLength(opcode);
+    }
+    return instructions;
+}
+
+void store(const Program &program, uint64_t *out) {
+    size_t pc = 0;
+    while (pc < program.size()) {
+        Opcode opcode = wordOpcode(program[pc]);
+        size_t length = instructionLength(opcode);
+        out[pc] = opcode;
+        for (size_t i = 1; i < length; ++i) {
+            out[pc + i] = program[pc + i].slot;
+        }
+        pc += length;
+    }
+}
+
+bool load(const uint64_t *words, size_t count, size_t registers, size_t constants, const RegisterId *ids,
+          Program &out) {
+    // Check the program while translating the opcodes: it starts
+    // with an AFFINE, ends with an AFFINE and a HALT, and all of
+    // its registers and constants are in range.
+    out.resize(count);
+    size_t pc = 0;
+    Opcode previous = HALT;
+    while (pc < count) {
+        uint64_t number = words[pc];
+        if (number > HALT) return false;
+        Opcode opcode = static_cast<Opcode>(number);
+        size_t length = instructionLength(opcode);
+        if (pc + length > count) return false;
+        if (pc == 0 && opcode != AFFINE) return false;
+        if (opcode == HALT && (previous != AFFINE || pc + 1 != count)) return false;
+        bool reads = opcode == ADD_REG || opcode == SUB_REG || opcode == MUL_REG;
+        if (reads && words[pc + 1] >= registers) return false;
+        if ((opcode == ADD_NUM || opcode == SUB_NUM || opcode == MUL_NUM) && words[pc + 1] >= constants) return false;
+        out[pc] = opcodeWord(opcode);
+        for (size_t i = 1; i < length; ++i) {
+            out[pc + i].slot = words[pc + i];
+        }
+        if (reads && ids) {
+            out[pc + 1].slot = ids[words[pc + 1]];
+        }
+        previous = opcode;
+        pc += length;
+    }
+    // (An empty program is a register without operations)
+    return count == 0 || previous == HALT;
+}
+
+}
@@ -0,0 +1,131 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include "definitions.h"
+#include "number.h"
+
+/*
+ * This file contains the bytecode that the operations of a register
+ * are compiled into, and the interpreter that runs it.
+ *
+ * The program of a register computes its value in an accumulator,
+ * which starts at zero. Every operation on a constant is an affine
+ * map of the accumulator (x -> x + c, x -> x - c or x -> x * c), and
+ * a run of such maps composes into a single one (x -> a * x + b). So
+ * the constant operations are folded into AFFINE instructions as they
+ * are added, and only the operations reading a register are kept as
+ * separate instructions. A program always has the form:
+ *     AFFINE <a> <b>  ( ADD_REG|SUB_REG|MUL_REG <r>  AFFINE <a> <b> )*  HALT
+ * Appending a constant operation updates the last AFFINE in place, and
+ * appending a register operation overwrites the HALT with the register
+ * instruction, an identity AFFINE and a new HALT. This way programs are
+ * compiled incrementally, in constant time per operation, and a register
+ * that only gets constant operations keeps a program of constant size
+ * (and constant evaluation time), however many operations it gets.
+ *
+ * The values are exact integers of any size (see "number.h"). The
+ * affine maps are composed exactly, as long as 'a' and 'b' fit in 64
+ * bits; when they would not, a new AFFINE is started after the last
+ * one instead. Constants that do not fit in 64 bits at all are kept
+ * in a table of numbers, and read with ADD_NUM, SUB_NUM and MUL_NUM
+ * (which, like the register instructions, are followed by an AFFINE).
+ *   The interpreter runs on 64-bit integers, with an overflow check
+ * on every operation, which costs next to nothing. When an operation
+ * overflows (or needs a value of more than 64 bits), the interpreter
+ * stops, and the caller continues the program from that instruction
+ * with runWide(), which works on numbers of any size.
+ *
+ * The interpreter is direct-threaded: each opcode in a program is
+ * stored as the address of the code handling it (using the computed
+ * goto extension of g++ and clang), so dispatching an instruction is
+ * a single indirect jump, with no switch and no table lookup. With
+ * other compilers, the opcodes are stored as numbers and dispatched
+ * with a switch instead.
+ *   A register instruction reading a register that is not evaluated
+ * yet stops the interpreter, so the caller can evaluate that register
+ * first and then resume the program where it stopped.
+ */
+
+#if defined(__GNUC__)
+#define BYTECODE_THREADED 1
+#endif
+
+/* The instructions of the bytecode. */
+enum Opcode {AFFINE, ADD_REG, SUB_REG, MUL_REG, ADD_NUM, SUB_NUM, MUL_NUM, HALT};
+
+/* Whether a register is evaluated, and if so, where its value is:
+ * in the 64-bit values, or (if it does not fit) in the wide values. */
+enum ValueState {NOT_EVALUATED, EVALUATED, EVALUATED_WIDE};
+
+/* A word of a program, either an opcode or an argument. */
+union Word {
+    const void *label;      // Opcode, as the address of its handler (threaded)
+    uint64_t opcode;        // Opcode, as a number (switch dispatch)
+    int64_t value;          // Literal argument
+    uint64_t slot;          // Register (or number table) argument
+};
+
+/* A compiled program, of one register. */
+typedef std::vector<Word> Program;
+
+namespace Bytecode {
+
+/* Why the interpreter stopped: the program is done, it reads a
+ * register that is not evaluated, or it needs more than 64 bits. */
+enum Status {FINISHED, BLOCKED, WIDENED};
+
+/* Compile an arithmetic operation, and append it to the program
+ * (folding it into the last AFFINE, if the value is a literal). For
+ * a BIG_LITERAL, the value is the index of the number in the table. */
+void append(Program &program, Operand op, ValueKind kind, int64_t value);
+
+/* Run the program from the instruction at 'pc', updating the
+ * accumulator 'acc'. The values of the registers are read from the
+ * given slots, as long as their state in 'evaluated' is EVALUATED
+ * (the number of registers read is added to 'reads').
+ *   Returns FINISHED when the program is done. Otherwise 'pc' is at
+ * the instruction that could not be run (so the program can be
+ * resumed from there), and BLOCKED is returned if it reads a register
+ * that is not evaluated, or WIDENED if it needs more than 64 bits.
+ * Either way, 'opcode' is set to the opcode of the instruction at 'pc'. */
+Status run(const Program &program, size_t &pc, int64_t &acc,
+           const int64_t *values, const uint8_t *evaluated, uint64_t &reads, Opcode &opcode);
+
+/* Run the program from the instruction at 'pc' (as above), on a
+ * number of any size, given the 'opcode' of that instruction (as set
+ * by run() or by a previous call). The registers in the EVALUATED_WIDE
+ * state are read from 'wideValues', and the big constants from
+ * 'constants'. Returns FINISHED or BLOCKED. */
+Status runWide(const Program &program, size_t &pc, Opcode &opcode, Number &acc,
+               const int64_t *values, const uint8_t *evaluated,
+               const std::unique_ptr<Number> *wideValues, const Number *constants,
+               uint64_t &reads);
+
+/* Return the register read by the instruction at 'pc'. */
+RegisterId registerAt(const Program &program, size_t pc);
+
+/* Add the registers read by the program to 'out', once for every
+ * instruction reading them, in order. Returns the number of
+ * instructions of the program. */
+size_t references(const Program &program, std::vector<RegisterId> &out);
+
+/* Write the program to 'out' in a portable form, with the opcodes
+ * stored as numbers (instead of handler addresses). */
+void store(const Program &program, uint64_t *out);
+
+/* Read a program written by store() from the given words. Returns
+ * false if the words are not a valid program, or if it reads a
+ * register with an id of 'registers' or more (or a number with an
+ * index of 'constants' or more). The ids of the registers read are
+ * translated through 'ids', unless it is null. */
+bool load(const uint64_t *words, size_t count, size_t registers, size_t constants, const RegisterId *ids,
+          Program &out);
+
+}
+
+#endif // BYTECODE_H
@@ -0,0 +1,770 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define COLUMNAR_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLUMNAR_AVX2 1
+#include <immintrin.h>
+#endif
+
+#include "columnar.h"
+#include "mappedfile.h"
+
+const uint32_t Columnar::NONE;
+
+namespace {
+
+// Version and byte order mark of the binary seed format
+const char SEEDS_MAGIC[8] = {'R', 'E', 'G', 'C', 'O', 'L', 'S', '\0'};
+const uint32_t SEEDS_VERSION = 1;
+const uint32_t SEEDS_BYTE_ORDER = 0x01020304;
+
+// Header of a binary seed file
+struct SeedsHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t columns;
+    uint64_t rows;
+};
+
+// Most rows in a block, and the most memory for the columns of a block
+const size_t BLOCK_ROWS = 4096;
+const size_t BLOCK_BYTES = 32 << 20;
+
+/* Round a size up to a multiple of 8 bytes. */
+size_t aligned(size_t bytes) {
+    return (bytes + 7) & ~static_cast<size_t>(7);
+}
+
+/* Return whether a name is a valid register name (letters and digits,
+ * with at least one letter), folding it to lower case. */
+bool foldName(std::string &name) {
+    bool letter = false;
+    for (char &c : name) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        if (c >= 'a' && c <= 'z') {
+            letter = true;
+        } else if (c < '0' || c > '9') {
+            return false;
+        }
+    }
+    return letter;
+}
+
+/* Trim the spaces and tabs around a field. */
+void trim(const char *&begin, const char *&end) {
+    while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+}
+
+/* Parse an integer that fits in 64 bits (the common case, without
+ * going through a big number). Returns false if it does not fit, or is
+ * not an integer. */
+bool parseSmall(const char *begin, const char *end, int64_t &out) {
+    bool negative = begin < end && *begin == '-';
+    begin += negative;
+    if (begin == end) {
+        return false;
+    }
+    int64_t value = 0;
+    for (; begin < end; ++begin) {
+        if (*begin < '0' || *begin > '9') {
+            return false;
+        }
+        int64_t digit = *begin - '0';
+        if (!checkedMultiply(value, 10, value) ||
+            !(negative ? checkedSubtract(value, digit, value) : checkedAdd(value, digit, value))) {
+            return false;
+        }
+    }
+    out = value;
+    return true;
+}
+
+/* Read the values of one CSV line into the seeds. Returns false if the
+ * line does not have a value for every column. */
+bool readRow(const char *begin, const char *end, Seeds &seeds) {
+    size_t column = 0;
+    const char *field = begin;
+    while (true) {
+        const char *comma = static_cast<const char *>(std::memchr(field, ',', static_cast<size_t>(end - field)));
+        const char *fieldEnd = comma ? comma : end;
+        const char *text = field;
+        trim(text, fieldEnd);
+        if (column >= seeds.columns.size()) {
+            return false;
+        }
+        int64_t small;
+        Number value;
+        if (parseSmall(text, fieldEnd, small)) {
+            seeds.columns[column].push_back(small);
+        } else if (!Number::parse(text, static_cast<size_t>(fieldEnd - text), value)) {
+            return false;
+        } else {
+            seeds.columns[column].push_back(0);
+            seeds.big[seeds.rows * seeds.columns.size() + column] = std::move(value);
+        }
+        ++column;
+        if (!comma) break;
+        field = comma + 1;
+    }
+    return column == seeds.columns.size();
+}
+
+/* Read a CSV seed file. */
+bool readCsv(const char *begin, const char *end, Seeds &seeds, std::string &error) {
+    size_t line = 0;
+    bool header = true;
+    while (begin < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+        if (!lineEnd) lineEnd = end;
+        ++line;
+        const char *text = begin;
+        const char *textEnd = lineEnd;
+        begin = lineEnd + 1;
+        trim(text, textEnd);
+        if (text == textEnd) continue;
+
+        if (header) {
+            // The names of the columns
+            header = false;
+            const char *field = text;
+            while (true) {
+                const char *comma = static_cast<const char *>(std::memchr(field, ',', static_cast<size_t>(textEnd - field)));
+                const char *fieldEnd = comma ? comma : textEnd;
+                const char *name = field;
+                trim(name, fieldEnd);
+                std::string folded(name, fieldEnd);
+                if (!foldName(folded)) {
+                    error = "invalid register name '" + std::string(name, fieldEnd) + "' in the header";
+                    return false;
+                }
+                if (std::find(seeds.names.begin(), seeds.names.end(), folded) != seeds.names.end()) {
+                    error = "register '" + folded + "' has more than one column";
+                    return false;
+                }
+                seeds.names.push_back(folded);
+                if (!comma) break;
+                field = comma + 1;
+            }
+            seeds.columns.resize(seeds.names.size());
+            continue;
+        }
+        if (!readRow(text, textEnd, seeds)) {
+            error = "line " + std::to_string(line) + " does not have an integer for each column";
+            return false;
+        }
+        ++seeds.rows;
+    }
+    if (header) {
+        error = "there is no header line";
+        return false;
+    }
+    return true;
+}
+
+/* Read a binary seed file. */
+bool readBinary(const char *begin, size_t size, Seeds &seeds, std::string &error) {
+    error = "the binary file is damaged";
+    if (size < sizeof(SeedsHeader)) {
+        return false;
+    }
+    SeedsHeader header;
+    std::memcpy(&header, begin, sizeof(header));
+    if (header.version != SEEDS_VERSION || header.byteOrder != SEEDS_BYTE_ORDER) {
+        error = "the binary file has another version or byte order";
+        return false;
+    }
+    // (The sizes are checked against the file before anything is read)
+    uint64_t columns = header.columns;
+    uint64_t rows = header.rows;
+    size_t position = sizeof(header);
+    if (columns > size / 8 || (size - position) / 8 < columns + 1) {
+        return false;
+    }
+    std::vector<uint64_t> offsets(columns + 1);
+    std::memcpy(offsets.data(), begin + position, offsets.size() * 8);
+    position += offsets.size() * 8;
+    uint64_t characters = offsets.back();
+    if (characters > size - position) {
+        return false;
+    }
+    const char *chars = begin + position;
+    position += aligned(characters);
+    if (position > size || (columns > 0 && rows > (size - position) / 8 / columns)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < columns; ++i) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > characters) {
+            return false;
+        }
+        std::string name(chars + offsets[i], chars + offsets[i + 1]);
+        if (!foldName(name) || std::find(seeds.names.begin(), seeds.names.end(), name) != seeds.names.end()) {
+            error = "the binary file has an invalid or repeated register name";
+            return false;
+        }
+        seeds.names.push_back(name);
+        std::vector<int64_t> column(rows);
+        std::memcpy(column.data(), begin + position + i * rows * 8, rows * 8);
+        seeds.columns.push_back(std::move(column));
+    }
+    seeds.rows = rows;
+    return true;
+}
+
+/* The kernels: apply an operation with the values of one column to
+ * another column. They return false if any row overflowed (the
+ * overflowed rows then hold wrapped values). */
+typedef bool (*Kernel)(int64_t *target, const int64_t *values, size_t count);
+
+bool addScalar(int64_t *target, const int64_t *values, size_t count) {
+    bool exact = true;
+    for (size_t i = 0; i < count; ++i) {
+        exact &= checkedAdd(target[i], values[i], target[i]);
+    }
+    return exact;
+}
+
+bool subtractScalar(int64_t *target, const int64_t *values, size_t count) {
+    bool exact = true;
+    for (size_t i = 0; i < count; ++i) {
+        exact &= checkedSubtract(target[i], values[i], target[i]);
+    }
+    return exact;
+}
+
+bool multiplyScalar(int64_t *target, const int64_t *values, size_t count) {
+    bool exact = true;
+    for (size_t i = 0; i < count; ++i) {
+        exact &= checkedMultiply(target[i], values[i], target[i]);
+    }
+    return exact;
+}
+
+#ifdef COLUMNAR_SSE2
+/* Add two rows at a time. A sum overflowed when it has another sign
+ * than both of the operands, so the signs of (a ^ r) & (b ^ r) are
+ * collected over the column, and checked once at the end. */
+bool addSse2(int64_t *target, const int64_t *values, size_t count) {
+    __m128i overflow = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i *address = reinterpret_cast<__m128i *>(target + i);
+        __m128i a = _mm_loadu_si128(address);
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+        __m128i r = _mm_add_epi64(a, b);
+        overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(a, r), _mm_xor_si128(b, r)));
+        _mm_storeu_si128(address, r);
+    }
+    bool exact = _mm_movemask_pd(_mm_castsi128_pd(overflow)) == 0;
+    return addScalar(target + i, values + i, count - i) && exact;
+}
+
+/* Subtract two rows at a time. A difference overflowed when the
+ * operands have different signs, and the result has another sign
+ * than the first operand: the signs of (a ^ b) & (a ^ r). */
+bool subtractSse2(int64_t *target, const int64_t *values, size_t count) {
+    __m128i overflow = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i *address = reinterpret_cast<__m128i *>(target + i);
+        __m128i a = _mm_loadu_si128(address);
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+        __m128i r = _mm_sub_epi64(a, b);
+        overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r)));
+        _mm_storeu_si128(address, r);
+    }
+    bool exact = _mm_movemask_pd(_mm_castsi128_pd(overflow)) == 0;
+    return subtractScalar(target + i, values + i, count - i) && exact;
+}
+#endif
+
+#ifdef COLUMNAR_AVX2
+/* The same as addSse2() and subtractSse2(), four rows at a time. */
+__attribute__((target("avx2")))
+bool addAvx2(int64_t *target, const int64_t *values, size_t count) {
+    __m256i overflow = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i *address = reinterpret_cast<__m256i *>(target + i);
+        __m256i a = _mm256_loadu_si256(address);
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+        __m256i r = _mm256_add_epi64(a, b);
+        overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r)));
+        _mm256_storeu_si256(address, r);
+    }
+    bool exact = _mm256_movemask_pd(_mm256_castsi256_pd(overflow)) == 0;
+    return addScalar(target + i, values + i, count - i) && exact;
+}
+
+__attribute__((target("avx2")))
+bool subtractAvx2(int64_t *target, const int64_t *values, size_t count) {
+    __m256i overflow = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i *address = reinterpret_cast<__m256i *>(target + i);
+        __m256i a = _mm256_loadu_si256(address);
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+        __m256i r = _mm256_sub_epi64(a, b);
+        overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r)));
+        _mm256_storeu_si256(address, r);
+    }
+    bool exact = _mm256_movemask_pd(_mm256_castsi256_pd(overflow)) == 0;
+    return subtractScalar(target + i, values + i, count - i) && exact;
+}
+#endif
+
+/* Return the kernel of an operation, in the given mode. */
+Kernel kernelFor(Operand op, KernelMode mode) {
+    if (op == MULTIPLY) {
+        return multiplyScalar;
+    }
+    switch (mode) {
+#ifdef COLUMNAR_AVX2
+        case KERNEL_AVX2:
+            return op == ADD ? addAvx2 : subtractAvx2;
+#endif
+#ifdef COLUMNAR_SSE2
+        case KERNEL_SSE2:
+            return op == ADD ? addSse2 : subtractSse2;
+#endif
+        default:
+            return op == ADD ? addScalar : subtractScalar;
+    }
+}
+
+}
+
+bool Seeds::read(const std::string &filename, std::string &error) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        error = "the file could not be opened";
+        return false;
+    }
+    if (file.size() >= sizeof(SEEDS_MAGIC) && std::memcmp(file.begin(), SEEDS_MAGIC, sizeof(SEEDS_MAGIC)) == 0) {
+        return readBinary(file.begin(), file.size(), *this, error);
+    }
+    return readCsv(file.begin(), file.end(), *this, error);
+}
+
+bool Seeds::writeBinary(const std::string &filename) const {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    SeedsHeader header;
+    std::memcpy(header.magic, SEEDS_MAGIC, sizeof(SEEDS_MAGIC));
+    header.version = SEEDS_VERSION;
+    header.byteOrder = SEEDS_BYTE_ORDER;
+    header.columns = names.size();
+    header.rows = rows;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<uint64_t> offsets(1, 0);
+    std::string chars;
+    for (const std::string &name : names) {
+        chars += name;
+        offsets.push_back(chars.size());
+    }
+    chars.resize(aligned(chars.size()), '\0');
+    out.write(reinterpret_cast<const char *>(offsets.data()), static_cast<std::streamsize>(offsets.size() * 8));
+    out.write(chars.data(), static_cast<std::streamsize>(chars.size()));
+    for (const std::vector<int64_t> &column : columns) {
+        out.write(reinterpret_cast<const char *>(column.data()), static_cast<std::streamsize>(rows * 8));
+    }
+    return static_cast<bool>(out);
+}
+
+Columnar::Columnar(const Symbols &symbols, Output &output)
+    : symbols(symbols), output(&output), mode(bestKernelMode()), native(nullptr), exact(false) {
+}
+
+void Columnar::setKernelMode(KernelMode mode) {
+    this->mode = supportsKernelMode(mode) ? mode : KERNEL_SCALAR;
+}
+
+void Columnar::setNative(NativeRow row) {
+    native = row;
+}
+
+void Columnar::compile(Instructions &instructions, const std::vector<RegisterId> &seedRegisters) {
+    for (size_t i = 0; i < seedRegisters.size(); ++i) {
+        reserve(seedRegisters[i]);
+        seedColumns[seedRegisters[i]] = static_cast<uint32_t>(i);
+    }
+
+    // Go through the program as the evaluator would, but instead of
+    // evaluating the prints, add the steps that compute their columns
+    while ( !instructions.empty() ) {
+        const Instruction &instruction = instructions.front();
+        Operand op     = static_cast<Operand>(instruction.op);
+        RegisterId reg = instruction.reg;
+        ValueKind kind = static_cast<ValueKind>(instruction.kind);
+        int64_t value  = instruction.value;
+        instructions.pop();
+
+        switch (op) {
+            case QUIT:
+                instructions.clear();
+                return;
+            case PRINT:
+                if (compileRegister(reg)) {
+                    Printed column = {reg, current[reg]};
+                    printed.push_back(column);
+                }
+                break;
+            case ERROR:
+                *output << symbols.message(reg) << '\n';
+                symbols.releaseMessage(reg);
+                break;
+            case EXPLAIN:
+                *output << "Explain Error: Registers cannot be explained in columnar mode." << '\n';
+                break;
+            case SAVE:
+            case RESTORE:
+                *output << "Snapshot Error: Registers cannot be saved or restored in columnar mode." << '\n';
+                symbols.releaseMessage(reg);
+                break;
+            case ADD:
+            case SUBTRACT:
+            case MULTIPLY:
+                addOperation(op, reg, kind, value);
+                break;
+        }
+    }
+}
+
+void Columnar::run(const Seeds &seeds) {
+    // The header, with the names of the printed registers (there is no
+    // table if nothing could be printed)
+    if (printed.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < printed.size(); ++i) {
+        if (i > 0) *output << ',';
+        *output << symbols.name(printed[i].reg);
+    }
+    *output << '\n';
+
+    // The rows that have a seed over 64 bits are computed exactly
+    std::vector<uint8_t> bigRows(seeds.rows, 0);
+    size_t width = std::max<size_t>(1, seeds.columns.size());
+    for (const std::pair<const uint64_t, Number> &entry : seeds.big) {
+        bigRows[entry.first / width] = 1;
+    }
+
+    // Native code runs a row at a time, from the seeds of the row
+    std::vector<Number> values;
+    if (native && !exact) {
+        std::vector<int64_t> row(seeds.columns.size());
+        std::vector<int64_t> results(printed.size());
+        for (size_t r = 0; r < seeds.rows; ++r) {
+            for (size_t column = 0; column < row.size(); ++column) {
+                row[column] = seeds.columns[column][r];
+            }
+            if (!bigRows[r] && native(row.data(), results.data())) {
+                for (size_t i = 0; i < printed.size(); ++i) {
+                    if (i > 0) *output << ',';
+                    *output << results[i];
+                }
+            } else {
+                runExact(seeds, r, values);
+                for (size_t i = 0; i < printed.size(); ++i) {
+                    if (i > 0) *output << ',';
+                    *output << values[printed[i].step];
+                }
+            }
+            *output << '\n';
+        }
+        return;
+    }
+
+    // Blocks are as many rows as fit in the memory for the columns
+    size_t block = BLOCK_BYTES / 8 / std::max<size_t>(1, steps.size());
+    block = std::max<size_t>(8, std::min(BLOCK_ROWS, block)) & ~static_cast<size_t>(7);
+    std::vector<int64_t> columns(steps.size() * block);
+    std::vector<int64_t> constant(block);
+    for (size_t start = 0; start < seeds.rows; start += block) {
+        size_t count = std::min(block, seeds.rows - start);
+        bool fits = !exact && std::find(bigRows.begin() + start, bigRows.begin() + start + count, 1) == bigRows.begin() + start + count;
+        if (fits && runBlock(seeds, start, count, block, columns, constant)) {
+            for (size_t row = 0; row < count; ++row) {
+                for (size_t i = 0; i < printed.size(); ++i) {
+                    if (i > 0) *output << ',';
+                    *output << columns[printed[i].step * block + row];
+                }
+                *output << '\n';
+            }
+            continue;
+        }
+        for (size_t row = start; row < start + count; ++row) {
+            runExact(seeds, row, values);
+            for (size_t i = 0; i < printed.size(); ++i) {
+                if (i > 0) *output << ',';
+                *output << values[printed[i].step];
+            }
+            *output << '\n';
+        }
+    }
+}
+
+bool Columnar::emit(std::string &source) const {
+    if (exact) {
+        return false;
+    }
+    source += "// A register program, compiled by the calculator (see \"columnar.h\").\n";
+    source += "#include <stdint.h>\n\n";
+    for (size_t i = 0; i < printed.size(); ++i) {
+        emitPrint(i, source);
+    }
+    source += "extern \"C\" int regcalc_row(const int64_t *seeds, int64_t *printed) {\n";
+    source += "    (void) seeds;\n";
+    source += "    (void) printed;\n";
+    source += "    return 1";
+    for (size_t i = 0; i < printed.size(); ++i) {
+        std::string index = std::to_string(i);
+        source += "\n        && print" + index + "(seeds, printed[" + index + "])";
+    }
+    source += ";\n}\n";
+    return true;
+}
+
+KernelMode Columnar::bestKernelMode() {
+    // (The CPU is only asked once)
+    static const KernelMode best = supportsKernelMode(KERNEL_AVX2) ? KERNEL_AVX2
+                                 : supportsKernelMode(KERNEL_SSE2) ? KERNEL_SSE2
+                                 : KERNEL_SCALAR;
+    return best;
+}
+
+bool Columnar::supportsKernelMode(KernelMode mode) {
+    switch (mode) {
+        case KERNEL_AVX2:
+#ifdef COLUMNAR_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        case KERNEL_SSE2:
+#ifdef COLUMNAR_SSE2
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return true;
+    }
+}
+
+const char *Columnar::kernelModeName(KernelMode mode) {
+    switch (mode) {
+        case KERNEL_AVX2: return "avx2";
+        case KERNEL_SSE2: return "sse2";
+        default:          return "scalar";
+    }
+}
+
+void Columnar::reserve(RegisterId reg) {
+    if (reg < programs.size()) return;
+    size_t size = static_cast<size_t>(reg) + 1;
+    programs.resize(size);
+    users.resize(size);
+    seedColumns.resize(size, NONE);
+    current.resize(size, NONE);
+    active.resize(size, 0);
+}
+
+void Columnar::addOperation(Operand op, RegisterId reg, ValueKind kind, int64_t value) {
+    reserve(reg);
+    if (kind == BIG_LITERAL) {
+        const std::string &digits = symbols.number(static_cast<uint32_t>(value));
+        Number number;
+        Number::parse(digits.data(), digits.size(), number);
+        value = static_cast<int64_t>(constants.size());
+        constants.push_back(std::move(number));
+        exact = true;
+    }
+    Operation operation = {static_cast<uint8_t>(op), static_cast<uint8_t>(kind), value};
+    programs[reg].push_back(operation);
+    if (kind == REFERENCE) {
+        RegisterId used = static_cast<RegisterId>(value);
+        reserve(used);
+        if (users[used].empty() || users[used].back() != reg) {
+            users[used].push_back(reg);
+        }
+    }
+    invalidate(reg);
+}
+
+void Columnar::invalidate(RegisterId reg) {
+    // (As in the evaluator, registers without a current column are
+    // skipped, since no current column can depend on them)
+    std::vector<RegisterId> pending(1, reg);
+    while ( !pending.empty() ) {
+        RegisterId next = pending.back();
+        pending.pop_back();
+        if (current[next] == NONE) continue;
+        current[next] = NONE;
+        pending.insert(pending.end(), users[next].begin(), users[next].end());
+    }
+}
+
+bool Columnar::compileRegister(RegisterId reg) {
+    // Walk the registers depth first, without recursion (like the
+    // evaluator), and add the step of each register once the steps of
+    // all the registers it uses have been added
+    reserve(reg);
+    if (programs[reg].empty() && seedColumns[reg] == NONE) {
+        *output << "Lookup Error: No register named '" << symbols.name(reg) << "'." << '\n';
+        return false;
+    }
+    std::vector<std::pair<RegisterId, size_t>> stack(1, std::make_pair(reg, static_cast<size_t>(0)));
+    active[reg] = 1;
+    bool success = true;
+    while ( !stack.empty() && current[reg] == NONE ) {
+        std::pair<RegisterId, size_t> &top = stack.back();
+        const std::vector<Operation> &program = programs[top.first];
+        while (top.second < program.size() &&
+               (program[top.second].kind != REFERENCE || current[program[top.second].value] != NONE)) {
+            ++top.second;
+        }
+        if (top.second < program.size()) {
+            RegisterId used = static_cast<RegisterId>(program[top.second].value);
+            if (programs[used].empty() && seedColumns[used] == NONE) {
+                *output << "Lookup Error: No register named '" << symbols.name(used) << "'." << '\n';
+                success = false;
+                break;
+            }
+            if (active[used]) {
+                *output << "Cycle Error: Register '" << symbols.name(used) << "' depends on itself." << '\n';
+                success = false;
+                break;
+            }
+            active[used] = 1;
+            stack.push_back(std::make_pair(used, static_cast<size_t>(0)));  // (invalidates 'top')
+            continue;
+        }
+
+        // Everything the register uses has a column
+        Step step = {top.first, seedColumns[top.first], static_cast<uint32_t>(operations.size()),
+                     static_cast<uint32_t>(program.size())};
+        for (Operation operation : program) {
+            if (operation.kind == REFERENCE) {
+                operation.value = current[operation.value];
+            }
+            operations.push_back(operation);
+        }
+        current[top.first] = static_cast<uint32_t>(steps.size());
+        steps.push_back(step);
+        active[top.first] = 0;
+        stack.pop_back();
+    }
+    for (const std::pair<RegisterId, size_t> &entry : stack) {
+        active[entry.first] = 0;
+    }
+    return success;
+}
+
+bool Columnar::runBlock(const Seeds &seeds, size_t start, size_t count, size_t block,
+                        std::vector<int64_t> &columns, std::vector<int64_t> &constant) const {
+    for (size_t s = 0; s < steps.size(); ++s) {
+        const Step &step = steps[s];
+        int64_t *target = &columns[s * block];
+        if (step.seed != NONE) {
+            std::memcpy(target, seeds.columns[step.seed].data() + start, count * 8);
+        } else {
+            std::fill(target, target + count, 0);
+        }
+        for (uint32_t i = step.first; i < step.first + step.count; ++i) {
+            const Operation &operation = operations[i];
+            const int64_t *values;
+            if (operation.kind == REFERENCE) {
+                values = &columns[static_cast<size_t>(operation.value) * block];
+            } else {
+                std::fill(constant.begin(), constant.begin() + count, operation.value);
+                values = constant.data();
+            }
+            if (!kernelFor(static_cast<Operand>(operation.op), mode)(target, values, count)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Columnar::emitPrint(size_t index, std::string &source) const {
+    // Find the steps the column needs (steps only use earlier steps)
+    uint32_t last = printed[index].step;
+    std::vector<uint8_t> needed(last + 1, 0);
+    needed[last] = 1;
+    for (uint32_t s = last + 1; s-- > 0;) {
+        if (!needed[s]) continue;
+        for (uint32_t i = steps[s].first; i < steps[s].first + steps[s].count; ++i) {
+            if (operations[i].kind == REFERENCE) {
+                needed[static_cast<size_t>(operations[i].value)] = 1;
+            }
+        }
+    }
+
+    source += "// print " + symbols.name(printed[index].reg) + "\n";
+    source += "static inline bool print" + std::to_string(index) + "(const int64_t *seeds, int64_t &out) {\n";
+    for (uint32_t s = 0; s <= last; ++s) {
+        if (!needed[s]) continue;
+        const Step &step = steps[s];
+        std::string variable = "s" + std::to_string(s);
+        source += "    int64_t " + variable + " = ";
+        source += step.seed != NONE ? "seeds[" + std::to_string(step.seed) + "]" : std::string("0");
+        source += ";  // " + symbols.name(step.reg) + "\n";
+        for (uint32_t i = step.first; i < step.first + step.count; ++i) {
+            const Operation &operation = operations[i];
+            const char *builtin = operation.op == ADD ? "__builtin_add_overflow"
+                                : operation.op == SUBTRACT ? "__builtin_sub_overflow"
+                                : "__builtin_mul_overflow";
+            std::string value;
+            if (operation.kind == REFERENCE) {
+                value = "s" + std::to_string(operation.value);
+            } else if (operation.value == INT64_MIN) {
+                value = "INT64_MIN";
+            } else {
+                value = "INT64_C(" + std::to_string(operation.value) + ")";
+            }
+            source += std::string("    if (") + builtin + "(" + variable + ", " + value + ", &" + variable + ")) return false;\n";
+        }
+    }
+    source += "    out = s" + std::to_string(last) + ";\n";
+    source += "    return true;\n";
+    source += "}\n\n";
+}
+
+void Columnar::runExact(const Seeds &seeds, size_t row, std::vector<Number> &values) const {
+    values.resize(steps.size());
+    for (size_t s = 0; s < steps.size(); ++s) {
+        const Step &step = steps[s];
+        Number &value = values[s];
+        value = Number();
+        if (step.seed != NONE) {
+            std::unordered_map<uint64_t, Number>::const_iterator found = seeds.big.find(row * seeds.columns.size() + step.seed);
+            value = found != seeds.big.end() ? found->second : Number(seeds.columns[step.seed][row]);
+        }
+        for (uint32_t i = step.first; i < step.first + step.count; ++i) {
+            const Operation &operation = operations[i];
+            Operand op = static_cast<Operand>(operation.op);
+            switch (static_cast<ValueKind>(operation.kind)) {
+                case LITERAL:
+                    value.apply(op, Number(operation.value));
+                    break;
+                case BIG_LITERAL:
+                    value.apply(op, constants[static_cast<size_t>(operation.value)]);
+                    break;
+                case REFERENCE:
+                    value.apply(op, values[static_cast<size_t>(operation.value)]);
+                    break;
+            }
+        }
+    }
+}
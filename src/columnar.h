@@ -0,0 +1,214 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "instructions.h"
+#include "number.h"
+#include "output.h"
+#include "symbols.h"
+
+/*
+ * This file contains the columnar mode of the calculator ('--columns
+ * <file>'), which runs one program over many rows of seed values at
+ * once, instead of running the calculator once per row.
+ *
+ * The seeds are a table with a column per seed register: each row is
+ * one run of the program, in which the seed registers start with the
+ * values of the row (as if the program started with 'r add <value>'
+ * for each of them). The output is a table as well, with a column per
+ * print of the program, and a row per row of seeds.
+ *
+ * Since the values never change which registers a print needs, the
+ * program is compiled once, into steps: each step computes the column
+ * of one register (at one point of the program), from its seed column
+ * and the columns of the registers it uses, in the order the program
+ * has to evaluate them (the same memoization and invalidation as in
+ * the evaluator, see "evaluator.h", but done once for all rows). The
+ * errors of the program (syntax errors, and prints of missing or cyclic
+ * registers) are also found then, and written before the table; the
+ * prints that fail have no column.
+ *   The steps are then run on blocks of rows, as 64-bit integer
+ * columns, with kernels that add, subtract or multiply a column with
+ * another column or a constant. The add and subtract kernels use SSE2
+ * or AVX2 instructions, whichever the CPU supports (chosen at run time,
+ * like the lexer), and check every lane for overflow. (There are no
+ * vector instructions for 64-bit multiplication before AVX-512, so
+ * the multiply kernels are plain loops with overflow checks.) A block
+ * in which anything overflows, or which has a seed that does not fit
+ * in 64 bits, is computed again row by row with exact numbers (see
+ * "number.h"), so the results are always exact.
+ *
+ * # Seed files
+ * The seeds are read from a CSV file or from a binary column file,
+ * which is told apart by its magic. The CSV file has a header line with
+ * the register names, separated by commas, followed by a line of values
+ * per row (integers of any size). The binary file is, in the native
+ * byte order, with each array starting at a multiple of 8 bytes:
+ *     header       magic "REGCOLS", version, byte order mark,
+ *                  number of columns and of rows
+ *     names        offsets (columns + 1) and characters of the names
+ *     values       the columns of 64-bit values, one after the other
+ * The output table is written as CSV, to the output of the calculator.
+ *
+ * # Native code
+ * The compiled program can also be written out as C++ (see emit), with
+ * a function per print that computes it from the seeds of a row, in
+ * straight-line code with the literals inlined. Once that is compiled
+ * into a shared library and loaded (see "native.h"), the rows are run
+ * through it instead of the kernels (and, as with the kernels, a row in
+ * which anything overflows is computed again with exact numbers).
+ */
+
+/* The ways of running the kernels: plain loops, or SSE2 or AVX2. */
+enum KernelMode {KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2};
+
+/* The function of a compiled program (see Columnar::emit): computes the
+ * printed values of one row from its seeds. Returns 0 if anything
+ * overflowed 64 bits. */
+typedef int (*NativeRow)(const int64_t *seeds, int64_t *printed);
+
+/* A table of seed values, stored by column. Values that do not fit in
+ * 64 bits are stored apart, by their row and column. */
+struct Seeds {
+    std::vector<std::string> names;
+    std::vector<std::vector<int64_t>> columns;
+    std::unordered_map<uint64_t, Number> big;
+    size_t rows;
+
+    Seeds() : rows(0) {}
+
+    /* Read a seed file (CSV or binary). Returns false, with a
+     * description of the problem in 'error', if it is not valid. */
+    bool read(const std::string &filename, std::string &error);
+
+    /* Write the seeds as a binary column file (the big values are not
+     * supported, and are written as 0). Returns false if the file could
+     * not be written. */
+    bool writeBinary(const std::string &filename) const;
+};
+
+class Columnar {
+
+private:
+
+    // Marks a register without an up to date column
+    static const uint32_t NONE = UINT32_MAX;
+
+    // An operation of a step: the value is a literal, the index of a
+    // big literal, or (for a reference) the index of the step whose
+    // column is used
+    struct Operation {
+        uint8_t op;
+        uint8_t kind;
+        int64_t value;
+    };
+
+    // A step computes the column of a register: it starts from the seed
+    // column (if the register has one) and applies its operations
+    struct Step {
+        RegisterId reg;
+        uint32_t seed;          // Seed column, or NONE
+        uint32_t first;         // First operation
+        uint32_t count;         // Number of operations
+    };
+
+    // A column of the output: its name, and the step computing it
+    struct Printed {
+        RegisterId reg;
+        uint32_t step;
+    };
+
+    const Symbols &symbols;
+    Output *output;
+    KernelMode mode;
+    NativeRow native;
+
+    // The compiled program
+    std::vector<Step> steps;
+    std::vector<Operation> operations;
+    std::vector<Printed> printed;
+    std::vector<Number> constants;
+
+    // Whether the program uses big literals (then all rows are exact)
+    bool exact;
+
+    // While compiling: the operations added to each register so far,
+    // its users, its seed column, and the step of its current column
+    std::vector<std::vector<Operation>> programs;
+    std::vector<std::vector<RegisterId>> users;
+    std::vector<uint32_t> seedColumns;
+    std::vector<uint32_t> current;
+    std::vector<uint8_t> active;
+
+public:
+
+    /* Create a columnar run, for a program interned in the given
+     * symbols, writing to the given output (with the best kernels). */
+    Columnar(const Symbols &symbols, Output &output);
+
+    /* Use the given kernel mode (if the CPU supports it). */
+    void setKernelMode(KernelMode mode);
+
+    /* Run the rows through native code (see "native.h") instead of the
+     * kernels, or through the kernels again if null. */
+    void setNative(NativeRow row);
+
+    /* Compile the program, for seed columns of the given registers
+     * (interned in the same symbols), writing the errors of the program.
+     * The instructions are removed; a quit ends the program. */
+    void compile(Instructions &instructions, const std::vector<RegisterId> &seedRegisters);
+
+    /* Run the compiled program on all rows of the seeds, and write the
+     * output table. */
+    void run(const Seeds &seeds);
+
+    /* Write the compiled program as a C++ translation unit, which
+     * defines the function 'regcalc_row' (see NativeRow), for seeds in
+     * the order given to compile. Returns false if the program cannot
+     * be run as native code (it uses literals over 64 bits). */
+    bool emit(std::string &source) const;
+
+    /* The kernel modes, the best one the CPU supports, and their names
+     * (as for the lexer, see "lexer.h"). */
+    static KernelMode bestKernelMode();
+    static bool supportsKernelMode(KernelMode mode);
+    static const char *kernelModeName(KernelMode mode);
+
+private:
+
+    /* Make sure the compile arrays cover the given register. */
+    void reserve(RegisterId reg);
+
+    /* Add an operation to a register (while compiling). */
+    void addOperation(Operand op, RegisterId reg, ValueKind kind, int64_t value);
+
+    /* Mark the columns of a register, and of the registers using it,
+     * as out of date. */
+    void invalidate(RegisterId reg);
+
+    /* Add the steps for the current column of a register. Returns
+     * false (after writing an error) if a register is missing or
+     * part of a cycle. */
+    bool compileRegister(RegisterId reg);
+
+    /* Run the steps on a block of rows, with 64-bit columns (of 'block'
+     * rows each, and a column for the constants). Returns false if
+     * anything overflowed. */
+    bool runBlock(const Seeds &seeds, size_t start, size_t count, size_t block,
+                  std::vector<int64_t> &columns, std::vector<int64_t> &constant) const;
+
+    /* Write the function of a print: the straight-line code of the
+     * steps its column needs (in the order they were compiled). */
+    void emitPrint(size_t index, std::string &source) const;
+
+    /* Run the steps on one row, with exact numbers. */
+    void runExact(const Seeds &seeds, size_t row, std::vector<Number> &values) const;
+
+};
+
+#endif // COLUMNAR_H
@@ -2,95 +2,63 @@
 #define DEFINITIONS_H
 
 #include <string>
-#include <tuple>
-#include <queue>
+#include <cstdint>
 #include <vector>
-#include <regex>
 
 /*
  * This file contains definitions for the data structures that are shared
  * between the parser and the evaluator.
  * 
- * This includes definitions about the different tokens.
- * The supported tokens are:
- *  > The operand keywords: "add", "subtract", "multiply", "print", "quit".
- *  > Registers: strings containing alphanumeric symbols (with at least one letter symbol)
- *  > Numbers: strings containing only digits
+ * (The definitions of the different tokens are found in "lexer.h".)
  * 
- * It also includes definitions about how the instructions are stored.
- * The instructions are stored in tuples with three values:
- *     <operand> <register> <value>
- * The value can be either a numeric value, or a register name.
+ * It includes definitions about how the instructions are stored.
+ * The instructions are stored in fixed-size records with four fields:
+ *     <operand> <value kind> <register> <value>
+ * Register names are interned by the parser (see "symbols.h"), so the
+ * register is stored as an integer id. The value can be either a numeric
+ * literal, or a register id, which is told apart by the value kind.
+ * Numeric literals are parsed once, by the parser. Literals that do not fit
+ * in 64 bits are kept as text (see "symbols.h"), and the value is the index
+ * of that text.
  * The print instruction has no <value>, and the quit instruction has no <value> or
- * <register>. These fields will then be empty in the tuple.
+ * <register>. These fields will then be zero in the record.
+ * Syntax errors found by the parser are also passed on as instructions, so that
+ * the error messages are printed in order with the rest of the output. An error
+ * instruction holds the index of its message (see "symbols.h") as <register>.
+ *   The records are plain data of 16 bytes, so they can be copied around
+ * freely, and are stored in a chunked arena between the parser and the
+ * evaluator (see "instructions.h").
  */
 
 
-/* Static functions for identifying the different tokens. */
-namespace Token {
-
-/* Return true if the input token is a quit operand. */
-static bool isQuitOperand(std::string &in) {
-    return !in.compare("quit");
-}
-
-/* Return true if the input token is a print operand. */
-static bool isPrintOperand(std::string &in) {
-    return !in.compare("print");
-}
-
-/* Return true if the input token is a add operand. */
-static bool isAddOperand(std::string &in) {
-    return !in.compare("add");
-}
-
-/* Return true if the input token is a subtract operand. */
-static bool isSubtractOperand(std::string &in) {
-    return !in.compare("subtract");
-}
-
-/* Return true if the input token is a multiply operand. */
-static bool isMultiplyOperand(std::string &in) {
-    return !in.compare("multiply");
-}
-
-/* Return true if the input token is any of the keyword operands. */
-static bool isKeyword(std::string &in) {
-    return ( isQuitOperand(in)
-             || isPrintOperand(in)
-             || isAddOperand(in)
-             || isSubtractOperand(in)
-             || isMultiplyOperand(in) );
-}
-
-/* Return true if the input token is a number. */
-static bool isNumber(std::string &in) {
-    std::regex regularexpression("[0-9]*");
-    return std::regex_match(in, regularexpression);
-}
-
-/* Return true if the input token is a register name. */
-static bool isRegister(std::string &in) {
-    std::regex regularexpression("[a-zA-Z0-9]*");
-    return ( std::regex_match(in, regularexpression)
-             && !isNumber(in) && !isKeyword(in) );
-}
-
-};
-
-
 /* Definitions of the instructions. */
 
 // The calculator should support operands for addition, subtraction and multiplication,
 // plus printing the result and quitting the calculator.
-enum Operand {ADD, SUBTRACT, MULTIPLY, PRINT, QUIT};
+// (The error operand reports a syntax error, the explain operand
+// reports what evaluating a register involves, see "explain.h", and
+// the save and restore operands save the registers to a snapshot file
+// and restore them from one, see "snapshot.h".)
+enum Operand {ADD, SUBTRACT, MULTIPLY, PRINT, QUIT, ERROR, EXPLAIN, SAVE, RESTORE};
 
-// Instructions consists of an operand, a register, and a value.
+// Registers are identified by dense integer ids, handed out by the parser.
+typedef uint32_t RegisterId;
+
+// A value is either a numeric literal, or a reference to a register.
+// (Literals that do not fit in 64 bits are big literals, see "symbols.h".)
+enum ValueKind {LITERAL, REFERENCE, BIG_LITERAL};
+
+// Instructions consists of an operand, a register, and a value (kind and data).
+// The value data is the literal number, or the id of the referenced register.
 // Note that the print operation has no value, and the quit operation has no register or value.
-typedef std::tuple<Operand, std::string, std::string> Instruction;
-// The instructions are stored in a queue, since they will always be evaluated in
-// the same order they are parsed.
-typedef std::queue<Instruction> Instructions;
+// (The operand and the value kind are stored as bytes, to keep the record small.)
+struct Instruction {
+    uint8_t op;         // Operand
+    uint8_t kind;       // ValueKind
+    RegisterId reg;
+    int64_t value;
+};
+static_assert(sizeof(Instruction) <= 16, "Instruction records must be 16 bytes or less");
 
 
 #endif // DEFINITIONS_H
@@ -1,4 +1,40 @@
 #include "evaluator.h"
+#include "explain.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "stats.h"
+
+const Evaluator::Index Evaluator::NONE;
+const size_t Evaluator::PARALLEL_THRESHOLD;
+
+Evaluator::Evaluator(Symbols &symbols) : symbols(symbols), output(&Output::console()), shared(nullptr), journal(nullptr) {
+    job.capacity = 0;
+}
+
+void Evaluator::setThreads(unsigned threads) {
+    if (threads > 1) {
+        pool.reset(new ThreadPool(threads));
+    } else {
+        pool.reset();
+    }
+}
+
+void Evaluator::setOutput(Output &out) {
+    output = &out;
+}
+
+void Evaluator::share(SharedRegisters &registers) {
+    shared = &registers;
+    reader.reset(new SharedRegisters::Reader(registers));
+}
+
+void Evaluator::setJournal(Journal &journal) {
+    this->journal = &journal;
+}
+
+void Evaluator::setExplainGraph(const std::string &filename) {
+    explainGraph = filename;
+}
 
 bool Evaluator::execute(Instructions &instructions) {
     // Go through all instructions sequentially,
@@ -6,97 +42,484 @@ bool Evaluator::execute(Instructions &instructions) {
     // performed.
     //   (The executed instructions should be removed
     // from the instruction list.)
+    Stats::Timer timer(Stats::EVALUATE_TIME);
     while ( !instructions.empty() ) {
-        // Get instruction
-        Instruction intructions = instructions.front();
+        // Get the fields of the instruction record
+        const Instruction &instruction = instructions.front();
+        Operand op     = static_cast<Operand>(instruction.op);
+        RegisterId reg = instruction.reg;
+        ValueKind kind = static_cast<ValueKind>(instruction.kind);
+        int64_t value  = instruction.value;
         instructions.pop(); // Remove instruction
 
-        // Get the fields of the instruction tuple
-        Operand op = std::get<0>(intructions);
-        std::string reg   = std::get<1>(intructions);
-        std::string value = std::get<2>(intructions);
-
         // Determine which operation to execute
         switch (op) {
             case QUIT:
+                // (The instructions after the quit are dropped in bulk)
+                instructions.clear();
+                if (journal) {
+                    journal->commit();
+                }
                 return false;
                 break;
             case PRINT:
-                printRegister(reg);
+                if (shared) {
+                    printShared(reg);
+                } else {
+                    printRegister(reg);
+                }
+                break;
+            case ERROR:
+                *output << symbols.message(reg) << '\n';
+                symbols.releaseMessage(reg);
+                break;
+            case EXPLAIN:
+                explainRegister(reg);
+                break;
+            case SAVE:
+                saveSnapshot(symbols.message(reg));
+                symbols.releaseMessage(reg);
+                break;
+            case RESTORE:
+                restoreSnapshot(symbols.message(reg));
+                symbols.releaseMessage(reg);
                 break;
             case ADD:
             case SUBTRACT:
             case MULTIPLY:
-                addArithmeticOperation(op, reg, value);
+                if (journal) {
+                    journal->record(op, reg, kind, value);
+                }
+                if (shared) {
+                    addSharedOperation(op, reg, kind, value);
+                } else {
+                    addArithmeticOperation(op, reg, kind, value);
+                }
                 break;
         }
 
     }
+    if (journal) {
+        journal->commit();
+    }
     return true;
 }
 
-void Evaluator::addArithmeticOperation(Operand &op, std::string &reg, std::string &value) {
+void Evaluator::addArithmeticOperation(Operand op, RegisterId reg, ValueKind kind, int64_t value) {
     // Add the given operand and value to the
-    // symbol table entry for the given register.
+    // program of the given register.
     // If the register is not in the symbol table,
     // it should be added.
-    Operations operations = registers[reg];
-    Operation operation = std::make_tuple(op, value);
-    operations.push_back(operation);
-    registers[reg] = operations;
+    Stats::add(Stats::OPERATIONS);
+    reserve(reg);
+    ++registers.counts[reg];
+    if (kind == BIG_LITERAL) {
+        // The digits are turned into a number once, and the program
+        // refers to it by its index in the table of numbers
+        const std::string &digits = symbols.number(static_cast<uint32_t>(value));
+        Number number;
+        Number::parse(digits.data(), digits.size(), number);
+        value = static_cast<int64_t>(constants.size());
+        constants.push_back(std::move(number));
+    }
+    Bytecode::append(registers.programs[reg], op, kind, value);
+
+    // If the value is a register, the register now depends on it.
+    if (kind == REFERENCE) {
+        RegisterId used = static_cast<RegisterId>(value);
+        reserve(used);
+        addDependency(reg, used);
+    }
+
+    // The value of the register has changed, so its cached value,
+    // and the cached values of everything using it, are stale.
+    invalidate(reg);
 }
 
-void Evaluator::printRegister(std::string &reg) {
+void Evaluator::addSharedOperation(Operand op, RegisterId reg, ValueKind kind, int64_t value) {
+    Stats::add(Stats::OPERATIONS);
+    if (kind == BIG_LITERAL) {
+        const std::string &digits = symbols.number(static_cast<uint32_t>(value));
+        Number number;
+        Number::parse(digits.data(), digits.size(), number);
+        value = shared->addConstant(number);
+    }
+    shared->append(op, reg, kind, value);
+}
+
+void Evaluator::printShared(RegisterId reg) {
+    Stats::add(Stats::PRINTS);
+    Stats::add(Stats::EVALUATIONS);
+    Number value;
+    RegisterId failed;
+    switch (reader->evaluate(reg, value, failed)) {
+        case SharedRegisters::EVALUATED:
+            *output << value << '\n';
+            break;
+        case SharedRegisters::MISSING:
+            *output << "Lookup Error: No register named '" << symbols.name(failed) << "'." << '\n';
+            break;
+        case SharedRegisters::CYCLE:
+            *output << "Cycle Error: Register '" << symbols.name(failed) << "' depends on itself." << '\n';
+            break;
+    }
+}
+
+void Evaluator::explainRegister(RegisterId reg) {
+    // (The shared registers are not in the symbol table of this evaluator)
+    if (shared) {
+        *output << "Explain Error: Registers that are shared cannot be explained." << '\n';
+        return;
+    }
+    // (As for printing it, the register must be defined)
+    if (reg >= registers.counts.size() || registers.counts[reg] == 0) {
+        *output << "Lookup Error: No register named '" << symbols.name(reg) << "'." << '\n';
+        return;
+    }
+    Explain::report(*this, reg, *output);
+    if (!explainGraph.empty() && !Explain::graph(*this, reg, explainGraph)) {
+        *output << "Explain Error: Could not write the graph to '" << explainGraph << "'." << '\n';
+    }
+}
+
+void Evaluator::saveSnapshot(const std::string &filename) {
+    if (shared) {
+        *output << "Save Error: Registers that are shared cannot be saved." << '\n';
+        return;
+    }
+    if (!Snapshot::save(filename, symbols, *this)) {
+        *output << "Save Error: Could not write the snapshot '" << filename << "'." << '\n';
+    }
+}
+
+void Evaluator::restoreSnapshot(const std::string &filename) {
+    // (The journal only has the operations, so it could not replay this)
+    if (shared) {
+        *output << "Restore Error: Registers that are shared cannot be restored." << '\n';
+        return;
+    }
+    if (journal) {
+        *output << "Restore Error: Registers that are journaled cannot be restored." << '\n';
+        return;
+    }
+    if (!Snapshot::load(filename, symbols, *this)) {
+        *output << "Restore Error: Could not read the snapshot '" << filename << "'." << '\n';
+    }
+}
+
+void Evaluator::reserve(RegisterId reg) {
+    // Grow all the symbol table arrays to cover the register id.
+    if (reg < registers.counts.size()) return;
+    size_t size = static_cast<size_t>(reg) + 1;
+    registers.counts.resize(size, 0);
+    registers.users.resize(size, NONE);
+    registers.uses.resize(size, NONE);
+    registers.cached.resize(size, 0);
+    registers.values.resize(size, 0);
+    registers.wideValues.resize(size);
+    registers.active.resize(size, 0);
+    registers.programs.resize(size);
+}
+
+void Evaluator::addDependency(RegisterId reg, RegisterId used) {
+    // (Repeated edges between the same registers are skipped.)
+    Index head = registers.uses[reg];
+    if (head == NONE || edges.targets[head] != used) {
+        edges.targets.push_back(used);
+        edges.next.push_back(head);
+        registers.uses[reg] = static_cast<Index>(edges.targets.size() - 1);
+
+        edges.targets.push_back(reg);
+        edges.next.push_back(registers.users[used]);
+        registers.users[used] = static_cast<Index>(edges.targets.size() - 1);
+    }
+}
+
+void Evaluator::invalidate(RegisterId reg) {
+    // Walk the reverse dependency graph from the changed register.
+    // Registers that are not cached can be skipped, since no cached
+    // register can depend on an uncached one.
+    pending.push_back(reg);
+    while ( !pending.empty() ) {
+        RegisterId current = pending.back();
+        pending.pop_back();
+
+        if (!registers.cached[current]) continue;
+        registers.cached[current] = 0;
+
+        for (Index edge = registers.users[current]; edge != NONE; edge = edges.next[edge]) {
+            pending.push_back(edges.targets[edge]);
+        }
+    }
+}
+
+void Evaluator::printRegister(RegisterId reg) {
     // Evaluate what the value of the register is
     // and, if successful, print the value.
-    long value;
-    if (evaluateValue(reg, value)) {
-        std::cout << value << std::endl;
+    Stats::add(Stats::PRINTS);
+    Number value;
+    if (evaluateValue(REFERENCE, reg, value)) {
+        *output << value << '\n';
     }
 }
 
-bool Evaluator::evaluateValue(std::string &value, long &outvalue) {
+bool Evaluator::evaluateValue(ValueKind kind, int64_t value, Number &outvalue) {
+    Stats::add(Stats::EVALUATIONS);
 
     // If the value is a number, set the output and return.
-    if (Token::isNumber(value)) {
-        outvalue = std::stol(value);
+    if (kind == LITERAL) {
+        outvalue = Number(value);
+        return true;
+    }
+    if (kind == BIG_LITERAL) {
+        outvalue = constants[static_cast<size_t>(value)];
         return true;
     }
     // If it's not a number, it has to be a register.
-    // If there is no register with the given name in
-    // the symbol table, return failure.
-    if (registers.find(value) == registers.end()) {
-        std::cout << "Lookup Error: No register named '" << value << "'." << std::endl;
+    // If the register has no operations in the symbol
+    // table, return failure.
+    RegisterId reg = static_cast<RegisterId>(value);
+    Stats::add(Stats::LOOKUPS);
+    if (reg >= registers.counts.size() || registers.counts[reg] == 0) {
+        *output << "Lookup Error: No register named '" << symbols.name(reg) << "'." << '\n';
         return false;
     }
-    // If the register is defined in the symbol table,
-    // then retrieve it and go through the operations that
-    // are associated with it.
-    long res = 0;
-    Operations operations = registers[value];
-    for (Operation operation : operations) {
-        // Retrieve the operand and value of the operation
-        Operand operand   = std::get<0>(operation);
-        std::string operandvalue = std::get<1>(operation);
-
-        // Recursively evaluate the value
-        long val;
-        if (!evaluateValue(operandvalue, val)) return false;
-        // If the evaluation was successful, perform the operation
-        switch (operand) {
-            case ADD:
-                res += val;
-                break;
-            case SUBTRACT:
-                res -= val;
-                break;
-            case MULTIPLY:
-                res *= val;
-                break;
+    // If the register value is already known, there is
+    // no need to go through its operations again.
+    if (registers.cached[reg]) {
+        Stats::add(Stats::CACHE_HITS);
+        outvalue = cachedValue(reg);
+        return true;
+    }
+    // Large registers are evaluated in parallel, if there is a pool.
+    if (pool && collectDependencies(reg) && job.order.size() >= PARALLEL_THRESHOLD) {
+        evaluateParallel();
+    } else if (!evaluateRegister(reg)) {
+        return false;
+    }
+    outvalue = cachedValue(reg);
+    return true;
+}
+
+bool Evaluator::evaluateRegister(RegisterId reg) {
+    // Run the program of the register. When it reads a register
+    // that is not yet evaluated, that register is pushed on the
+    // stack and evaluated first, and the program is resumed once
+    // it is done (and cached).
+    //   (The statistics are counted locally, and added at the end:
+    // every register read that stops the program is a lookup, and
+    // every read that finds the value is also a cache hit.)
+    Frame root = {reg, 0, 0, nullptr, AFFINE};
+    stack.push_back(std::move(root));
+    registers.active[reg] = 1;
+    uint64_t reads = 0;
+    uint64_t misses = 0;
+    uint64_t evaluated = 0;
+
+    while ( !stack.empty() ) {
+        Frame &frame = stack.back();
+
+        if (runFrame(frame, reads) == Bytecode::BLOCKED) {
+            // The current instruction uses an unevaluated register
+            RegisterId used = Bytecode::registerAt(registers.programs[frame.reg], frame.pc);
+            ++misses;
+            if (registers.counts[used] == 0) {
+                *output << "Lookup Error: No register named '" << symbols.name(used) << "'." << '\n';
+                abortEvaluation();
+                countEvaluation(reads, misses, evaluated);
+                return false;
+            }
+            if (registers.active[used]) {
+                *output << "Cycle Error: Register '" << symbols.name(used) << "' depends on itself." << '\n';
+                abortEvaluation();
+                countEvaluation(reads, misses, evaluated);
+                return false;
+            }
+            Frame next = {used, 0, 0, nullptr, AFFINE};
+            registers.active[used] = 1;
+            stack.push_back(std::move(next));  // (invalidates 'frame')
+            continue;
         }
+
+        // The program is done, so the register value is known
+        storeValue(frame.reg, frame);
+        registers.active[frame.reg] = 0;
+        stack.pop_back();
+        ++evaluated;
     }
 
-    outvalue = res;
+    countEvaluation(reads, misses, evaluated);
     return true;
 }
 
+Bytecode::Status Evaluator::runFrame(Frame &frame, uint64_t &reads) const {
+    // Run on 64-bit values until the program needs more, and then
+    // continue on a number (from the instruction that overflowed).
+    const Program &program = registers.programs[frame.reg];
+    if (!frame.wide) {
+        Bytecode::Status status = Bytecode::run(program, frame.pc, frame.value, registers.values.data(),
+                                                registers.cached.data(), reads, frame.opcode);
+        if (status != Bytecode::WIDENED) {
+            return status;
+        }
+        frame.wide.reset(new Number(frame.value));
+    }
+    return Bytecode::runWide(program, frame.pc, frame.opcode, *frame.wide,
+                             registers.values.data(), registers.cached.data(),
+                             registers.wideValues.data(), constants.data(), reads);
+}
+
+void Evaluator::storeValue(RegisterId reg, Frame &frame) {
+    // Values that fit in 64 bits again are stored as such
+    if (frame.wide && !frame.wide->isSmall()) {
+        registers.wideValues[reg] = std::move(frame.wide);
+        registers.cached[reg] = EVALUATED_WIDE;
+    } else {
+        registers.values[reg] = frame.wide ? frame.wide->toSmall() : frame.value;
+        registers.wideValues[reg].reset();
+        registers.cached[reg] = EVALUATED;
+    }
+}
+
+Number Evaluator::cachedValue(RegisterId reg) const {
+    if (registers.cached[reg] == EVALUATED_WIDE) {
+        return *registers.wideValues[reg];
+    }
+    return Number(registers.values[reg]);
+}
+
+void Evaluator::countEvaluation(uint64_t reads, uint64_t misses, uint64_t evaluated) {
+    Stats::add(Stats::LOOKUPS, reads + misses);
+    Stats::add(Stats::CACHE_HITS, reads);
+    Stats::add(Stats::REGISTERS_EVALUATED, evaluated);
+}
+
+void Evaluator::abortEvaluation() {
+    // None of the registers on the stack could be evaluated.
+    for (const Frame &frame : stack) {
+        registers.active[frame.reg] = 0;
+    }
+    stack.clear();
+}
+
+bool Evaluator::collectDependencies(RegisterId reg) {
+    // Walk the dependency edges depth first, and add each register
+    // to the order once all of its dependencies have been added.
+    // Cached registers do not need to be evaluated, and are skipped.
+    job.order.clear();
+    if (job.position.size() < registers.counts.size()) {
+        job.position.resize(registers.counts.size());
+    }
+
+    bool success = true;
+    job.walk.push_back(std::make_pair(reg, registers.uses[reg]));
+    registers.active[reg] = 1;
+    while ( !job.walk.empty() ) {
+        std::pair<RegisterId, Index> &top = job.walk.back();
+        if (top.second == NONE) {
+            // All dependencies are in the order
+            job.position[top.first] = static_cast<uint32_t>(job.order.size());
+            job.order.push_back(top.first);
+            registers.active[top.first] = 0;
+            job.walk.pop_back();
+            continue;
+        }
+
+        RegisterId used = edges.targets[top.second];
+        top.second = edges.next[top.second];
+        if (registers.counts[used] == 0 || registers.active[used]) {
+            success = false;
+            break;
+        }
+        bool collected = job.position[used] < job.order.size() && job.order[job.position[used]] == used;
+        if (registers.cached[used] || collected) {
+            continue;
+        }
+        registers.active[used] = 1;
+        job.walk.push_back(std::make_pair(used, registers.uses[used]));
+    }
+
+    for (const std::pair<RegisterId, Index> &entry : job.walk) {
+        registers.active[entry.first] = 0;
+    }
+    job.walk.clear();
+    return success;
+}
+
+void Evaluator::evaluateParallel() {
+    // Count the (distinct) unevaluated dependencies of each register,
+    // and gather the links from each register to its users.
+    uint32_t count = static_cast<uint32_t>(job.order.size());
+    if (job.capacity < count) {
+        job.remaining.reset(new std::atomic<uint32_t>[count]);
+        job.capacity = count;
+    }
+    job.links.clear();
+    job.lastUser.assign(count, UINT32_MAX);
+    for (uint32_t i = 0; i < count; ++i) {
+        RegisterId reg = job.order[i];
+        uint32_t dependencies = 0;
+        for (Index edge = registers.uses[reg]; edge != NONE; edge = edges.next[edge]) {
+            RegisterId used = edges.targets[edge];
+            if (registers.cached[used]) continue;
+            uint32_t position = job.position[used];
+            if (job.lastUser[position] == i) continue;
+            job.lastUser[position] = i;
+            job.links.push_back(std::make_pair(position, i));
+            ++dependencies;
+        }
+        job.remaining[i].store(dependencies, std::memory_order_relaxed);
+    }
+
+    // Sort the links into compressed rows of users
+    job.userStart.assign(count + 1, 0);
+    for (const std::pair<uint32_t, uint32_t> &link : job.links) {
+        ++job.userStart[link.first + 1];
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        job.userStart[i + 1] += job.userStart[i];
+    }
+    job.userPositions.resize(job.links.size());
+    for (const std::pair<uint32_t, uint32_t> &link : job.links) {
+        job.userPositions[job.userStart[link.first]++] = link.second;
+    }
+    for (uint32_t i = count; i > 0; --i) {
+        job.userStart[i] = job.userStart[i - 1];
+    }
+    job.userStart[0] = 0;
+
+    // Start with the registers that have no unevaluated dependencies
+    std::vector<uint32_t> ready;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (job.remaining[i].load(std::memory_order_relaxed) == 0) {
+            ready.push_back(i);
+        }
+    }
+    pool->run(&Evaluator::evaluateTask, this, ready);
+}
+
+void Evaluator::evaluateTask(void *context, uint32_t position) {
+    Evaluator &evaluator = *static_cast<Evaluator *>(context);
+    ParallelJob &job = evaluator.job;
+
+    RegisterId reg = job.order[position];
+    evaluator.computeRegister(reg);
+
+    // The users that were only waiting for this register can start
+    for (uint32_t i = job.userStart[position]; i < job.userStart[position + 1]; ++i) {
+        uint32_t user = job.userPositions[i];
+        if (job.remaining[user].fetch_sub(1) == 1) {
+            evaluator.pool->spawn(user);
+        }
+    }
+}
+
+void Evaluator::computeRegister(RegisterId reg) {
+    // All used registers are known to be evaluated already,
+    // so the program runs to the end in one go.
+    Frame frame = {reg, 0, 0, nullptr, AFFINE};
+    uint64_t reads = 0;
+    runFrame(frame, reads);
+    storeValue(reg, frame);
+    countEvaluation(reads, 0, 1);
+}
@@ -2,9 +2,17 @@
 #define EVALUATOR_H
 
 #include <iostream>
-#include <unordered_map>
+#include <atomic>
+#include <memory>
 
-#include "definitions.h"
+#include "instructions.h"
+#include "output.h"
+#include "shared.h"
+#include "symbols.h"
+#include "threadpool.h"
+#include "bytecode.h"
+
+class Journal;
 
 /*
  * This class represents an evaluator for the calculator.
@@ -12,12 +20,12 @@
  * the instructions in the given list of instructions. This
  * method will return if it encountered a quit operation or
  * not.
- * 
+ *
  * The class uses a symbol table to keep track of the used
  * registers. This symbol table contains entries for all
  * previously used registers. Each entry is associated with
- * a list of the operations performed on the register, in
- * sequential order.
+ * the operations performed on the register, in sequential
+ * order (compiled into a program, see below).
  *   This way of storing the instructions,
  * rather than just updating a stored value, is necessary
  * to support functionality for using a registry before it
@@ -27,7 +35,7 @@
  *     a add b
  *     b add 1
  *     print a
- * 
+ *
  * The evaluator reads the instructions one by one, and
  * performs the necessary actions. If the instruction is a
  * quit instruction, a false value will be returned immediately.
@@ -35,31 +43,209 @@
  * will be evaluated and printed to the console. If an
  * arithmetic operation is encountered, it will be added
  * in the symbol table, to the register it was performed on.
+ *
+ * Evaluated register values are memoized, so printing the
+ * same register again (with nothing changed in between) is a
+ * single lookup, and registers shared between several paths in
+ * the dependency graph are only evaluated once.
+ *   To know which cached values become stale when an operation
+ * is added, the evaluator keeps a reverse dependency graph next
+ * to the symbol table: for each register, the registers that
+ * use it as a value. Adding an operation to a register
+ * invalidates the cached value of that register and of all
+ * registers that transitively depend on it, and nothing else.
+ *
+ * The registers are identified by the integer ids handed out
+ * by the parser (see "symbols.h"), so the symbol table and the
+ * dependency graph are all stored in flat arrays indexed by
+ * ids. Evaluating a register does not touch any strings or
+ * hash maps; the register names are only looked up for error
+ * messages.
+ *
+ * The operations of each register are compiled into a bytecode
+ * program (see "bytecode.h"), which is extended every time an
+ * operation is added to the register. Runs of operations on
+ * constants are folded into a single affine map as they are
+ * added, so only the operations reading another register take
+ * up room, and adding an operation takes constant time. (Only
+ * the number of operations added to each register is kept, not
+ * the operations themselves.) Evaluating a register runs its
+ * program on a threaded interpreter.
+ *
+ * Registers are evaluated without recursion, by a depth-first
+ * walk over an explicit stack of partially evaluated registers.
+ * This way arbitrarily deep chains of registers only use heap
+ * memory, and not the native call stack. Registers that are on
+ * the stack are marked as active, so a register that depends on
+ * itself (directly or through other registers) is detected when
+ * it is reached a second time, and reported as an error.
+ *
+ * The evaluator can be given a thread pool (see "threadpool.h"),
+ * to evaluate large registers in parallel. When a printed register
+ * needs many registers to be evaluated, the dependency graph of
+ * those registers is collected first, and the registers are then
+ * evaluated as tasks on the pool: a register becomes a task once
+ * all of its dependencies have been evaluated. Each register is
+ * still evaluated by going through its operations in order, so
+ * the results are the same as when evaluating serially. (If the
+ * graph has a missing register or a cycle, the register is
+ * evaluated serially instead, to report the error.)
+ *
+ * Instead of keeping its own registers, the evaluator can use
+ * registers that are shared with other evaluators, on other
+ * threads (see "shared.h"). Its operations are then added to the
+ * shared registers, and its prints see the operations of all of
+ * the evaluators (as a consistent snapshot, without waiting for
+ * the evaluators that are adding operations).
+ *
+ * The evaluator can also be given a journal (see "journal.h"), to
+ * which it records the arithmetic operations it executes, committing
+ * them at the end of each call of execute().
  */
 class Evaluator {
 
+    // Saves and restores the registers (see "snapshot.h")
+    friend class Snapshot;
+
+    // Reports on the registers (see "explain.h")
+    friend class Explain;
+
 private:
 
     /* Definitions for how the register values are stored. */
 
-    // The list of operations on a register consists of pairs of operands and values.
-    typedef std::tuple<Operand, std::string> Operation;
-    typedef std::vector<Operation> Operations;
+    // Index of an edge in the dependency graph.
+    // NONE marks the end of a chain.
+    typedef uint32_t Index;
+    static const Index NONE = UINT32_MAX;
+
+    // The symbol table is a set of parallel arrays indexed by register id.
+    // A register is defined once it has at least one operation.
+    // A register is only cached if all registers it depends on are
+    // cached as well, so invalidation can stop at uncached registers.
+    struct SymbolTable {
+        std::vector<uint64_t> counts;   // Number of operations added to the register
+        std::vector<Index> users;       // First edge of the reverse dependencies
+        std::vector<Index> uses;        // First edge of the dependencies
+        std::vector<uint8_t> cached;    // Whether the cached value is valid (a ValueState)
+        std::vector<int64_t> values;    // Cached value of the register
+        std::vector<std::unique_ptr<Number>> wideValues;  // Cached value, if over 64 bits
+        std::vector<uint8_t> active;    // Whether the register is being evaluated
+        std::vector<Program> programs;  // Compiled operations of the register
+    };
+
+    // The dependency graph is stored as chained edges, in both directions.
+    // Each register has a chain of edges to the registers it uses, and
+    // a chain of edges to the registers using it.
+    struct Edges {
+        std::vector<RegisterId> targets;  // Register at the other end
+        std::vector<Index> next;          // Next edge of the same chain
+    };
+
+    // Interned register names, used for error messages (and by the
+    // snapshots, see "snapshot.h")
+    Symbols &symbols;
 
-    // The symbol table is implemented as a hash map, containing the stored registers (symbols)
-    // and a list of the operands used on the register.
-    typedef std::unordered_map<std::string, Operations> SymbolTable;
+    // Where the output is written to
+    Output *output;
 
     // Symbol table holding all information about the used registers
     SymbolTable registers;
 
+    // Dependencies between the registers
+    Edges edges;
+
+    // Values of the big literals (that do not fit in 64 bits)
+    std::vector<Number> constants;
+
+    // A register that is being evaluated: where its program stopped
+    // (and the opcode there), and the value accumulated so far (in
+    // 'wide', once the value has needed more than 64 bits).
+    struct Frame {
+        RegisterId reg;
+        size_t pc;
+        int64_t value;
+        std::unique_ptr<Number> wide;
+        Opcode opcode;
+    };
+
+    // Registers left to invalidate (kept to reuse its memory)
+    std::vector<RegisterId> pending;
+
+    // Stack of registers being evaluated (kept to reuse its memory)
+    std::vector<Frame> stack;
+
+    // The shared registers, and the reader of this evaluator (none when
+    // the evaluator keeps its own registers)
+    SharedRegisters *shared;
+    std::unique_ptr<SharedRegisters::Reader> reader;
+
+    // Pool for evaluating in parallel (none when evaluating serially)
+    std::unique_ptr<ThreadPool> pool;
+
+    // Number of registers that have to be evaluated for a print
+    // before it is worth evaluating them in parallel
+    static const size_t PARALLEL_THRESHOLD = 1024;
+
+    // State of a parallel evaluation. The registers to evaluate are
+    // ordered so that dependencies come before the registers using them.
+    // The users of each register are stored in compressed rows, indexed
+    // by positions in that order.
+    struct ParallelJob {
+        std::vector<RegisterId> order;          // Registers to evaluate
+        std::vector<uint32_t> position;         // Position of each register in the order
+        std::vector<uint32_t> userStart;        // Start of the users of each position
+        std::vector<uint32_t> userPositions;    // Positions of the users
+        std::vector<std::pair<uint32_t, uint32_t>> links;     // (used, user) positions
+        std::vector<uint32_t> lastUser;         // Last user linked to each position
+        std::vector<std::pair<RegisterId, Index>> walk;       // Stack for collecting
+        std::unique_ptr<std::atomic<uint32_t>[]> remaining;  // Dependencies left
+        size_t capacity;
+    };
+    ParallelJob job;
+
+    // Journal the operations are recorded to (none if not journaled)
+    Journal *journal;
+
+    // File the graph of each explained register is written to (empty
+    // for none)
+    std::string explainGraph;
+
 public:
 
+    /* Create an evaluator, for instructions whose registers are
+     * interned in the given symbols object. */
+    Evaluator(Symbols &symbols);
+
+    /* Set the number of threads used for evaluating registers.
+     * With more than one thread, large registers are evaluated
+     * in parallel. */
+    void setThreads(unsigned threads);
+
+    /* Set where the output (and the error messages) are written
+     * to. By default this is the console (see "output.h"). */
+    void setOutput(Output &out);
+
+    /* Use the given shared registers from now on, instead of the
+     * registers of this evaluator (see "shared.h"). The registers
+     * must be interned in the same symbols object by all evaluators
+     * sharing them. */
+    void share(SharedRegisters &registers);
+
+    /* Record the arithmetic operations to the given journal from now
+     * on (see "journal.h"). */
+    void setJournal(Journal &journal);
+
+    /* Write the dependency graph of each explained register to the
+     * given file from now on, in the Graphviz format (see "explain.h"). */
+    void setExplainGraph(const std::string &filename);
+
     /* This method is the interface for using the evaluator.
      * It takes a list of instructions, and will execute them,
      * sequentially.
-     *   This method can handle operations: print, quit, and
-     * arithmetic operations (add, subtract, multiply).
+     *   This method can handle operations: print, explain, save,
+     * restore, quit, and arithmetic operations (add, subtract,
+     * multiply), and prints the messages of error instructions.
      *   This method will remove all the instructions that
      * are executed.
      *   The return value is a boolean signifying if a quit
@@ -74,29 +260,104 @@ private:
     /* This method adds an operation to the given register.
      * The operation will contain the given operand and the
      * given value. */
-    void addArithmeticOperation(Operand &op, std::string &reg, std::string &value);
+    void addArithmeticOperation(Operand op, RegisterId reg, ValueKind kind, int64_t value);
+
+    /* This method adds an operation to a register of the shared
+     * registers. */
+    void addSharedOperation(Operand op, RegisterId reg, ValueKind kind, int64_t value);
+
+    /* This method evaluates a register of the shared registers, and
+     * prints it. */
+    void printShared(RegisterId reg);
+
+    /* This method reports on what evaluating the given register
+     * involves (see "explain.h"). */
+    void explainRegister(RegisterId reg);
+
+    /* This method saves the registers to the given snapshot file, or
+     * replaces them with the registers of one (see "snapshot.h"). */
+    void saveSnapshot(const std::string &filename);
+    void restoreSnapshot(const std::string &filename);
+
+    /* This method makes sure the symbol table has an entry
+     * for the given register id. */
+    void reserve(RegisterId reg);
+
+    /* This method adds the edges for a register reading another
+     * one to the dependency graph (unless the last register it
+     * read is the same one). */
+    void addDependency(RegisterId reg, RegisterId used);
+
+    /* This method removes the cached value of the given
+     * register, and of all registers that (transitively)
+     * depend on it. */
+    void invalidate(RegisterId reg);
 
     /* This method will evaluate the value of the given
      * register, and print it to the console.
      *   The value will only be printed if the evaluation
      * was successful. */
-    void printRegister(std::string &reg);
+    void printRegister(RegisterId reg);
 
-    /* This method evaluates the numeric value of a string
-     * represented value.
-     *   This string can be either a numeric value (only digits),
-     * or the name of a register (alphanumeric symbols).
+    /* This method evaluates the numeric value of a value.
+     *   The value can be either a numeric literal, or the id
+     * of a register.
      *   The resulting value will be stored in the given output
-     * parameter 'outvalue'.
-     *   If the value is a register name, it has to be a
+     * parameter 'outvalue' (as an exact number of any size).
+     *   If the value is a register, it has to be a
      * previously defined one, otherwise it's an error.
      *   The method returns if the evaluation was successful
      * or not. If it wasn't successful, the 'outvalue' will
      * be unaltered, and an error message will be printed to
-     * console. */
-    bool evaluateValue(std::string &value, long &outvalue);
+     * console.
+     *   Successfully evaluated register values are stored in
+     * the value cache, and served from it until invalidated. */
+    bool evaluateValue(ValueKind kind, int64_t value, Number &outvalue);
+
+    /* This method evaluates a register that is defined, but not
+     * cached, by running its program. The registers it depends
+     * on are evaluated first, using the explicit stack. Returns
+     * false (after printing an error message) if a register is
+     * missing or part of a cycle. */
+    bool evaluateRegister(RegisterId reg);
+
+    /* This method runs the program of a frame from where it stopped,
+     * switching to numbers of any size when it needs more than 64
+     * bits. Returns FINISHED or BLOCKED (see "bytecode.h"). */
+    Bytecode::Status runFrame(Frame &frame, uint64_t &reads) const;
+
+    /* This method stores the value of an evaluated register in the
+     * cache (as a 64-bit value, or as a wide value if it needs to be),
+     * and marks it as evaluated. */
+    void storeValue(RegisterId reg, Frame &frame);
+
+    /* This method returns the cached value of an evaluated register. */
+    Number cachedValue(RegisterId reg) const;
+
+    /* This method clears the stack after a failed evaluation. */
+    void abortEvaluation();
+
+    /* This method adds the counts of an evaluation to the statistics
+     * (see "stats.h"): the register reads that found their value, the
+     * reads that had to wait for the register, and the registers run. */
+    static void countEvaluation(uint64_t reads, uint64_t misses, uint64_t evaluated);
+
+    /* This method collects the registers that have to be evaluated
+     * for the given (uncached) register, in the order of the parallel
+     * job. Returns false if a register is missing or part of a cycle. */
+    bool collectDependencies(RegisterId reg);
+
+    /* This method evaluates the collected registers on the pool. */
+    void evaluateParallel();
+
+    /* Task of the parallel evaluation: evaluates the register at the
+     * given position, and spawns the users that become ready. */
+    static void evaluateTask(void *context, uint32_t position);
+
+    /* This method runs the program of a register whose
+     * dependencies have all been evaluated, and stores its value. */
+    void computeRegister(RegisterId reg);
 
 };
 
 #endif // EVALUATOR_H
-
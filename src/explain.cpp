@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <fstream>
+
+#include "explain.h"
+
+const uint32_t Explain::NONE;
+const size_t Explain::HOTSPOTS;
+
+namespace {
+
+/* Sort the reads of a register, for counting the registers it reads
+ * (each one once). */
+void sortedReads(const uint32_t *begin, const uint32_t *end, std::vector<uint32_t> &out) {
+    out.assign(begin, end);
+    std::sort(out.begin(), out.end());
+}
+
+}
+
+bool Explain::defined(const Evaluator &evaluator, RegisterId reg) {
+    return reg < evaluator.registers.counts.size() && evaluator.registers.counts[reg] > 0;
+}
+
+void Explain::collect(const Evaluator &evaluator, RegisterId reg, Closure &closure) {
+    const Evaluator::SymbolTable &table = evaluator.registers;
+    closure.position.assign(std::max(table.counts.size(), static_cast<size_t>(reg) + 1), NONE);
+    closure.cycle = NONE;
+
+    // Add a register to the closure, with the registers it reads (as
+    // ids, until all positions are known)
+    auto discover = [&](RegisterId found) {
+        uint32_t position = static_cast<uint32_t>(closure.registers.size());
+        closure.position[found] = position;
+        closure.registers.push_back(found);
+        closure.readStart.push_back(closure.reads.size());
+        size_t instructions = 0;
+        if (defined(evaluator, found)) {
+            std::vector<RegisterId> reads;
+            instructions = Bytecode::references(table.programs[found], reads);
+            closure.reads.insert(closure.reads.end(), reads.begin(), reads.end());
+        }
+        closure.instructions.push_back(instructions);
+        return position;
+    };
+
+    // Walk the graph depth-first (without recursion), adding each
+    // register to the order once all the registers it reads are; a
+    // register that is reached again while it is being walked is part
+    // of a cycle
+    struct Entry {
+        uint32_t position;
+        size_t next;
+    };
+    std::vector<Entry> stack;
+    std::vector<uint8_t> done;
+    stack.push_back({discover(reg), 0});
+    done.push_back(0);
+    while (!stack.empty()) {
+        uint32_t position = stack.back().position;
+        size_t end = position + 1 < closure.readStart.size() ? closure.readStart[position + 1] : closure.reads.size();
+        size_t at = closure.readStart[position] + stack.back().next;
+        if (at == end) {
+            done[position] = 1;
+            closure.order.push_back(position);
+            stack.pop_back();
+            continue;
+        }
+        ++stack.back().next;
+        RegisterId used = closure.reads[at];
+        if (closure.position[used] == NONE) {
+            stack.push_back({discover(used), 0});
+            done.push_back(0);
+        } else if (!done[closure.position[used]] && closure.cycle == NONE) {
+            closure.cycle = closure.position[used];
+        }
+    }
+    closure.readStart.push_back(closure.reads.size());
+    for (uint32_t &read : closure.reads) {
+        read = closure.position[read];
+    }
+}
+
+void Explain::report(const Evaluator &evaluator, RegisterId reg, Output &out) {
+    const Symbols &symbols = evaluator.symbols;
+    const Evaluator::SymbolTable &table = evaluator.registers;
+    Closure closure;
+    collect(evaluator, reg, closure);
+    size_t count = closure.registers.size();
+
+    // Operations, costs and fan-in of each register
+    size_t undefined = 0;
+    uint64_t operations = 0;
+    uint64_t most = 0;
+    uint32_t busiest = NONE;
+    size_t scratchCost = 0;
+    size_t currentCost = 0;
+    size_t currentEvaluations = 0;
+    std::vector<std::pair<size_t, uint32_t>> fanIn;
+    std::vector<uint32_t> reads;
+    for (uint32_t position = 0; position < count; ++position) {
+        RegisterId current = closure.registers[position];
+        if (!defined(evaluator, current)) {
+            ++undefined;
+            continue;
+        }
+        uint64_t added = table.counts[current];
+        operations += added;
+        if (added > most) {
+            most = added;
+            busiest = position;
+        }
+        scratchCost += closure.instructions[position];
+        if (!table.cached[current]) {
+            currentCost += closure.instructions[position];
+            ++currentEvaluations;
+        }
+        sortedReads(closure.reads.data() + closure.readStart[position],
+                    closure.reads.data() + closure.readStart[position + 1], reads);
+        size_t distinct = static_cast<size_t>(std::unique(reads.begin(), reads.end()) - reads.begin());
+        if (distinct > 0) {
+            fanIn.push_back(std::make_pair(distinct, position));
+        }
+    }
+    size_t hotspots = std::min(HOTSPOTS, fanIn.size());
+    std::partial_sort(fanIn.begin(), fanIn.begin() + hotspots, fanIn.end(),
+                      [](const std::pair<size_t, uint32_t> &a, const std::pair<size_t, uint32_t> &b) {
+                          return a.first > b.first || (a.first == b.first && a.second < b.second);
+                      });
+
+    // The depth and the evaluations (without sharing, an evaluation of
+    // each register read, for every instruction reading it), in the
+    // order of the dependencies
+    std::vector<size_t> depth(count, 0);
+    std::vector<Number> evaluations(count);
+    if (closure.cycle == NONE) {
+        for (uint32_t position : closure.order) {
+            size_t deepest = 0;
+            Number total(1);
+            for (size_t i = closure.readStart[position]; i < closure.readStart[position + 1]; ++i) {
+                deepest = std::max(deepest, depth[closure.reads[i]]);
+                total.apply(ADD, evaluations[closure.reads[i]]);
+            }
+            depth[position] = deepest + 1;
+            evaluations[position] = std::move(total);
+        }
+    }
+
+    out << "Explain '" << symbols.name(reg) << "':" << '\n';
+    out << "  Registers: " << static_cast<int64_t>(count) << " in the closure";
+    if (undefined > 0) {
+        out << " (" << static_cast<int64_t>(undefined) << " not defined, so it cannot be evaluated)";
+    }
+    out << '\n';
+    if (closure.cycle != NONE) {
+        out << "  Cycle: '" << symbols.name(closure.registers[closure.cycle])
+            << "' depends on itself, so it cannot be evaluated" << '\n';
+    } else {
+        out << "  Depth: " << static_cast<int64_t>(depth[0]) << " (registers in the longest chain)" << '\n';
+    }
+    out << "  Operations: " << static_cast<int64_t>(operations);
+    if (busiest != NONE) {
+        out << " (the most on '" << symbols.name(closure.registers[busiest]) << "': "
+            << static_cast<int64_t>(most) << ")";
+    }
+    out << '\n';
+    if (hotspots > 0) {
+        out << "  Fan-in: ";
+        for (size_t i = 0; i < hotspots; ++i) {
+            if (i > 0) out << ", ";
+            out << "'" << symbols.name(closure.registers[fanIn[i].second]) << "' reads "
+                << static_cast<int64_t>(fanIn[i].first);
+        }
+        out << '\n';
+    }
+    if (closure.cycle == NONE && undefined == 0) {
+        out << "  Evaluations: " << static_cast<int64_t>(count - undefined) << " with sharing ("
+            << static_cast<int64_t>(currentEvaluations) << " not cached), " << evaluations[0] << " without" << '\n';
+    }
+    out << "  Cost in instructions: " << static_cast<int64_t>(scratchCost) << " from scratch, "
+        << static_cast<int64_t>(currentCost) << " now (with the cached values)" << '\n';
+}
+
+bool Explain::graph(const Evaluator &evaluator, RegisterId reg, const std::string &filename) {
+    const Symbols &symbols = evaluator.symbols;
+    const Evaluator::SymbolTable &table = evaluator.registers;
+    Closure closure;
+    collect(evaluator, reg, closure);
+
+    std::ofstream file(filename);
+    file << "digraph \"" << symbols.name(reg) << "\" {\n";
+    file << "    node [shape=box];\n";
+    std::vector<uint32_t> reads;
+    for (uint32_t position = 0; position < closure.registers.size(); ++position) {
+        RegisterId current = closure.registers[position];
+        const std::string &name = symbols.name(current);
+        file << "    \"" << name << "\" [label=\"" << name;
+        if (defined(evaluator, current)) {
+            file << "\\noperations: " << table.counts[current] << "\"";
+        } else {
+            file << "\\nnot defined\", style=dashed";
+        }
+        if (position == 0) {
+            file << ", penwidth=2";
+        }
+        file << "];\n";
+
+        // An edge per register read, with the number of reads
+        sortedReads(closure.reads.data() + closure.readStart[position],
+                    closure.reads.data() + closure.readStart[position + 1], reads);
+        for (size_t i = 0; i < reads.size(); ) {
+            size_t same = 1;
+            while (i + same < reads.size() && reads[i + same] == reads[i]) ++same;
+            file << "    \"" << name << "\" -> \"" << symbols.name(closure.registers[reads[i]]) << "\"";
+            if (same > 1) {
+                file << " [label=\"" << same << "\"]";
+            }
+            file << ";\n";
+            i += same;
+        }
+    }
+    file << "}\n";
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,91 @@
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+#include "output.h"
+
+/*
+ * This class explains what evaluating a register involves, for the
+ * 'explain <register>' command (and the '--explain' option), to find
+ * out why printing a register is slow.
+ *
+ * It looks at the registers of an evaluator (its symbol table and its
+ * compiled programs), without evaluating anything, and reports:
+ *  > registers:    the size of the dependency closure of the register
+ *                  (the register, and all registers it transitively
+ *                  reads), and how many of them are not defined.
+ *  > depth:        the longest chain of registers reading each other,
+ *                  which is how deep the evaluation goes.
+ *  > operations:   the number of operations added to the registers of
+ *                  the closure, and the register with the most.
+ *  > fan-in:       the registers that read the most other registers.
+ *  > evaluations:  the number of register evaluations with sharing (as
+ *                  the evaluator does it, with memoized values: once
+ *                  per register), and without (once per path through
+ *                  the graph, which can grow exponentially, and is
+ *                  computed exactly).
+ *  > cost:         an estimate of the work, as the number of bytecode
+ *                  instructions run (see "bytecode.h"): for evaluating
+ *                  the closure from scratch, and now, skipping the
+ *                  registers whose values are cached.
+ * (The register itself must be defined: the evaluator reports a
+ * lookup error instead, as for printing it.)
+ * If the register depends on itself, the depth and the evaluations
+ * are not reported, but the register where the cycle was found is.
+ * (Nor are the evaluations, if a register of the closure is not
+ * defined, since the evaluation stops there.)
+ *
+ * The dependency graph of the closure can also be written to a file
+ * in the Graphviz format ('--explain-dot <file>'), with an edge from
+ * each register to each register it reads (labeled with the number of
+ * reads, if more than one), so pathological scripts can be looked at:
+ *     dot -Tsvg graph.dot -o graph.svg
+ */
+class Explain {
+
+private:
+
+    // Marks a register that is not in the closure, or no cycle
+    static const uint32_t NONE = UINT32_MAX;
+
+    // Number of fan-in hotspots reported
+    static const size_t HOTSPOTS = 3;
+
+    // The dependency closure of a register. The registers are numbered
+    // by position in the order they were found (the explained register
+    // is 0), and the registers each one reads are stored in compressed
+    // rows, as positions.
+    struct Closure {
+        std::vector<RegisterId> registers;  // Register at each position
+        std::vector<uint32_t> position;     // Position of each register, or NONE
+        std::vector<size_t> readStart;      // Start of the reads of each position
+        std::vector<uint32_t> reads;        // Positions read (once per instruction)
+        std::vector<size_t> instructions;   // Bytecode instructions of each position
+        std::vector<uint32_t> order;        // Positions, dependencies first
+        uint32_t cycle;                     // Position where a cycle was found, or NONE
+    };
+
+public:
+
+    /* Write the report on a register of the evaluator to the output. */
+    static void report(const Evaluator &evaluator, RegisterId reg, Output &out);
+
+    /* Write the dependency graph of a register of the evaluator to a
+     * file, in the Graphviz format. Returns false if the file could not
+     * be written. */
+    static bool graph(const Evaluator &evaluator, RegisterId reg, const std::string &filename);
+
+private:
+
+    /* Collect the dependency closure of a register. */
+    static void collect(const Evaluator &evaluator, RegisterId reg, Closure &closure);
+
+    /* Return whether a register has any operations. */
+    static bool defined(const Evaluator &evaluator, RegisterId reg);
+
+};
+
+#endif // EXPLAIN_H
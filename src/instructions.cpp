@@ -0,0 +1,8 @@
+#include "instructions.h"
+
+const size_t Instructions::CHUNK_BITS;
+const size_t Instructions::CHUNK;
+
+void Instructions::grow() {
+    chunks.emplace_back(new Instruction[CHUNK]);
+}
@@ -0,0 +1,82 @@
+#ifndef INSTRUCTIONS_H
+#define INSTRUCTIONS_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "definitions.h"
+
+/*
+ * This class is the list of instructions passed from the parser to
+ * the evaluator. It works as a queue, since the instructions are
+ * always executed in the same order they are parsed.
+ *
+ * The instructions are stored in an arena of fixed-size chunks. The
+ * chunks are only allocated when the list grows beyond its largest
+ * size so far, and are never freed or moved: when the last instruction
+ * is taken out, the whole list is reset in bulk, and the chunks are
+ * reused by the next batch. So in steady state (one batch after the
+ * other), adding and taking instructions does no heap allocations.
+ */
+class Instructions {
+
+private:
+
+    // Number of instructions in a chunk (a power of two)
+    static const size_t CHUNK_BITS = 10;
+    static const size_t CHUNK = size_t(1) << CHUNK_BITS;
+
+    // The chunks of the arena
+    std::vector<std::unique_ptr<Instruction[]>> chunks;
+
+    // Positions of the first and one past the last instruction
+    size_t head;
+    size_t tail;
+
+public:
+
+    Instructions() : head(0), tail(0) {}
+
+    /* Return true if there are no instructions in the list. */
+    bool empty() const { return head == tail; }
+
+    /* Return the number of instructions in the list. */
+    size_t size() const { return tail - head; }
+
+    /* Add an instruction at the end of the list. */
+    void push(const Instruction &instruction) {
+        if (tail == chunks.size() << CHUNK_BITS) {
+            grow();
+        }
+        chunks[tail >> CHUNK_BITS][tail & (CHUNK - 1)] = instruction;
+        ++tail;
+    }
+
+    /* Return the first instruction in the list. */
+    const Instruction &front() const {
+        return chunks[head >> CHUNK_BITS][head & (CHUNK - 1)];
+    }
+
+    /* Take the first instruction out of the list. When the list
+     * becomes empty, it is reset, so the chunks are reused. */
+    void pop() {
+        if (++head == tail) {
+            clear();
+        }
+    }
+
+    /* Remove all instructions (keeping the chunks for reuse). */
+    void clear() {
+        head = 0;
+        tail = 0;
+    }
+
+private:
+
+    /* Add a chunk at the end of the arena. */
+    void grow();
+
+};
+
+#endif // INSTRUCTIONS_H
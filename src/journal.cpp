@@ -0,0 +1,353 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "journal.h"
+#include "mappedfile.h"
+
+const uint32_t Journal::VERSION;
+const size_t Journal::FRAME_HEADER;
+const size_t Journal::BATCH;
+const uint32_t Journal::NONE;
+
+namespace {
+
+// Magic and byte order mark of the journal header
+const char JOURNAL_MAGIC[8] = {'R', 'E', 'G', 'J', 'R', 'N', 'L', '\0'};
+const uint32_t JOURNAL_BYTE_ORDER = 0x01020304;
+
+// Header of a journal file
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+};
+
+// Tag of a record holding the name of the next register (the tags of
+// operations are the operand, plus the kind of value times 4)
+const uint8_t NAME_TAG = 0x80;
+
+/* Return the checksum of a frame (a 32-bit FNV-1a hash). */
+uint32_t checksum(const char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Append a variable length integer (7 bits per byte, low bits first). */
+void appendNumber(std::string &out, uint64_t number) {
+    while (number >= 0x80) {
+        out += static_cast<char>((number & 0x7f) | 0x80);
+        number >>= 7;
+    }
+    out += static_cast<char>(number);
+}
+
+/* Read a variable length integer. Returns false if the data ends
+ * within it (or it is too long). */
+bool readNumber(const char *&position, const char *end, uint64_t &out) {
+    uint64_t number = 0;
+    for (unsigned shift = 0; shift < 64 && position < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*position++);
+        number |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            out = number;
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifndef _WIN32
+/* Write all of the data to a descriptor. */
+bool writeAll(int descriptor, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::write(descriptor, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+/* Sync the data of a file to disk. */
+void syncFile(int descriptor) {
+#ifdef __linux__
+    fdatasync(descriptor);
+#else
+    fsync(descriptor);
+#endif
+}
+#endif
+
+}
+
+Journal::Journal(Symbols &symbols)
+    : symbols(symbols), descriptor(-1), frame(FRAME_HEADER, '\0'), registers(0), failed(false),
+      window(0), dirty(false), stopping(false), replayedCount(0) {
+}
+
+Journal::~Journal() {
+    commit();
+    if (syncer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        syncer.join();
+    }
+#ifndef _WIN32
+    if (descriptor >= 0) {
+        syncFile(descriptor);
+        ::close(descriptor);
+    }
+#endif
+}
+
+bool Journal::open(const std::string &filename, Evaluator &evaluator, std::chrono::milliseconds window,
+                   std::string &error) {
+#ifndef _WIN32
+    descriptor = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (descriptor < 0) {
+        error = "the file could not be opened";
+        return false;
+    }
+
+    // Replay the frames, and cut off whatever follows the last complete
+    // one (or write the header, for a new journal)
+    struct stat status;
+    fstat(descriptor, &status);
+    size_t valid = 0;
+    if (status.st_size > 0) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            error = "the file could not be read";
+            return false;
+        }
+        valid = replay(file.begin(), file.end(), evaluator);
+        if (valid == 0) {
+            error = "it is not a journal, or has another version or byte order";
+            return false;
+        }
+    } else {
+        JournalHeader header;
+        std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        header.version = VERSION;
+        header.byteOrder = JOURNAL_BYTE_ORDER;
+        if (!writeAll(descriptor, reinterpret_cast<const char *>(&header), sizeof(header))) {
+            error = "the file could not be written";
+            return false;
+        }
+        valid = sizeof(header);
+    }
+    if (static_cast<size_t>(status.st_size) > valid && ftruncate(descriptor, static_cast<off_t>(valid)) != 0) {
+        error = "the damaged end of the file could not be removed";
+        return false;
+    }
+    lseek(descriptor, static_cast<off_t>(valid), SEEK_SET);
+    syncFile(descriptor);
+
+    this->window = window;
+    if (window.count() > 0) {
+        syncer = std::thread(&Journal::syncLoop, this);
+    }
+    return true;
+#else
+    (void) filename;
+    (void) evaluator;
+    (void) window;
+    error = "journals are not supported on this platform";
+    return false;
+#endif
+}
+
+void Journal::record(Operand op, RegisterId reg, ValueKind kind, int64_t value) {
+    // (The registers are numbered first, since that can add records)
+    uint32_t target = number(reg);
+    uint32_t used = kind == REFERENCE ? number(static_cast<RegisterId>(value)) : 0;
+    frame += static_cast<char>(static_cast<uint8_t>(op) | static_cast<uint8_t>(kind) << 2);
+    appendNumber(frame, target);
+    switch (kind) {
+        case LITERAL:
+            // (Zigzag encoded, so small negative values are short too)
+            appendNumber(frame, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+            break;
+        case REFERENCE:
+            appendNumber(frame, used);
+            break;
+        case BIG_LITERAL: {
+            const std::string &digits = symbols.number(static_cast<uint32_t>(value));
+            appendNumber(frame, digits.size());
+            frame += digits;
+            break;
+        }
+    }
+}
+
+void Journal::commit() {
+    if (frame.size() == FRAME_HEADER || descriptor < 0) {
+        return;
+    }
+#ifndef _WIN32
+    uint32_t length = static_cast<uint32_t>(frame.size() - FRAME_HEADER);
+    uint32_t sum = checksum(frame.data() + FRAME_HEADER, length);
+    std::memcpy(&frame[0], &length, sizeof(length));
+    std::memcpy(&frame[4], &sum, sizeof(sum));
+    if (!writeAll(descriptor, frame.data(), frame.size()) && !failed) {
+        std::cerr << "Could not write to the journal, the operations after this are not kept." << std::endl;
+        failed = true;
+    }
+    frame.resize(FRAME_HEADER);
+
+    if (window.count() == 0) {
+        syncFile(descriptor);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!dirty) {
+        dirty = true;
+        wake.notify_one();
+    }
+#endif
+}
+
+size_t Journal::replay(const char *begin, const char *end, Evaluator &evaluator) {
+    JournalHeader header;
+    if (static_cast<size_t>(end - begin) < sizeof(header)) {
+        return 0;
+    }
+    std::memcpy(&header, begin, sizeof(header));
+    if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        header.version != VERSION || header.byteOrder != JOURNAL_BYTE_ORDER) {
+        return 0;
+    }
+
+    // The ids of the journal's registers in this session, and the
+    // operations of the frame being decoded
+    std::vector<RegisterId> ids;
+    std::vector<Instruction> decoded;
+    Instructions instructions;
+    const char *valid = begin + sizeof(header);
+    while (static_cast<size_t>(end - valid) >= FRAME_HEADER) {
+        uint32_t length;
+        uint32_t sum;
+        std::memcpy(&length, valid, sizeof(length));
+        std::memcpy(&sum, valid + 4, sizeof(sum));
+        const char *position = valid + FRAME_HEADER;
+        if (length > static_cast<size_t>(end - position) || checksum(position, length) != sum) {
+            break;
+        }
+        const char *frameEnd = position + length;
+
+        // Decode the records of the frame (a frame that does not decode,
+        // in spite of its checksum, ends the replay as well; its names
+        // stay interned, which only adds registers without operations)
+        size_t names = ids.size();
+        decoded.clear();
+        bool complete = true;
+        while (position < frameEnd && complete) {
+            uint8_t tag = static_cast<uint8_t>(*position++);
+            uint64_t target = 0;
+            uint64_t value = 0;
+            if (tag == NAME_TAG) {
+                complete = readNumber(position, frameEnd, value) && value <= static_cast<size_t>(frameEnd - position);
+                if (complete) {
+                    ids.push_back(symbols.intern(position, static_cast<size_t>(value)));
+                    position += value;
+                }
+                continue;
+            }
+            Operand op = static_cast<Operand>(tag & 3);
+            ValueKind kind = static_cast<ValueKind>(tag >> 2);
+            complete = op <= MULTIPLY && kind <= BIG_LITERAL && readNumber(position, frameEnd, target) &&
+                       target < ids.size() && readNumber(position, frameEnd, value);
+            if (!complete) break;
+            int64_t operand = 0;
+            if (kind == LITERAL) {
+                // (Zigzag decoded)
+                operand = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+            } else if (kind == REFERENCE) {
+                complete = value < ids.size();
+                operand = complete ? ids[value] : 0;
+            } else {
+                complete = value <= static_cast<size_t>(frameEnd - position);
+                if (complete) {
+                    operand = symbols.addNumber(position, static_cast<size_t>(value));
+                    position += value;
+                }
+            }
+            Instruction instruction = {static_cast<uint8_t>(op), static_cast<uint8_t>(kind), ids[target], operand};
+            decoded.push_back(instruction);
+        }
+        if (!complete) {
+            ids.resize(names);
+            break;
+        }
+        for (const Instruction &instruction : decoded) {
+            instructions.push(instruction);
+        }
+        replayedCount += decoded.size();
+        valid = frameEnd;
+        if (instructions.size() >= BATCH) {
+            evaluator.execute(instructions);
+        }
+    }
+    evaluator.execute(instructions);
+
+    // Continue numbering the registers after the journal's
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] >= numbers.size()) {
+            numbers.resize(static_cast<size_t>(ids[i]) + 1, NONE);
+        }
+        numbers[ids[i]] = static_cast<uint32_t>(i);
+    }
+    registers = static_cast<uint32_t>(ids.size());
+    return static_cast<size_t>(valid - begin);
+}
+
+uint32_t Journal::number(RegisterId reg) {
+    if (reg >= numbers.size()) {
+        numbers.resize(static_cast<size_t>(reg) + 1, NONE);
+    }
+    if (numbers[reg] == NONE) {
+        const std::string &name = symbols.name(reg);
+        frame += static_cast<char>(NAME_TAG);
+        appendNumber(frame, name.size());
+        frame += name;
+        numbers[reg] = registers++;
+    }
+    return numbers[reg];
+}
+
+void Journal::syncLoop() {
+#ifndef _WIN32
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return dirty || stopping; });
+        if (stopping) {
+            // (The destructor syncs what is left)
+            return;
+        }
+        // Wait out the window, so that one sync covers all the frames
+        // written in it
+        wake.wait_for(lock, window, [this] { return stopping; });
+        dirty = false;
+        lock.unlock();
+        syncFile(descriptor);
+        lock.lock();
+    }
+#endif
+}
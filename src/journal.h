@@ -0,0 +1,138 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "evaluator.h"
+#include "symbols.h"
+
+/*
+ * This class keeps a write-ahead journal of a session ('--journal
+ * <file>'): every arithmetic operation the evaluator executes is
+ * appended to the file, so that a later session (after an exit or a
+ * crash) starts with the same registers, by replaying the journal.
+ *
+ * The operations are stored as compact binary records, so replaying
+ * them does no lexing or parsing: a record is a tag byte (the operand
+ * and the kind of value), the register, and the value, with the
+ * numbers as variable length integers (7 bits per byte). Registers
+ * are numbered by the journal itself: a register gets the next number
+ * the first time an operation uses it, with a record holding its name
+ * (so each name is stored once). Literals over 64 bits are stored as
+ * their digits.
+ *   The records of each call of the evaluator (a line, in a console
+ * session) are written together, as a frame with their length and a
+ * checksum, so a frame that was only partly written when the process
+ * died (or that was damaged) is found on replay. Replay stops at the
+ * first such frame, and the file is cut there before new frames are
+ * appended. The file is a header (magic "REGJRNL", version and byte
+ * order mark) followed by the frames, in the native byte order.
+ *
+ * # Group commit
+ * Each frame is written to the file at once, so it survives the
+ * process dying. To also survive the machine going down, the file has
+ * to be synced to disk, which takes milliseconds. Instead of syncing
+ * every frame (which would limit the session to a few hundred lines
+ * per second), a background thread syncs the file once per durability
+ * window: the first frame written after a sync wakes it, it waits for
+ * the window, and then one sync covers all frames written meanwhile.
+ * So at most a window of operations can be lost, and the session never
+ * waits for the disk. With a window of 0, every frame is synced before
+ * the evaluator continues.
+ *
+ * Journals are only supported on POSIX systems.
+ */
+class Journal {
+
+private:
+
+    // Version of the journal format
+    static const uint32_t VERSION = 1;
+
+    // Size of the header of a frame (its length and checksum)
+    static const size_t FRAME_HEADER = 8;
+
+    // Number of replayed instructions executed at a time
+    static const size_t BATCH = 4096;
+
+    Symbols &symbols;
+
+    // The file, and the records of the frame being built (after room
+    // for the frame header)
+    int descriptor;
+    std::string frame;
+
+    // The journal number of each register (by id), or NONE, and the
+    // number of registers in the journal
+    std::vector<uint32_t> numbers;
+    uint32_t registers;
+
+    // Whether writing failed (it is reported once)
+    bool failed;
+
+    // The durability window, and the state of the syncing thread
+    std::chrono::milliseconds window;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool dirty;
+    bool stopping;
+    std::thread syncer;
+
+    // Number of operations replayed when the journal was opened
+    uint64_t replayedCount;
+
+public:
+
+    // Marks a register without a journal number
+    static const uint32_t NONE = UINT32_MAX;
+
+    /* Create a journal for a session whose registers are interned in
+     * the given symbols object. */
+    explicit Journal(Symbols &symbols);
+
+    /* Write out the last frame, sync it, and close the file. */
+    ~Journal();
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    /* Open the journal file (creating it if needed), replay its
+     * operations into the evaluator, and prepare to append to it,
+     * syncing once per window. Returns false, with a description of the
+     * problem in 'error', if it is not a journal or cannot be written. */
+    bool open(const std::string &filename, Evaluator &evaluator, std::chrono::milliseconds window,
+              std::string &error);
+
+    /* Add an operation to the current frame (from the evaluator). */
+    void record(Operand op, RegisterId reg, ValueKind kind, int64_t value);
+
+    /* Write the current frame to the file (from the evaluator, at the
+     * end of each call), and sync it or have it synced. */
+    void commit();
+
+    /* Return the number of operations replayed by open. */
+    uint64_t replayed() const { return replayedCount; }
+
+private:
+
+    /* Replay the frames of a journal file. Returns the size of the
+     * valid part of the file (the header and the complete frames), or
+     * 0 if it does not start with a valid header. */
+    size_t replay(const char *begin, const char *end, Evaluator &evaluator);
+
+    /* Return the journal number of a register, adding a record with
+     * its name to the frame if it does not have one yet. */
+    uint32_t number(RegisterId reg);
+
+    /* Sync the file once per window, until stopped. */
+    void syncLoop();
+
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,381 @@
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LEXER_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEXER_AVX2 1
+#include <immintrin.h>
+#endif
+
+#include "lexer.h"
+
+namespace {
+
+// Character classes. The classes seen in a token are combined
+// with bitwise or, to decide what kind of token it is.
+const uint8_t S = 1;    // Whitespace
+const uint8_t D = 2;    // Digit
+const uint8_t L = 4;    // Lower case letter
+const uint8_t U = 8;    // Upper case letter
+const uint8_t O = 16;   // Anything else
+
+// The character class of every possible byte.
+// The whitespace characters are the ones separating tokens
+// when reading with 'operator>>' (space, \t, \n, \v, \f, \r).
+const uint8_t CHARACTER_CLASSES[256] = {
+    O, O, O, O, O, O, O, O, O, S, S, S, S, S, O, O,  // 0x00
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0x10
+    S, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0x20
+    D, D, D, D, D, D, D, D, D, D, O, O, O, O, O, O,  // 0x30
+    O, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,  // 0x40
+    U, U, U, U, U, U, U, U, U, U, U, O, O, O, O, O,  // 0x50
+    O, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,  // 0x60
+    L, L, L, L, L, L, L, L, L, L, L, O, O, O, O, O,  // 0x70
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0x80
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0x90
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0xa0
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0xb0
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0xc0
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0xd0
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0xe0
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,  // 0xf0
+};
+
+// The keyword table, indexed by the perfect hash
+//     (10 * length + first character) mod 32
+// which gives a distinct slot for each of the eight keywords.
+struct Keyword {
+    const char *text;
+    size_t length;
+    TokenKind kind;
+};
+
+const Keyword KEYWORDS[32] = {
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"print",    5, TOKEN_PRINT},
+    {"subtract", 8, TOKEN_SUBTRACT},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"explain",  7, TOKEN_EXPLAIN},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"",         0, TOKEN_REGISTER},
+    {"restore",  7, TOKEN_RESTORE},
+    {"quit",     4, TOKEN_QUIT},
+    {"",         0, TOKEN_REGISTER},
+    {"save",     4, TOKEN_SAVE},
+    {"",         0, TOKEN_REGISTER},
+    {"multiply", 8, TOKEN_MULTIPLY},
+    {"",         0, TOKEN_REGISTER},
+    {"add",      3, TOKEN_ADD},
+};
+
+inline uint8_t characterClass(char c) {
+    return CHARACTER_CLASSES[static_cast<unsigned char>(c)];
+}
+
+// The size of the blocks classified at once, which is the number of
+// bits of the masks.
+const size_t BLOCK = 64;
+
+/* Return the index of the lowest set bit (which must exist). */
+inline unsigned lowestBit(uint64_t bits) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+    unsigned index = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+/* Fold the upper case letters of a block, at the given bits. */
+void foldBlock(char *block, uint64_t bits) {
+    while (bits) {
+        block[lowestBit(bits)] += 'a' - 'A';
+        bits &= bits - 1;
+    }
+}
+
+/* Classify the 'length' bytes at 'block' with the table (the bits past
+ * the length are set as whitespace). */
+void scanScalar(const char *block, size_t length, uint64_t &spaces, uint64_t &letters, uint64_t &uppers,
+                uint64_t &others) {
+    spaces = length < BLOCK ? ~0ULL << length : 0;
+    letters = 0;
+    uppers = 0;
+    others = 0;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t cls = characterClass(block[i]);
+        uint64_t bit = 1ULL << i;
+        if (cls == S) spaces |= bit;
+        if (cls & (L | U)) letters |= bit;
+        if (cls == U) uppers |= bit;
+        if (cls == O) others |= bit;
+    }
+}
+
+#ifdef LEXER_SSE2
+/* Classify a block of 64 bytes, 16 at a time. The whitespace is the
+ * space and the range \t to \r (the comparisons are signed, so bytes
+ * from 0x80 are below all of the ranges, and count as others). */
+void scanSse2(const char *block, uint64_t &spaces, uint64_t &letters, uint64_t &uppers, uint64_t &others) {
+    spaces = 0;
+    letters = 0;
+    uppers = 0;
+    others = 0;
+    for (size_t i = 0; i < BLOCK; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                     _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('\t' - 1)),
+                                                   _mm_cmplt_epi8(bytes, _mm_set1_epi8('\r' + 1))));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)),
+                                      _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+        __m128i letter = _mm_or_si128(upper, _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('a' - 1)),
+                                                           _mm_cmplt_epi8(bytes, _mm_set1_epi8('z' + 1))));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+        uint64_t spaceBits = static_cast<uint16_t>(_mm_movemask_epi8(space));
+        uint64_t letterBits = static_cast<uint16_t>(_mm_movemask_epi8(letter));
+        uint64_t upperBits = static_cast<uint16_t>(_mm_movemask_epi8(upper));
+        uint64_t digitBits = static_cast<uint16_t>(_mm_movemask_epi8(digit));
+        spaces |= spaceBits << i;
+        letters |= letterBits << i;
+        uppers |= upperBits << i;
+        others |= (~(spaceBits | letterBits | digitBits) & 0xffff) << i;
+    }
+}
+#endif
+
+#ifdef LEXER_AVX2
+/* The same as scanSse2(), 32 bytes at a time. (AVX2 only has the
+ * greater than comparison, so the ranges are written with it.) */
+__attribute__((target("avx2")))
+void scanAvx2(const char *block, uint64_t &spaces, uint64_t &letters, uint64_t &uppers, uint64_t &others) {
+    spaces = 0;
+    letters = 0;
+    uppers = 0;
+    others = 0;
+    for (size_t i = 0; i < BLOCK; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + i));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                        _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('\t' - 1)),
+                                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), bytes)));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('A' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), bytes));
+        __m256i letter = _mm256_or_si256(upper,
+                                         _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('a' - 1)),
+                                                          _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), bytes)));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+        uint64_t spaceBits = static_cast<uint32_t>(_mm256_movemask_epi8(space));
+        uint64_t letterBits = static_cast<uint32_t>(_mm256_movemask_epi8(letter));
+        uint64_t upperBits = static_cast<uint32_t>(_mm256_movemask_epi8(upper));
+        uint64_t digitBits = static_cast<uint32_t>(_mm256_movemask_epi8(digit));
+        spaces |= spaceBits << i;
+        letters |= letterBits << i;
+        uppers |= upperBits << i;
+        others |= (~(spaceBits | letterBits | digitBits) & 0xffffffffULL) << i;
+    }
+}
+#endif
+
+}
+
+Lexer::Lexer(char *begin, char *end) : Lexer(begin, end, bestScanMode()) {
+}
+
+Lexer::Lexer(char *begin, char *end, ScanMode mode)
+    : cursor(begin), end(end), count(0), mode(supportsScanMode(mode) ? mode : SCAN_SCALAR),
+      blockBegin(begin), blockEnd(begin), spaces(0), letters(0), uppers(0), others(0) {
+}
+
+ScanMode Lexer::bestScanMode() {
+    // (The CPU is only asked once)
+    static const ScanMode best = supportsScanMode(SCAN_AVX2) ? SCAN_AVX2
+                               : supportsScanMode(SCAN_SSE2) ? SCAN_SSE2
+                               : SCAN_SCALAR;
+    return best;
+}
+
+bool Lexer::supportsScanMode(ScanMode mode) {
+    switch (mode) {
+        case SCAN_AVX2:
+#ifdef LEXER_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        case SCAN_SSE2:
+#ifdef LEXER_SSE2
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return true;
+    }
+}
+
+const char *Lexer::scanModeName(ScanMode mode) {
+    switch (mode) {
+        case SCAN_AVX2: return "avx2";
+        case SCAN_SSE2: return "sse2";
+        default:        return "scalar";
+    }
+}
+
+bool Lexer::next(Token &out) {
+    return mode == SCAN_SCALAR ? nextScalar(out, true) : nextBlock(out, true);
+}
+
+bool Lexer::nextVerbatim(Token &out) {
+    return mode == SCAN_SCALAR ? nextScalar(out, false) : nextBlock(out, false);
+}
+
+bool Lexer::nextScalar(Token &out, bool fold) {
+    // Skip the whitespace before the token
+    while (cursor != end && characterClass(*cursor) == S) {
+        ++cursor;
+    }
+    if (cursor == end) {
+        return false;
+    }
+
+    // Read the token until the next whitespace, folding upper case
+    // letters (if asked to), and collecting the classes of the
+    // characters.
+    char *start = cursor;
+    uint8_t seen = 0;
+    do {
+        uint8_t cls = characterClass(*cursor);
+        if (cls == S) break;
+        if (cls == U && fold) *cursor += 'a' - 'A';
+        seen |= cls;
+        ++cursor;
+    } while (cursor != end);
+
+    out.text = start;
+    out.length = static_cast<size_t>(cursor - start);
+
+    // Any character that is not alphanumeric makes the token invalid.
+    // Only digits makes it a number, and otherwise it is a word.
+    if (seen & O) {
+        out.kind = TOKEN_INVALID;
+    } else if (seen == D) {
+        out.kind = TOKEN_NUMBER;
+    } else {
+        out.kind = keyword(out.text, out.length);
+    }
+    ++count;
+    return true;
+}
+
+bool Lexer::nextBlock(Token &out, bool fold) {
+    // Skip the whitespace before the token, a block at a time
+    while (true) {
+        if (cursor == end) {
+            return false;
+        }
+        if (cursor == blockEnd) {
+            scanBlock();
+        }
+        uint64_t rest = ~spaces >> (cursor - blockBegin);
+        if (rest) {
+            cursor += lowestBit(rest);
+            break;
+        }
+        cursor = blockEnd;
+    }
+
+    // Find the whitespace after the token, collecting the letters and
+    // other characters of the token (which can go on into the next
+    // blocks, unless the block is the last one), and folding its upper
+    // case letters (if asked to).
+    char *start = cursor;
+    uint64_t seenLetters = 0;
+    uint64_t seenOthers = 0;
+    while (true) {
+        unsigned offset = static_cast<unsigned>(cursor - blockBegin);
+        uint64_t stop = spaces >> offset;
+        size_t length = stop ? lowestBit(stop) : static_cast<size_t>(blockEnd - cursor);
+        uint64_t range = (length == BLOCK ? ~0ULL : (1ULL << length) - 1) << offset;
+        seenLetters |= letters & range;
+        seenOthers |= others & range;
+        if (fold && (uppers & range)) {
+            foldBlock(blockBegin, uppers & range);
+        }
+        cursor += length;
+        if (stop || cursor == end) {
+            break;
+        }
+        scanBlock();
+    }
+
+    out.text = start;
+    out.length = static_cast<size_t>(cursor - start);
+    if (seenOthers) {
+        out.kind = TOKEN_INVALID;
+    } else if (!seenLetters) {
+        out.kind = TOKEN_NUMBER;
+    } else {
+        out.kind = keyword(out.text, out.length);
+    }
+    ++count;
+    return true;
+}
+
+void Lexer::scanBlock() {
+    blockBegin = cursor;
+    size_t left = static_cast<size_t>(end - cursor);
+    if (left < BLOCK) {
+        blockEnd = end;
+        scanScalar(cursor, left, spaces, letters, uppers, others);
+        return;
+    }
+    blockEnd = cursor + BLOCK;
+    switch (mode) {
+#ifdef LEXER_AVX2
+        case SCAN_AVX2:
+            scanAvx2(cursor, spaces, letters, uppers, others);
+            break;
+#endif
+#ifdef LEXER_SSE2
+        case SCAN_SSE2:
+            scanSse2(cursor, spaces, letters, uppers, others);
+            break;
+#endif
+        default:
+            scanScalar(cursor, BLOCK, spaces, letters, uppers, others);
+            break;
+    }
+}
+
+TokenKind Lexer::keyword(const char *text, size_t length) {
+    // Look up the only keyword the token could be, and compare it.
+    const Keyword &candidate = KEYWORDS[(10 * length + static_cast<unsigned char>(text[0])) & 31];
+    if (candidate.length == length && std::memcmp(candidate.text, text, length) == 0) {
+        return candidate.kind;
+    }
+    return TOKEN_REGISTER;
+}
@@ -0,0 +1,136 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * This file contains the lexer, which splits the input into tokens
+ * and identifies what kind of token each one is.
+ *
+ * The supported tokens are:
+ *  > The operand keywords: "add", "subtract", "multiply", "print", "explain",
+ *    "save", "restore", "quit".
+ *  > Registers: strings containing alphanumeric symbols (with at least one letter symbol)
+ *  > Numbers: strings containing only digits
+ * Tokens are separated by whitespace (spaces, tabs and line breaks).
+ * Anything else is an invalid token. The syntax is case insensitive.
+ *
+ * The lexer works on a character buffer, and makes a single pass
+ * over each token. Every character is looked up in a 256-entry
+ * character class table, which tells if it is whitespace, a digit,
+ * a letter or something else. The classes seen in a token decide
+ * what kind of token it is, and upper case letters are folded to
+ * lower case in the same pass. The folding is done in place in the
+ * buffer, so the tokens are simply views into the buffer, and no
+ * strings are created while lexing. Only the tokens read are folded,
+ * and a token can also be read as it is (for a file name, which must
+ * keep its case).
+ *   The keywords are recognized with a perfect hash on the token
+ * length and first character, followed by a single comparison.
+ *
+ * # Block scanning
+ * On CPUs with vector instructions (SSE2 or AVX2, chosen at run time),
+ * the input is not read a byte at a time: it is classified in blocks
+ * of 64 bytes, giving bit masks of the whitespace, letters and other
+ * characters of the block, and a bit mask of its upper case letters,
+ * with which each token is folded when it is read (most tokens have
+ * none, and take no work at all). Token boundaries are then found with
+ * bit scans on the masks, and the kind of a token from the masks of
+ * its bytes, so most tokens take a few instructions. (The last bytes
+ * of the buffer, which do not fill a block, are classified with the
+ * table.) The tokens are exactly the same in all the scan modes.
+ */
+
+/* The ways of scanning the input: a byte at a time, or in blocks
+ * with SSE2 or AVX2 instructions. */
+enum ScanMode {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+
+/* The different kinds of tokens. */
+enum TokenKind {TOKEN_QUIT, TOKEN_PRINT, TOKEN_ADD, TOKEN_SUBTRACT, TOKEN_MULTIPLY,
+                TOKEN_NUMBER, TOKEN_REGISTER, TOKEN_INVALID, TOKEN_EXPLAIN, TOKEN_SAVE,
+                TOKEN_RESTORE};
+
+/* A token is a view into the lexed buffer (already folded to lower
+ * case, unless it was read verbatim), together with its kind. */
+struct Token {
+    TokenKind kind;
+    const char *text;
+    size_t length;
+
+    /* Return a copy of the token text. */
+    std::string str() const { return std::string(text, length); }
+};
+
+class Lexer {
+
+private:
+
+    // The part of the buffer that is left to lex
+    char *cursor;
+    char *end;
+
+    // Number of tokens read so far
+    size_t count;
+
+    // The scan mode, and (when scanning in blocks) the block that the
+    // cursor is in, with the masks of its whitespace, letters (of
+    // either case), upper case letters and other characters (bit i is
+    // the byte at blockBegin + i).
+    ScanMode mode;
+    char *blockBegin;
+    char *blockEnd;
+    uint64_t spaces;
+    uint64_t letters;
+    uint64_t uppers;
+    uint64_t others;
+
+public:
+
+    /* Create a lexer for the characters in [begin, end), scanning
+     * them in the best mode the CPU supports (or in the given mode,
+     * if the CPU supports it, and otherwise a byte at a time).
+     * Upper case letters in the buffer are folded to lower case in
+     * place, as the tokens are read. */
+    Lexer(char *begin, char *end);
+    Lexer(char *begin, char *end, ScanMode mode);
+
+    /* Return the best scan mode of this CPU, and whether a mode
+     * can be used on it. */
+    static ScanMode bestScanMode();
+    static bool supportsScanMode(ScanMode mode);
+
+    /* Return the name of a scan mode ("scalar", "sse2" or "avx2"). */
+    static const char *scanModeName(ScanMode mode);
+
+    /* Read the next token, and return true if successful,
+     * otherwise (at the end of the buffer) return false. */
+    bool next(Token &out);
+
+    /* Read the next token like next(), but without folding it: its
+     * text is exactly as in the input. */
+    bool nextVerbatim(Token &out);
+
+    /* Return where in the buffer the lexer is. */
+    char *position() const { return cursor; }
+
+    /* Return the number of tokens read so far. */
+    size_t tokens() const { return count; }
+
+private:
+
+    /* Read the next token a byte at a time, or from the block masks. */
+    bool nextScalar(Token &out, bool fold);
+    bool nextBlock(Token &out, bool fold);
+
+    /* Classify the block starting at the cursor. */
+    void scanBlock();
+
+    /* Return the kind of an alphanumeric token containing
+     * at least one letter: a keyword or a register. */
+    static TokenKind keyword(const char *text, size_t length);
+
+};
+
+#endif // LEXER_H
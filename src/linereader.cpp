@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "linereader.h"
+#include "stats.h"
+
+const size_t LineReader::BLOCK;
+
+LineReader::LineReader(int descriptor) : descriptor(descriptor), start(0), filled(0), ended(false) {
+}
+
+bool LineReader::next(char *&begin, char *&end) {
+    // Move the start of an incomplete line to the front
+    if (start > 0) {
+        std::memmove(buffer.data(), buffer.data() + start, filled - start);
+        filled -= start;
+        start = 0;
+    }
+
+    while (!ended) {
+        // (The buffer is allocated by the first read, and a line longer
+        // than the buffer makes it grow)
+        if (buffer.size() - filled < BLOCK / 2) {
+            buffer.resize(std::max(BLOCK, buffer.size() * 2));
+        }
+        ssize_t count;
+        {
+            Stats::Timer timer(Stats::READ_TIME);
+#ifndef _WIN32
+            count = ::read(descriptor, buffer.data() + filled, buffer.size() - filled);
+#else
+            count = 0;
+#endif
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            ended = true;
+            break;
+        }
+
+        // Return the lines up to the last line break, if any
+        size_t searched = filled;
+        filled += static_cast<size_t>(count);
+        for (size_t i = filled; i > searched; --i) {
+            if (buffer[i - 1] == '\n') {
+                begin = buffer.data();
+                end = buffer.data() + i;
+                start = i;
+                return true;
+            }
+        }
+    }
+
+    // At the end, the last line may not have a line break
+    if (filled > 0) {
+        begin = buffer.data();
+        end = buffer.data() + filled;
+        start = filled;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,54 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * This class reads lines from a file descriptor (standard input, when
+ * it is a pipe or a file rather than a terminal) in large blocks, with
+ * read(2), instead of a line at a time through a stream.
+ *
+ * Each call of next() returns a batch of complete lines: everything
+ * that one read returned, up to its last line break. The start of a
+ * line that is not complete yet is kept, and returned with the rest of
+ * the line by a later call. Since a read returns as soon as any data
+ * is available, a program that writes a line and waits for its output
+ * still gets it at once, while a generated file piped in is read in
+ * blocks of a megabyte. At the end of the input, a last line without a
+ * line break is returned as well, and then next() returns false.
+ *
+ * Lines are only read with this class on POSIX systems; elsewhere the
+ * console is read a line at a time.
+ */
+class LineReader {
+
+private:
+
+    // Size of the blocks read at a time
+    static const size_t BLOCK = 1 << 20;
+
+    // Where the lines are read from
+    int descriptor;
+
+    // The characters read; [start, filled) have not been returned yet
+    std::vector<char> buffer;
+    size_t start;
+    size_t filled;
+
+    // Whether the end of the input (or an error) has been reached
+    bool ended;
+
+public:
+
+    /* Create a reader for the given file descriptor. */
+    explicit LineReader(int descriptor);
+
+    /* Read the next batch of complete lines, as the characters in
+     * [begin, end) (which stay valid until the next call). Returns
+     * false at the end of the input. */
+    bool next(char *&begin, char *&end);
+
+};
+
+#endif // LINEREADER_H
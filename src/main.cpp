@@ -1,8 +1,27 @@
+#include <algorithm>
+#include <cctype>
 #include <iostream>
-#include <fstream>
+#include <thread>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "batch.h"
+#include "columnar.h"
 #include "parser.h"
 #include "evaluator.h"
+#include "journal.h"
+#include "linereader.h"
+#include "mappedfile.h"
+#include "native.h"
+#include "options.h"
+#include "output.h"
+#include "parallelparser.h"
+#include "pipeline.h"
+#include "server.h"
+#include "snapshot.h"
+#include "stats.h"
 
 /* 
  * This is the main file for the calculator, which handles
@@ -34,6 +53,9 @@
  * Common definitions, about how tokens are defined,
  * and how instructions are defined and stored are
  * defined in a seaprate header, "definitions.h".
+ * The register names are interned into integer ids by
+ * the parser, in a symbols object ("symbols.h") that is
+ * shared with the evaluator.
  * 
  * 
  * # Syntax
@@ -42,11 +64,61 @@
  * will be treated as an input file. If no argument
  * is given, the input will be taken from the
  * console instead. (If the file could not be read,
- * the program will exit.)
+ * the program will exit.) When the console input is
+ * piped in rather than typed, it is read in large
+ * blocks of lines ("linereader.h"), but each line is
+ * still parsed on its own. The program quits at the
+ * end of the input.
+ *   Input files are mapped into memory ("mappedfile.h")
+ * and lexed in place, so the tokens are views into
+ * the mapping and no strings are copied per token.
+ *   Arguments starting with "--" are options (see
+ * "options.h"), for example '--threads 8' to evaluate
+ * large registers in parallel on eight threads, or
+ * '--stats' to report runtime statistics ("stats.h").
+ * A large input file can be parsed on several threads
+ * ('--parse-threads 8'), in chunks ("parallelparser.h").
+ *   If several input files are given (or a manifest
+ * listing them, with '--manifest'), they are run in
+ * batch mode ("batch.h"): each file on its own, as if
+ * the calculator was run on each of them in turn, but
+ * spread over all cores in one process.
+ *   The output is buffered ("output.h"), and written out
+ * after every line on a terminal, and otherwise in large
+ * blocks (which '--flush' changes), and it can be written
+ * on a background thread ('--async-output').
+ *   The registers can be saved to a snapshot file when
+ * the calculator is done ('--save-snapshot'), and a later
+ * run can start from them ('--load-snapshot'), instead of
+ * replaying all of the input again ("snapshot.h"). The
+ * input can do the same with 'save' and 'restore'.
+ * With '--journal <file>', every operation is also
+ * appended to a journal as it is executed, and a later
+ * run with the same journal starts by replaying it,
+ * even after a crash ("journal.h").
+ *   With '--serve <path>', the calculator runs as a
+ * server on a Unix domain socket instead ("server.h"),
+ * where every connection is a session of its own, that
+ * sends lines and gets their output back, until it
+ * quits (or the server is stopped with SIGINT/SIGTERM).
+ * With '--shared', the sessions share their registers
+ * ("shared.h").
+ *   With '--columns <file>', the program in the input
+ * file is run once for every row of a table of seed
+ * values, all rows at once ("columnar.h"), and the
+ * output is a table with a column per print. With
+ * '--native <library>', the program is compiled to
+ * native code for that ("native.h").
+ *   'explain <register>' reports what printing the
+ * register involves: how many registers it depends on,
+ * how deep, and how much work it takes ("explain.h").
+ * '--explain <register>' does the same when the input
+ * is done, and '--explain-dot <file>' also writes the
+ * dependency graph to a file, for Graphviz.
  * 
- * The calculator can handle three types of input:
+ * The calculator can handle four types of input:
  * arithmetic operations on a register, printing a
- * register, and quitting.
+ * register, explaining a register, and quitting.
  *   The syntax for the arithemtic operations is
  * as follows:
  *       <register> <operation> <value>
@@ -76,11 +148,17 @@
  *       b add 1
  *       print a
  * 
+ * The output, and the error messages, are printed in the
+ * order of the input. (A syntax error in the middle of a
+ * file is reported between the output of the instructions
+ * before it and after it. Earlier versions parsed the whole
+ * file before running it, so its syntax errors came first.)
+ * 
  * When the input is taken from the user via the concole,
  * it is read one line at the time. This means that each
  * operation has to be finished by the end of the line.
  * This is not the case when reading from file (the whole
- * file is read in one go, so it does not matter where
+ * file is parsed as one stream, so it does not matter where
  * there are line breaks).
  *   So you can't for example type:
  *       print
@@ -96,31 +174,173 @@
  */
 int main(int argc, char *argv[]) {
 
+    // Read the command line options
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        return 0;
+    }
+    if (options.stats) {
+        Stats::enable(options.statsJson ? Stats::JSON : Stats::TEXT);
+    }
+
+    // Everything written to the console goes through the output, in order
+    Output &output = Output::console();
+    output.setPolicy(options.flush, std::chrono::milliseconds(options.flushMilliseconds));
+    if (options.asyncOutput) {
+        output.startWriter();
+    }
+
+    // Serve sessions on a socket, until stopped
+    if (!options.serve.empty()) {
+        Server server(options.serve, options.shared);
+        if (server.listen()) {
+            output << "Listening on socket: " << options.serve << '\n';
+            output.sync();
+            server.run();
+        }
+        output.sync();
+        Stats::reportAtExit();
+        return 0;
+    }
+
+    // Run the program once per row of a seed table
+    if (!options.columns.empty()) {
+        if (options.filenames.size() != 1) {
+            output << "Option '--columns' needs one input file, with the program." << '\n';
+            output.sync();
+            return 0;
+        }
+        Seeds seeds;
+        std::string error;
+        if (!seeds.read(options.columns, error)) {
+            output << "Could not read columns: " << options.columns << " (" << error << ")" << '\n';
+            output.sync();
+            return 0;
+        }
+        MappedFile file;
+        if (!file.open(options.filenames.front())) {
+            output << "Could not open file: " << options.filenames.front() << '\n';
+            output.sync();
+            return 0;
+        }
+        Symbols symbols;
+        std::vector<RegisterId> seedRegisters;
+        for (const std::string &name : seeds.names) {
+            seedRegisters.push_back(symbols.intern(name));
+        }
+        Instructions instructions;
+        Parser(symbols).parse(instructions, file.begin(), file.end());
+        Columnar columnar(symbols, output);
+        columnar.compile(instructions, seedRegisters);
+
+        // Run the rows through native code, if it can be built
+        NativeLibrary library;
+        if (!options.native.empty()) {
+            std::string source;
+            if (!columnar.emit(source)) {
+                std::cerr << "Native code is not used: the program has literals over 64 bits." << std::endl;
+            } else if (!library.load(options.native, source, error)) {
+                std::cerr << "Native code is not available (" << error << "), running without it." << std::endl;
+            } else {
+                columnar.setNative(library.function());
+            }
+        }
+        columnar.run(seeds);
+        output.sync();
+        Stats::reportAtExit();
+        return 0;
+    }
+
+    if (!options.native.empty()) {
+        output << "Option '--native' is only used with '--columns'." << '\n';
+        output.sync();
+        return 0;
+    }
+
+    // Run several files in batch mode
+    if (options.filenames.size() > 1 || !options.manifest.empty()) {
+        std::vector<std::string> filenames = options.filenames;
+        if (!options.manifest.empty() && !Batch::readManifest(options.manifest, filenames)) {
+            output << "Could not open manifest: " << options.manifest << '\n';
+            output.sync();
+            return 0;
+        }
+        unsigned jobs = options.jobs;
+        if (jobs == 0) {
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        Batch batch(filenames, options.outputDir);
+        batch.run(jobs);
+        output.sync();
+        batch.summary(std::cerr);
+        Stats::reportAtExit();
+        return 0;
+    }
+
+    // Interned register names, shared by the parser and the evaluator
+    Symbols symbols;
+
     // Class for parsing instructions from the command line
-    Parser parser;
+    Parser parser(symbols);
 
     // Class for evaluating loaded instructions
-    Evaluator evaluator;
+    Evaluator evaluator(symbols);
+    evaluator.setThreads(options.threads);
+    if (!options.explainDot.empty()) {
+        evaluator.setExplainGraph(options.explainDot);
+    }
+
+    // Start from the registers of an earlier session
+    if (!options.loadSnapshot.empty() && !Snapshot::load(options.loadSnapshot, symbols, evaluator)) {
+        output << "Could not load snapshot: " << options.loadSnapshot << '\n';
+        output.sync();
+        return 0;
+    }
+
+    // Replay the journal of earlier sessions, and keep adding to it
+    std::unique_ptr<Journal> journal;
+    if (!options.journal.empty()) {
+        journal.reset(new Journal(symbols));
+        std::string error;
+        if (!journal->open(options.journal, evaluator, std::chrono::milliseconds(options.journalWindow), error)) {
+            output << "Could not open journal: " << options.journal << " (" << error << ")" << '\n';
+            output.sync();
+            return 0;
+        }
+        evaluator.setJournal(*journal);
+    }
 
     // List of stored instructions, passed from the parser to the evaluator
     Instructions instructions;
 
     // Determine if there was any input file passed to the calculator
-    // The first argument is the name of the executable
-    // If there are any passed argument it 
-    bool readFromFile = (argc >= 2);
-    std::ifstream filestream;
+    bool readFromFile = !options.filenames.empty();
+    MappedFile file;
     if (readFromFile) {
-        std::string filename = argv[1];
-        filestream.open(filename);
+        std::string filename = options.filenames.front();
         // If the file could not be opened, exit the program
-        if (filestream.fail()) {
-            std::cout << "Could not open file: " << filename << std::endl;
+        bool opened;
+        {
+            Stats::Timer timer(Stats::READ_TIME);
+            opened = file.open(filename);
+        }
+        if (!opened) {
+            output << "Could not open file: " << filename << '\n';
+            output.sync();
             return 0;
         }
-        std::cout << "Reading from file: " << filename << std::endl;
+        output << "Reading from file: " << filename << '\n';
     }
 
+    // Input that is piped in (or redirected from a file) is read in
+    // blocks of lines, rather than a line at a time as from a terminal
+    // (see "linereader.h")
+    bool readBlocks = false;
+#ifndef _WIN32
+    readBlocks = !readFromFile && !isatty(STDIN_FILENO);
+#endif
+    LineReader lines(0);  // (Standard input)
+
     // Start a loop for reading the input lines
     // A flag signifying when
     bool running = true;
@@ -129,27 +349,84 @@ int main(int argc, char *argv[]) {
         // Parse the input
         // Read from file or from the console
         if (readFromFile) {
-            // Read the whole file, and parse it.
+            // Parse and execute the whole file, as a pipeline
+            // (see "pipeline.h"), so that the instructions are
+            // executed while the rest of the file is parsed.
             // Since the program should quit after reading
             // the file, the running-flag is set to false.
-            parser.parse(instructions, filestream);
+            // With several parse threads, the file is parsed in
+            // windows of a chunk per thread instead (see
+            // "parallelparser.h"), each executed when it is parsed.
+            if (options.parseThreads > 1) {
+                ParallelParser parallel(symbols, options.parseThreads);
+                char *at = file.begin();
+                bool more = true;
+                while (more && at < file.end()) {
+                    at = parallel.parse(instructions, at, file.end());
+                    more = evaluator.execute(instructions);
+                    Stats::poll();
+                }
+            } else {
+                Pipeline(parser, evaluator).run(file.begin(), file.end());
+            }
             running = false;
+        } else if (readBlocks) {
+            // Parse a block of lines, each line on its own (as if
+            // they were typed in one by one), until the input ends.
+            output.sync();
+            char *begin;
+            char *end;
+            if (lines.next(begin, end)) {
+                parser.parseLines(instructions, begin, end);
+            } else {
+                running = false;
+            }
         } else {
             // Read a line from console, and parse it.
             // We cannot send std::cin straight to the parser since std::cin waits
             // for more input. We want to evaluate the instructions after each line.
             // Since we want to read tokens from this line, we need it as a stream.
+            // (Whatever the flush policy, all output is written out before
+            // waiting for the user. At the end of the input, the program
+            // quits.)
+            output.sync();
             std::string line;
-            std::getline(std::cin, line);
-            std::istringstream inputstream(line);
-            parser.parse(instructions, inputstream);
+            if (std::getline(std::cin, line)) {
+                std::istringstream inputstream(line);
+                parser.parse(instructions, inputstream);
+            } else {
+                running = false;
+            }
         }
 
         // Execute the parsed instructions
         // If the running flag is already set to false, it should remain false
         running &= evaluator.execute(instructions);
+        Stats::poll();
+    }
+
+    // Explain a register of the session (named as it would be typed,
+    // so in any case; a name the session has not seen is not interned)
+    if (!options.explain.empty()) {
+        std::string name = options.explain;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        RegisterId reg;
+        if (symbols.find(name, reg)) {
+            Instruction explain = {EXPLAIN, REFERENCE, reg, 0};
+            instructions.push(explain);
+            evaluator.execute(instructions);
+        } else {
+            output << "Lookup Error: No register named '" << name << "'." << '\n';
+        }
+    }
+
+    // Save the registers for a later session
+    if (!options.saveSnapshot.empty() && !Snapshot::save(options.saveSnapshot, symbols, evaluator)) {
+        output << "Could not save snapshot: " << options.saveSnapshot << '\n';
     }
 
+    output.sync();
+    Stats::reportAtExit();
     return 0;
 }
 
@@ -0,0 +1,72 @@
+#include <fstream>
+#include <iterator>
+
+#include "mappedfile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile() : data(nullptr), length(0), mapped(false) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string &filename) {
+    close();
+
+#ifndef _WIN32
+    // Map the whole file. The descriptor is not needed once
+    // the mapping exists.
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(status.st_size);
+    if (length > 0 && S_ISREG(status.st_mode)) {
+        void *mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // The file is read front to back, once
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            data = static_cast<char *>(mapping);
+            mapped = true;
+            ::close(fd);
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+
+    // Fall back to reading the file into the buffer
+    // (empty files, pipes, or no mmap available).
+    std::ifstream filestream(filename, std::ios::binary);
+    if (filestream.fail()) {
+        return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(filestream), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    length = buffer.size();
+    return true;
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(data, length);
+    }
+#endif
+    mapped = false;
+    data = nullptr;
+    length = 0;
+    buffer.clear();
+}
@@ -0,0 +1,60 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/*
+ * This class maps an input file into memory, so that it can be
+ * lexed and parsed in place, without reading it through a stream.
+ *
+ * The file is mapped privately and writable: the lexer folds upper
+ * case letters in place, and with a private mapping those writes
+ * only touch copy-on-write pages of this process, never the file.
+ * Pages without any upper case letters are never copied, so the
+ * tokens are views straight into the page cache.
+ *   On platforms without mmap, the file is read into a buffer
+ * instead, which behaves the same (but costs a copy).
+ */
+class MappedFile {
+
+private:
+
+    // The mapped (or read) characters of the file
+    char *data;
+    size_t length;
+
+    // Whether the data is a mapping that has to be unmapped
+    bool mapped;
+
+    // Buffer used when the file could not be mapped
+    std::vector<char> buffer;
+
+public:
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /* Map the file with the given name. Returns false if the
+     * file could not be opened. */
+    bool open(const std::string &filename);
+
+    /* The mapped characters, as the range [begin, end). */
+    char *begin() { return data; }
+    char *end() { return data + length; }
+
+    /* Return the size of the file. */
+    size_t size() const { return length; }
+
+private:
+
+    /* Release the current mapping, if any. */
+    void close();
+
+};
+
+#endif // MAPPEDFILE_H
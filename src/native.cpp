@@ -0,0 +1,164 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "native.h"
+
+namespace {
+
+/* Return the fingerprint of a source (a 64-bit FNV-1a hash of its
+ * text, in hexadecimal). */
+std::string fingerprint(const std::string &source) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : source) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+}
+
+/* Return the fingerprint in the given file (empty if it cannot be
+ * read). */
+std::string readFingerprint(const std::string &path) {
+    std::ifstream in(path);
+    std::string text;
+    in >> text;
+    return text;
+}
+
+#ifndef _WIN32
+/* Run the compiler on a source file, writing the library to the given
+ * path. Returns false if there is no compiler, or it failed. (The
+ * compiler writes its errors to stderr.) */
+bool compile(const std::string &source, const std::string &library, std::string &error) {
+    const char *compiler = std::getenv("CXX");
+    if (!compiler || !*compiler) {
+        compiler = "g++";
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        error = "could not start the compiler";
+        return false;
+    }
+    if (child == 0) {
+        execlp(compiler, compiler, "-O2", "-shared", "-fPIC", "-o", library.c_str(), source.c_str(),
+               static_cast<char *>(nullptr));
+        _exit(127);
+    }
+    int status;
+    while (waitpid(child, &status, 0) < 0) {
+        if (errno != EINTR) {
+            error = "could not wait for the compiler";
+            return false;
+        }
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        error = std::string("there is no compiler named ") + compiler;
+        return false;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        error = std::string("the compiler ") + compiler + " failed";
+        return false;
+    }
+    return true;
+}
+#endif
+
+}
+
+NativeLibrary::NativeLibrary() : handle(nullptr), row(nullptr) {
+}
+
+NativeLibrary::~NativeLibrary() {
+    close();
+}
+
+bool NativeLibrary::load(const std::string &path, const std::string &source, std::string &error) {
+#ifndef _WIN32
+    // (dlopen only searches the library path for names without a slash)
+    std::string library = path.find('/') == std::string::npos ? "./" + path : path;
+    std::string print = fingerprint(source);
+    std::string printPath = path + ".fingerprint";
+    if (readFingerprint(printPath) == print && open(library, print)) {
+        return true;
+    }
+
+    // Write the source, with the fingerprint, and compile it (the old
+    // fingerprint goes first, so that it never stands for a library it
+    // does not belong to)
+    std::remove(printPath.c_str());
+    std::string sourcePath = path + ".cpp";
+    {
+        std::ofstream out(sourcePath);
+        out << source << "\nextern \"C\" const char regcalc_fingerprint[] = \"" << print << "\";\n";
+        if (!out) {
+            error = "could not write " + sourcePath;
+            return false;
+        }
+    }
+    std::string temporary = path + ".tmp";
+    if (!compile(sourcePath, temporary, error)) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = "could not write " + path;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (!open(library, print)) {
+        error = "could not load " + path;
+        return false;
+    }
+    {
+        std::ofstream out(printPath);
+        out << print << '\n';
+    }
+    return true;
+#else
+    (void) path;
+    (void) source;
+    error = "shared libraries are not supported on this platform";
+    return false;
+#endif
+}
+
+bool NativeLibrary::open(const std::string &path, const std::string &fingerprint) {
+    close();
+#ifndef _WIN32
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        return false;
+    }
+    const char *found = static_cast<const char *>(dlsym(handle, "regcalc_fingerprint"));
+    row = reinterpret_cast<NativeRow>(dlsym(handle, "regcalc_row"));
+    if (!found || !row || fingerprint != found) {
+        close();
+        return false;
+    }
+    return true;
+#else
+    (void) path;
+    (void) fingerprint;
+    return false;
+#endif
+}
+
+void NativeLibrary::close() {
+#ifndef _WIN32
+    if (handle) {
+        dlclose(handle);
+    }
+#endif
+    handle = nullptr;
+    row = nullptr;
+}
@@ -0,0 +1,66 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <string>
+
+#include "columnar.h"
+
+/*
+ * This class compiles a program written as C++ (see Columnar::emit)
+ * into a shared library, with the local compiler, and loads it, for
+ * '--native <library>' in columnar mode.
+ *
+ * The library is kept, so that later runs of the same program load it
+ * without compiling it again: the source gets a fingerprint (a hash of
+ * its text), which is written next to the library (as
+ * '<library>.fingerprint'), and a library is only reused if that file
+ * holds the fingerprint of the program. The file is checked before
+ * the library is loaded, so a stale (or foreign) library is never
+ * loaded, which would run its constructors; the fingerprint the
+ * library exports is checked as well, once it is. Otherwise the source is
+ * written next to the library (as '<library>.cpp'), and compiled with
+ * the compiler named by the CXX environment variable (g++ by default)
+ * into a temporary file, which then replaces the library at once, so
+ * that a run never loads a library that is only partly written.
+ *
+ * Loading fails, with a description of the problem, if there is no
+ * compiler, if the compiler fails, or on platforms without shared
+ * libraries; the calculator then runs the program with the kernels of
+ * the columnar mode instead, with exactly the same output.
+ */
+class NativeLibrary {
+
+private:
+
+    // Handle of the loaded library (null if none), and its function
+    void *handle;
+    NativeRow row;
+
+public:
+
+    NativeLibrary();
+    ~NativeLibrary();
+
+    NativeLibrary(const NativeLibrary &) = delete;
+    NativeLibrary &operator=(const NativeLibrary &) = delete;
+
+    /* Load the library at the given path, built from the given source,
+     * compiling it first unless it is up to date. Returns false, with
+     * a description of the problem in 'error', if it is not available. */
+    bool load(const std::string &path, const std::string &source, std::string &error);
+
+    /* Return the function of the loaded library (null if none). */
+    NativeRow function() const { return row; }
+
+private:
+
+    /* Open the library at the given path, if it has the given
+     * fingerprint. */
+    bool open(const std::string &path, const std::string &fingerprint);
+
+    /* Close the library (if one is open). */
+    void close();
+
+};
+
+#endif // NATIVE_H
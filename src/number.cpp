@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <utility>
+
+#include "number.h"
+
+namespace {
+
+#ifdef HAVE_INT128
+/* Checked 128-bit arithmetic, as for 64 bits (see "number.h"). */
+bool checkedApply(Operand op, Int128 a, Int128 b, Int128 &out) {
+    switch (op) {
+        case SUBTRACT: return !__builtin_sub_overflow(a, b, &out);
+        case MULTIPLY: return !__builtin_mul_overflow(a, b, &out);
+        default:       return !__builtin_add_overflow(a, b, &out);
+    }
+}
+
+/* Return a 128-bit integer in decimal. */
+std::string wideString(Int128 value) {
+    typedef unsigned __int128 UInt128;
+    UInt128 magnitude = value < 0 ? 0 - static_cast<UInt128>(value) : static_cast<UInt128>(value);
+    std::string digits;
+    do {
+        digits += static_cast<char>('0' + static_cast<int>(magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        digits += '-';
+    }
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+#endif
+
+}
+
+Number::Number(const Number &other) : tier(other.tier), small(other.small) {
+#ifdef HAVE_INT128
+    wide = other.wide;
+#endif
+    if (other.big) {
+        big.reset(new BigInt(*other.big));
+    }
+}
+
+Number &Number::operator=(const Number &other) {
+    if (this != &other) {
+        tier = other.tier;
+        small = other.small;
+#ifdef HAVE_INT128
+        wide = other.wide;
+#endif
+        big.reset(other.big ? new BigInt(*other.big) : nullptr);
+    }
+    return *this;
+}
+
+bool Number::parse(const char *text, size_t length, Number &out) {
+    bool negative = length > 0 && text[0] == '-';
+    BigInt value;
+    if (!BigInt::parse(text + negative, length - negative, value)) {
+        return false;
+    }
+    out.setBig(negative ? BigInt() - value : std::move(value));
+    return true;
+}
+
+void Number::apply(Operand op, const Number &value) {
+    // Both small: 64-bit arithmetic, unless it overflows
+    if (tier == SMALL && value.tier == SMALL) {
+        int64_t result;
+        bool fits;
+        switch (op) {
+            case SUBTRACT: fits = checkedSubtract(small, value.small, result); break;
+            case MULTIPLY: fits = checkedMultiply(small, value.small, result); break;
+            default:       fits = checkedAdd(small, value.small, result); break;
+        }
+        if (fits) {
+            small = result;
+            return;
+        }
+    }
+#ifdef HAVE_INT128
+    // Neither big: 128-bit arithmetic, unless it overflows
+    if (tier != BIG && value.tier != BIG) {
+        Int128 result;
+        if (checkedApply(op, toWide(), value.toWide(), result)) {
+            setWide(result);
+            return;
+        }
+    }
+#endif
+    // Arbitrary precision. A sum on a big number is done in place
+    // (the usual case of a big value that keeps growing), and
+    // otherwise big operands are used as they are, and only the
+    // smaller ones are converted.
+    BigInt convertedA, convertedB;
+    const BigInt &b = value.tier == BIG ? *value.big : (convertedB = value.toBig());
+    if (tier == BIG && op != MULTIPLY) {
+        if (op == SUBTRACT) {
+            *big -= b;
+        } else {
+            *big += b;
+        }
+        setBig(std::move(*big));
+        return;
+    }
+    const BigInt &a = tier == BIG ? *big : (convertedA = toBig());
+    BigInt result;
+    switch (op) {
+        case SUBTRACT: result = a - b; break;
+        case MULTIPLY: result = a * b; break;
+        default:       result = a + b; break;
+    }
+    setBig(std::move(result));
+}
+
+#ifdef HAVE_INT128
+void Number::setWide(Int128 value) {
+    big.reset();
+    if (value >= INT64_MIN && value <= INT64_MAX) {
+        tier = SMALL;
+        small = static_cast<int64_t>(value);
+    } else {
+        tier = WIDE;
+        wide = value;
+    }
+}
+#endif
+
+void Number::setBig(BigInt &&value) {
+    // (The value can be the big number of this one, so it is read
+    // before that is released)
+    if (value.fitsInt64()) {
+        small = value.toInt64();
+        tier = SMALL;
+        big.reset();
+        return;
+    }
+#ifdef HAVE_INT128
+    if (value.fitsInt128()) {
+        setWide(value.toInt128());
+        return;
+    }
+#endif
+    tier = BIG;
+    if (!big) {
+        big.reset(new BigInt(std::move(value)));
+    } else if (big.get() != &value) {
+        *big = std::move(value);
+    }
+}
+
+BigInt Number::toBig() const {
+    switch (tier) {
+        case BIG:
+            return *big;
+#ifdef HAVE_INT128
+        case WIDE:
+            return BigInt(wide);
+#endif
+        default:
+            return BigInt(small);
+    }
+}
+
+std::string Number::str() const {
+    switch (tier) {
+        case BIG:
+            return big->str();
+#ifdef HAVE_INT128
+        case WIDE:
+            return wideString(wide);
+#endif
+        default:
+            return std::to_string(small);
+    }
+}
+
+std::ostream &operator<<(std::ostream &out, const Number &number) {
+    if (number.isSmall()) {
+        return out << number.toSmall();
+    }
+    return out << number.str();
+}
@@ -0,0 +1,140 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "bigint.h"
+#include "definitions.h"
+
+/*
+ * This file contains the numbers of the calculator, which are exact
+ * integers of any size.
+ *
+ * Almost all values fit in 64 bits, so the numbers are built to make
+ * that case fast, and only pay for more precision when a value needs
+ * it. A number is stored in one of three tiers:
+ *  > SMALL:  a 64-bit integer.
+ *  > WIDE:   a 128-bit integer (with compilers that have them).
+ *  > BIG:    an arbitrary precision integer (see "bigint.h").
+ * The arithmetic is done in the tier of the widest operand, with
+ * overflow checks, and a result that overflows is computed again in
+ * the next tier. Results are always stored in the smallest tier they
+ * fit in, so a value that shrinks back (say, multiplied by zero) is
+ * a plain 64-bit integer again.
+ *
+ * The overflow checks are also used on their own by the interpreter
+ * (see "bytecode.h"), which works on 64-bit integers as long as none
+ * of them overflow, and only then continues with numbers.
+ */
+
+/* Checked 64-bit arithmetic: store the result in 'out', and return
+ * false if it overflowed (the hardware overflow flag, where the
+ * compiler gives access to it). */
+inline bool checkedAdd(int64_t a, int64_t b, int64_t &out) {
+#if defined(__GNUC__)
+    return !__builtin_add_overflow(a, b, &out);
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return false;
+    out = a + b;
+    return true;
+#endif
+}
+
+inline bool checkedSubtract(int64_t a, int64_t b, int64_t &out) {
+#if defined(__GNUC__)
+    return !__builtin_sub_overflow(a, b, &out);
+#else
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) return false;
+    out = a - b;
+    return true;
+#endif
+}
+
+inline bool checkedMultiply(int64_t a, int64_t b, int64_t &out) {
+#if defined(__GNUC__)
+    return !__builtin_mul_overflow(a, b, &out);
+#else
+    if (a == 0 || b == 0) {
+        out = 0;
+        return true;
+    }
+    if ((a == -1 && b == INT64_MIN) || (b == -1 && a == INT64_MIN)) return false;
+    int64_t product = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+    if (product / b != a) return false;
+    out = product;
+    return true;
+#endif
+}
+
+class Number {
+
+public:
+
+    // The tiers a number can be stored in
+    enum Tier {SMALL, WIDE, BIG};
+
+private:
+
+    Tier tier;
+    int64_t small;
+#ifdef HAVE_INT128
+    Int128 wide;
+#endif
+    std::unique_ptr<BigInt> big;
+
+public:
+
+    /* Create a number with the given value. */
+    Number(int64_t value = 0) : tier(SMALL), small(value)
+#ifdef HAVE_INT128
+        , wide(0)
+#endif
+    {}
+
+    Number(const Number &other);
+    Number &operator=(const Number &other);
+    Number(Number &&other) = default;
+    Number &operator=(Number &&other) = default;
+
+    /* Read a number from the given decimal digits (with an optional
+     * minus sign). Returns false if there are no digits, or anything
+     * else than digits. */
+    static bool parse(const char *text, size_t length, Number &out);
+
+    /* Return the tier the number is stored in. */
+    Tier level() const { return tier; }
+
+    /* Return whether the number fits in 64 bits, and its value if so. */
+    bool isSmall() const { return tier == SMALL; }
+    int64_t toSmall() const { return small; }
+
+    /* Apply an arithmetic operation (add, subtract or multiply) with
+     * the given value to the number. */
+    void apply(Operand op, const Number &value);
+
+    /* Return the number in decimal. */
+    std::string str() const;
+
+private:
+
+    /* Store a result, in the smallest tier it fits in. */
+    void setBig(BigInt &&value);
+#ifdef HAVE_INT128
+    void setWide(Int128 value);
+
+    /* Return the number as a 128-bit integer (unless it is big). */
+    Int128 toWide() const { return tier == SMALL ? small : wide; }
+#endif
+
+    /* Return the number as an arbitrary precision integer. */
+    BigInt toBig() const;
+
+};
+
+/* Write a number, in decimal. */
+std::ostream &operator<<(std::ostream &out, const Number &number);
+
+#endif // NUMBER_H
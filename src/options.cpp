@@ -0,0 +1,152 @@
+#include <iostream>
+#include <cstdlib>
+
+#include "options.h"
+
+namespace {
+
+/* Read the value of an option, as a positive number (or zero, if
+ * allowed). */
+bool readNumber(int argc, char *argv[], int &i, unsigned &out, bool allowZero = false) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    char *end;
+    unsigned long number = std::strtoul(argv[++i], &end, 10);
+    if (*end != '\0' || argv[i][0] == '\0' || (number == 0 && !allowZero)) {
+        return false;
+    }
+    out = static_cast<unsigned>(number);
+    return true;
+}
+
+/* Read the value of an option, as a string. */
+bool readString(int argc, char *argv[], int &i, std::string &out) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    out = argv[++i];
+    return true;
+}
+
+/* Read the value of the flush option: 'line', 'full', or a number
+ * of milliseconds. */
+bool readFlushPolicy(int argc, char *argv[], int &i, Options &out) {
+    std::string policy;
+    if (!readString(argc, argv, i, policy)) {
+        return false;
+    }
+    if (policy == "line") {
+        out.flush = FLUSH_LINE;
+        return true;
+    }
+    if (policy == "full") {
+        out.flush = FLUSH_FULL;
+        return true;
+    }
+    char *end;
+    unsigned long milliseconds = std::strtoul(policy.c_str(), &end, 10);
+    if (policy.empty() || *end != '\0' || milliseconds == 0) {
+        return false;
+    }
+    out.flush = FLUSH_TIMED;
+    out.flushMilliseconds = static_cast<unsigned>(milliseconds);
+    return true;
+}
+
+}
+
+bool parseOptions(int argc, char *argv[], Options &out) {
+    // The first argument is the name of the executable
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--threads") {
+            if (!readNumber(argc, argv, i, out.threads)) {
+                std::cout << "Option '--threads' must be followed by a positive number." << std::endl;
+                return false;
+            }
+        } else if (argument == "--parse-threads") {
+            if (!readNumber(argc, argv, i, out.parseThreads)) {
+                std::cout << "Option '--parse-threads' must be followed by a positive number." << std::endl;
+                return false;
+            }
+        } else if (argument == "--jobs") {
+            if (!readNumber(argc, argv, i, out.jobs)) {
+                std::cout << "Option '--jobs' must be followed by a positive number." << std::endl;
+                return false;
+            }
+        } else if (argument == "--manifest") {
+            if (!readString(argc, argv, i, out.manifest)) {
+                std::cout << "Option '--manifest' must be followed by a file name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--output-dir") {
+            if (!readString(argc, argv, i, out.outputDir)) {
+                std::cout << "Option '--output-dir' must be followed by a directory name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--load-snapshot" || argument == "--save-snapshot") {
+            std::string &snapshot = (argument == "--load-snapshot") ? out.loadSnapshot : out.saveSnapshot;
+            if (!readString(argc, argv, i, snapshot)) {
+                std::cout << "Option '" << argument << "' must be followed by a file name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--flush") {
+            if (!readFlushPolicy(argc, argv, i, out)) {
+                std::cout << "Option '--flush' must be followed by 'line', 'full' or a number of milliseconds." << std::endl;
+                return false;
+            }
+        } else if (argument == "--serve") {
+            if (!readString(argc, argv, i, out.serve)) {
+                std::cout << "Option '--serve' must be followed by a socket path." << std::endl;
+                return false;
+            }
+        } else if (argument == "--columns") {
+            if (!readString(argc, argv, i, out.columns)) {
+                std::cout << "Option '--columns' must be followed by a file name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--native") {
+            if (!readString(argc, argv, i, out.native)) {
+                std::cout << "Option '--native' must be followed by a library file name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--journal") {
+            if (!readString(argc, argv, i, out.journal)) {
+                std::cout << "Option '--journal' must be followed by a file name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--journal-window") {
+            if (!readNumber(argc, argv, i, out.journalWindow, true)) {
+                std::cout << "Option '--journal-window' must be followed by a number of milliseconds." << std::endl;
+                return false;
+            }
+        } else if (argument == "--explain") {
+            if (!readString(argc, argv, i, out.explain)) {
+                std::cout << "Option '--explain' must be followed by a register name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--explain-dot") {
+            if (!readString(argc, argv, i, out.explainDot)) {
+                std::cout << "Option '--explain-dot' must be followed by a file name." << std::endl;
+                return false;
+            }
+        } else if (argument == "--shared") {
+            out.shared = true;
+        } else if (argument == "--async-output") {
+            out.asyncOutput = true;
+        } else if (argument == "--stats" || argument == "--stats=text") {
+            out.stats = true;
+            out.statsJson = false;
+        } else if (argument == "--stats=json") {
+            out.stats = true;
+            out.statsJson = true;
+        } else if (argument.compare(0, 2, "--") == 0) {
+            std::cout << "Unknown option: " << argument << std::endl;
+            return false;
+        } else {
+            out.filenames.push_back(argument);
+        }
+    }
+    return true;
+}
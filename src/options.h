@@ -0,0 +1,119 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <vector>
+
+#include "output.h"
+
+/*
+ * This file contains the command line options of the calculator.
+ *
+ * Options start with "--", and some of them take a value as the
+ * next argument. Any other argument is taken as an input file.
+ * When more than one input file is given (or a manifest), the files
+ * are run in batch mode (see "batch.h").
+ * The supported options are:
+ *  > --threads <n>   Evaluate large registers in parallel, on n threads.
+ *  > --parse-threads <n> Parse the input file in chunks, on n threads (see
+ *                    "parallelparser.h").
+ *  > --stats         Write runtime statistics to stderr at exit (and on
+ *                    SIGUSR1), see "stats.h". '--stats=json' writes them
+ *                    as a JSON object instead of plain text.
+ *  > --manifest <f>  Run the files listed in f (one per line) in batch mode.
+ *  > --jobs <n>      Run batch mode on n threads (default: one per core).
+ *  > --output-dir <d> In batch mode, write the output of each file to its
+ *                    own file in d, instead of to the console.
+ *  > --load-snapshot <f> Start from the registers saved in snapshot f.
+ *  > --save-snapshot <f> Save the registers to snapshot f when done
+ *                    (see "snapshot.h").
+ *  > --flush <p>     When to write out the output (see "output.h"):
+ *                    'line' after every line, 'full' when the buffer is
+ *                    full, or a number of milliseconds, for at most that
+ *                    long after a line is written. (The default is per
+ *                    line on a terminal, and otherwise when full.)
+ *  > --async-output  Write the output on a background thread.
+ *  > --serve <path>  Run as a server on the Unix domain socket at path,
+ *                    with a session per connection (see "server.h").
+ *  > --shared        In server mode, let all sessions share their
+ *                    registers (see "shared.h").
+ *  > --columns <f>   Run the program file once per row of the seed table
+ *                    in f, in columnar mode (see "columnar.h").
+ *  > --native <lib>  In columnar mode, compile the program to native code,
+ *                    in the shared library lib (see "native.h").
+ *  > --journal <f>   Keep a journal of the operations in f, and start from
+ *                    the operations already in it (see "journal.h").
+ *  > --journal-window <ms> Sync the journal to disk at most this long after
+ *                    an operation (default 10; 0 syncs after every line).
+ *  > --explain <r>   When done, explain register r, as the 'explain'
+ *                    command does (see "explain.h").
+ *  > --explain-dot <f> Write the dependency graph of each explained
+ *                    register to f, in the Graphviz format.
+ */
+struct Options {
+
+    // Input files to read from (none when reading from the console)
+    std::vector<std::string> filenames;
+
+    // File listing more input files, one per line (for batch mode)
+    std::string manifest;
+
+    // Number of threads running files in batch mode (0 for one per core)
+    unsigned jobs;
+
+    // Directory for the output files in batch mode (empty for the console)
+    std::string outputDir;
+
+    // Number of threads used for evaluating registers
+    unsigned threads;
+
+    // Number of threads used for parsing the input file
+    unsigned parseThreads;
+
+    // Snapshots to start from, and to save to when done (empty for none)
+    std::string loadSnapshot;
+    std::string saveSnapshot;
+
+    // Whether to report statistics, and if so, as JSON or plain text
+    bool stats;
+    bool statsJson;
+
+    // Flush policy of the output (and its interval, for FLUSH_TIMED),
+    // and whether to write the output on a background thread
+    FlushPolicy flush;
+    unsigned flushMilliseconds;
+    bool asyncOutput;
+
+    // Unix domain socket to serve sessions on (empty for no server mode)
+    std::string serve;
+
+    // Whether the sessions of the server share their registers
+    bool shared;
+
+    // Seed table for columnar mode (empty for no columnar mode)
+    std::string columns;
+
+    // Shared library for the native code of columnar mode (empty for none)
+    std::string native;
+
+    // Journal of the operations (empty for none), and how long after an
+    // operation it is synced to disk, at most
+    std::string journal;
+    unsigned journalWindow;
+
+    // Register to explain when done (empty for none), and the file for
+    // the graphs of the explained registers (empty for none)
+    std::string explain;
+    std::string explainDot;
+
+    Options() : jobs(0), threads(1), parseThreads(1), stats(false), statsJson(false),
+                flush(FLUSH_AUTO), flushMilliseconds(0), asyncOutput(false), shared(false),
+                journalWindow(10) {}
+
+};
+
+/* Read the command line arguments into the given options. Returns
+ * false (after printing an error message) if an argument is invalid. */
+bool parseOptions(int argc, char *argv[], Options &out);
+
+#endif // OPTIONS_H
@@ -0,0 +1,275 @@
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "number.h"
+#include "output.h"
+#include "stats.h"
+
+const size_t Output::CAPACITY;
+
+namespace {
+
+// Number of full buffers that can wait for the writer thread, before
+// the evaluator waits for it (so a stalled pipe cannot use up memory)
+const size_t MAX_QUEUED = 8;
+
+// The decimal digits of 0 to 99, two characters each
+const char DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+}
+
+Output::Output(int descriptor)
+    : descriptor(descriptor), stream(nullptr), destination(nullptr),
+      policy(FLUSH_FULL), interval(), writing(false), stopping(false) {
+    buffer.reserve(CAPACITY);
+    setPolicy(FLUSH_AUTO);
+}
+
+Output::Output(std::ostream &stream)
+    : descriptor(-1), stream(&stream), destination(nullptr),
+      policy(FLUSH_FULL), interval(), writing(false), stopping(false) {
+    buffer.reserve(CAPACITY);
+    setPolicy(FLUSH_AUTO);
+}
+
+Output::Output(std::string &text)
+    : descriptor(-1), stream(nullptr), destination(&text),
+      policy(FLUSH_FULL), interval(), writing(false), stopping(false) {
+    buffer.reserve(CAPACITY);
+    setPolicy(FLUSH_AUTO);
+}
+
+Output::~Output() {
+    sync();
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+    }
+}
+
+Output &Output::console() {
+#ifndef _WIN32
+    static Output output(STDOUT_FILENO);
+#else
+    static Output output(std::cout);
+#endif
+    return output;
+}
+
+void Output::setPolicy(FlushPolicy policy, std::chrono::milliseconds interval) {
+    // (Without a descriptor there is no telling if it is a terminal,
+    // which is only the case for the console on Windows)
+    if (policy == FLUSH_AUTO) {
+#ifndef _WIN32
+        policy = (descriptor >= 0 && isatty(descriptor)) ? FLUSH_LINE : FLUSH_FULL;
+#else
+        policy = (stream == &std::cout) ? FLUSH_LINE : FLUSH_FULL;
+#endif
+    }
+    this->policy = policy;
+    this->interval = interval;
+    if (policy == FLUSH_TIMED) {
+        startWriter();
+    }
+}
+
+void Output::startWriter() {
+    if (!writer.joinable()) {
+        writer = std::thread(&Output::writeQueued, this);
+    }
+}
+
+Output &Output::operator<<(const char *text) {
+    append(text, std::strlen(text));
+    return *this;
+}
+
+Output &Output::operator<<(const std::string &text) {
+    append(text.data(), text.size());
+    return *this;
+}
+
+Output &Output::operator<<(int64_t value) {
+    // Fill a small buffer from the end, two digits at a time
+    // (the magnitude is unsigned, so INT64_MIN works too)
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    while (magnitude >= 100) {
+        size_t pair = static_cast<size_t>(magnitude % 100);
+        magnitude /= 100;
+        start -= 2;
+        std::memcpy(start, DIGIT_PAIRS + 2 * pair, 2);
+    }
+    if (magnitude >= 10) {
+        start -= 2;
+        std::memcpy(start, DIGIT_PAIRS + 2 * magnitude, 2);
+    } else {
+        *--start = static_cast<char>('0' + magnitude);
+    }
+    if (value < 0) {
+        *--start = '-';
+    }
+    append(start, static_cast<size_t>(end - start));
+    return *this;
+}
+
+Output &Output::operator<<(const Number &value) {
+    if (value.isSmall()) {
+        return *this << value.toSmall();
+    }
+    return *this << value.str();
+}
+
+Output &Output::operator<<(char c) {
+    append(&c, 1);
+    if (c == '\n') {
+        if (policy == FLUSH_LINE) {
+            flush();
+        } else if (policy == FLUSH_TIMED) {
+            handOver();
+        }
+    }
+    return *this;
+}
+
+void Output::flush() {
+    if (!writer.joinable()) {
+        if (!buffer.empty()) {
+            write(buffer);
+            buffer.clear();
+        }
+        return;
+    }
+    // Queue the lines waiting for the interval first, then the buffer
+    std::unique_lock<std::mutex> guard(lock);
+    if (!lines.empty()) {
+        queue(guard, lines);
+    }
+    if (!buffer.empty()) {
+        queue(guard, buffer);
+    }
+}
+
+void Output::sync() {
+    flush();
+    if (writer.joinable()) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return queued.empty() && !writing; });
+    }
+}
+
+void Output::append(const char *text, size_t length) {
+    if (buffer.size() + length > CAPACITY) {
+        flush();
+    }
+    buffer.append(text, length);
+}
+
+void Output::handOver() {
+    // The interval starts with the first line waiting (which is then
+    // swapped in, rather than copied)
+    std::unique_lock<std::mutex> guard(lock);
+    if (lines.empty()) {
+        deadline = Clock::now() + interval;
+        lines.swap(buffer);
+        changed.notify_all();
+    } else {
+        lines.append(buffer);
+        buffer.clear();
+        if (lines.size() >= CAPACITY) {
+            queue(guard, lines);
+        }
+    }
+}
+
+void Output::queue(std::unique_lock<std::mutex> &guard, std::string &data) {
+    changed.wait(guard, [this] { return queued.size() < MAX_QUEUED; });
+    queued.push_back(std::move(data));
+    if (!spare.empty()) {
+        data = std::move(spare.back());
+        spare.pop_back();
+    } else {
+        data = std::string();
+        data.reserve(CAPACITY);
+    }
+    changed.notify_all();
+}
+
+void Output::write(const std::string &data) {
+    Stats::add(Stats::OUTPUT_WRITES);
+    if (destination) {
+        destination->append(data);
+        return;
+    }
+    if (stream) {
+        stream->write(data.data(), static_cast<std::streamsize>(data.size()));
+        stream->flush();
+        return;
+    }
+#ifndef _WIN32
+    // Write it all, even if the descriptor takes it in parts (if it
+    // fails, such as a closed pipe, the output is lost, as with cout)
+    const char *position = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t written = ::write(descriptor, position, left);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        position += written;
+        left -= static_cast<size_t>(written);
+    }
+#endif
+}
+
+void Output::writeQueued() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        // Wait for a buffer, or for the interval of the waiting lines
+        // to be up (and then write them out as a buffer)
+        while (queued.empty() && !stopping) {
+            if (lines.empty()) {
+                changed.wait(guard);
+            } else if (changed.wait_until(guard, deadline) == std::cv_status::timeout ||
+                       Clock::now() >= deadline) {
+                queued.push_back(std::move(lines));
+                lines = std::string();
+                if (!spare.empty()) {
+                    lines = std::move(spare.back());
+                    spare.pop_back();
+                }
+            }
+        }
+        if (queued.empty()) {
+            return;
+        }
+        std::string data = std::move(queued.front());
+        queued.pop_front();
+        writing = true;
+        guard.unlock();
+
+        write(data);
+        data.clear();
+
+        guard.lock();
+        writing = false;
+        spare.push_back(std::move(data));
+        changed.notify_all();
+    }
+}
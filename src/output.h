@@ -0,0 +1,150 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Number;
+
+/*
+ * This file contains the output of the calculator: the results of the
+ * prints and the error messages.
+ *
+ * Everything is written to a large buffer, which is reused, and only
+ * written out (with a single write, straight to the file descriptor
+ * where there is one) when the flush policy says so:
+ *  > FLUSH_LINE:  after every line, for an interactive console.
+ *  > FLUSH_FULL:  when the buffer is full (or on an explicit flush),
+ *                 for pipes and files, where only throughput matters.
+ *  > FLUSH_TIMED: when the buffer is full, or when the flush interval
+ *                 has passed since a line ended, even if nothing is
+ *                 written after it (the complete lines are handed to
+ *                 the writer thread, which this policy starts, and it
+ *                 writes them out when the interval is up).
+ *  > FLUSH_AUTO:  FLUSH_LINE if the output is a terminal, and
+ *                 otherwise FLUSH_FULL.
+ * Whatever the policy, the output is flushed before the calculator
+ * waits for input from the console, and when it is done, so nothing
+ * is ever held back from a user.
+ *   A line ends when the character '\n' is written (on its own), and
+ * integers are formatted directly into the buffer (two digits at a
+ * time), without going through the locale machinery of iostreams.
+ *
+ * Optionally, the buffers are written on a background thread, so the
+ * evaluator never waits for a slow pipe or disk: a full buffer is
+ * queued for the writer thread, and writing continues in a spare one.
+ * The writer writes the buffers in the order they were queued, so the
+ * output is exactly the same either way.
+ */
+
+/* The flush policies (see above). */
+enum FlushPolicy {FLUSH_AUTO, FLUSH_LINE, FLUSH_FULL, FLUSH_TIMED};
+
+class Output {
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Size at which the buffer is flushed
+    static const size_t CAPACITY = 1 << 16;
+
+    // Where the buffers are written: a file descriptor, a stream (when
+    // there is no descriptor), or the end of a string (for callers that
+    // send the output on themselves, see "server.h")
+    int descriptor;
+    std::ostream *stream;
+    std::string *destination;
+
+    // The buffer being filled
+    std::string buffer;
+
+    // The flush policy, and the interval of FLUSH_TIMED
+    FlushPolicy policy;
+    Clock::duration interval;
+
+    // The writer thread, when writing in the background: the full
+    // buffers waiting to be written (in order), and the written
+    // buffers kept for reuse. With FLUSH_TIMED, also the complete
+    // lines waiting for the interval, and when it is up.
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::string> queued;
+    std::vector<std::string> spare;
+    std::string lines;
+    Clock::time_point deadline;
+    bool writing;
+    bool stopping;
+
+public:
+
+    /* Create an output writing to the given file descriptor, to the
+     * given stream, or appending to the given string. The policy is
+     * FLUSH_AUTO. */
+    explicit Output(int descriptor);
+    explicit Output(std::ostream &stream);
+    explicit Output(std::string &text);
+
+    /* Flush the buffer, and wait for the writer thread (if any)
+     * to write everything. */
+    ~Output();
+
+    Output(const Output &) = delete;
+    Output &operator=(const Output &) = delete;
+
+    /* Return the output of the process, to standard output. */
+    static Output &console();
+
+    /* Set the flush policy (the interval is only used by FLUSH_TIMED,
+     * which starts the writer thread). */
+    void setPolicy(FlushPolicy policy, std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+
+    /* Write the buffers on a background thread from now on. */
+    void startWriter();
+
+    /* Write text, a number, or a single character (where '\n' ends
+     * the line, see the flush policies above). */
+    Output &operator<<(const char *text);
+    Output &operator<<(const std::string &text);
+    Output &operator<<(int64_t value);
+    Output &operator<<(const Number &value);
+    Output &operator<<(char c);
+
+    /* Write out everything in the buffer (with a writer thread, the
+     * buffer is queued, and this does not wait for it to be written). */
+    void flush();
+
+    /* Flush, and also wait for the writer thread to write everything. */
+    void sync();
+
+private:
+
+    /* Append to the buffer, flushing it first if it is full. */
+    void append(const char *text, size_t length);
+
+    /* Hand the lines in the buffer to the writer thread, to be written
+     * when the flush interval is up (FLUSH_TIMED). */
+    void handOver();
+
+    /* Queue a buffer for the writer thread (waiting while too many are
+     * queued), and continue in a spare one. */
+    void queue(std::unique_lock<std::mutex> &guard, std::string &data);
+
+    /* Write out a buffer, to the descriptor, stream or string. */
+    void write(const std::string &data);
+
+    /* The loop of the writer thread. */
+    void writeQueued();
+
+};
+
+#endif // OUTPUT_H
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include "parallelparser.h"
+
+const size_t ParallelParser::CHUNK;
+const size_t ParallelParser::LINE_SEARCH;
+
+namespace {
+
+// Marks a name of a chunk that has no id in the shared symbols yet
+const RegisterId UNMAPPED = UINT32_MAX;
+
+/* Return whether a character is whitespace (as for the lexer). */
+bool isSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/* Return whether the last token in [begin, end) is 'save' or 'restore'
+ * (in any case). */
+bool endsWithSnapshot(const char *begin, const char *end) {
+    while (end > begin && isSpace(end[-1])) --end;
+    const char *start = end;
+    while (start > begin && !isSpace(start[-1])) --start;
+    std::string word(start, end);
+    std::transform(word.begin(), word.end(), word.begin(), [](char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    });
+    return word == "save" || word == "restore";
+}
+
+}
+
+ParallelParser::ParallelParser(Symbols &symbols, unsigned threads)
+    : symbols(symbols), parser(symbols), threads(std::max(1u, threads)) {
+}
+
+char *ParallelParser::parse(Instructions &instructions, char *begin, char *end) {
+    // (With one thread there is nothing to gain, so the window is
+    // parsed directly, about as many instructions as a chunk holds)
+    if (threads == 1) {
+        return parser.parse(instructions, begin, end, CHUNK / 16);
+    }
+
+    // Split the window into chunks
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    for (char *from = begin; from < end && chunks.size() < threads; ) {
+        chunks.emplace_back(new Chunk());
+        chunks.back()->begin = from;
+        chunks.back()->end = split(from, end);
+        from = chunks.back()->end;
+    }
+
+    // Parse the first chunk on this thread, and the others on their own
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        workers.emplace_back(parseChunk, std::ref(*chunks[i]));
+    }
+    if (!chunks.empty()) {
+        parseChunk(*chunks.front());
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    char *at = begin;
+    for (const std::unique_ptr<Chunk> &chunk : chunks) {
+        at = merge(instructions, *chunk, at, end);
+    }
+    // (A window that is only the start of one expression, which would
+    // need tokens of several megabytes, is parsed on this thread)
+    if (at == begin && begin < end) {
+        at = parser.parse(instructions, begin, end, 1);
+    }
+    return at;
+}
+
+char *ParallelParser::split(char *begin, char *end) {
+    if (static_cast<size_t>(end - begin) <= CHUNK) {
+        return end;
+    }
+    char *target = begin + CHUNK;
+    char *limit = static_cast<size_t>(end - target) > LINE_SEARCH ? target + LINE_SEARCH : end;
+    char *found = std::find(target, limit, '\n');
+    if (found == limit) {
+        found = std::find_if(target, end, isSpace);
+    }
+    // (The file name of a 'save' or 'restore' stays with it, since a
+    // chunk starting with it would read it as a register, folding it
+    // to lower case in the buffer)
+    if (endsWithSnapshot(begin, found)) {
+        found = std::find_if(std::find_if_not(found, end, isSpace), end, isSpace);
+    }
+    return found;
+}
+
+void ParallelParser::parseChunk(Chunk &chunk) {
+    Parser parser(chunk.symbols);
+    parser.setTrace(&chunk.trace);
+    parser.parse(chunk.instructions, chunk.begin, chunk.end);
+}
+
+char *ParallelParser::merge(Instructions &instructions, Chunk &chunk, char *at, char *end) {
+    // The last expression of the chunk is parsed again if it was cut off
+    // by the edge of the chunk (and not by the end of the buffer)
+    const Parser::Trace &trace = chunk.trace;
+    size_t total = trace.starts.size();
+    size_t steps = total;
+    if (trace.truncated && chunk.end != end) {
+        --steps;
+    }
+
+    // Parse expressions here, until one starts where one of the chunk
+    // started (or the chunk has been passed)
+    size_t first;
+    while (true) {
+        if (at >= chunk.end) {
+            return at;
+        }
+        Lexer lexer(at, chunk.end);
+        Token token;
+        if (!lexer.next(token)) {
+            return chunk.end;
+        }
+        first = std::lower_bound(trace.starts.begin(), trace.starts.begin() + steps, token.text) - trace.starts.begin();
+        if (first < steps && trace.starts[first] == token.text) {
+            break;
+        }
+        at = parser.parse(instructions, at, end, 1);
+    }
+
+    // Intern the names of the steps used, in order
+    ids.assign(chunk.symbols.size(), UNMAPPED);
+    size_t lastName = steps < total ? trace.interned[steps] : trace.ids.size();
+    for (size_t i = trace.interned[first]; i < lastName; ++i) {
+        RegisterId id = trace.ids[i];
+        if (ids[id] == UNMAPPED) {
+            ids[id] = symbols.intern(chunk.symbols.name(id));
+        }
+    }
+
+    // Add their instructions, with the shared ids
+    size_t lastInstruction = steps < total ? trace.instructions[steps] : chunk.instructions.size();
+    for (size_t i = 0; i < lastInstruction; ++i) {
+        Instruction instruction = chunk.instructions.front();
+        chunk.instructions.pop();
+        if (i < trace.instructions[first]) continue;
+        switch (static_cast<Operand>(instruction.op)) {
+            case QUIT:
+                break;
+            case ERROR:
+            case SAVE:
+            case RESTORE:
+                instruction.reg = symbols.addMessage(chunk.symbols.message(instruction.reg));
+                break;
+            default:
+                instruction.reg = ids[instruction.reg];
+                if (instruction.kind == REFERENCE) {
+                    instruction.value = ids[static_cast<RegisterId>(instruction.value)];
+                } else if (instruction.kind == BIG_LITERAL) {
+                    const std::string &digits = chunk.symbols.number(static_cast<uint32_t>(instruction.value));
+                    instruction.value = symbols.addNumber(digits.data(), digits.size());
+                }
+                break;
+        }
+        instructions.push(instruction);
+    }
+    return steps < total ? chunk.begin + (trace.starts[steps] - chunk.begin) : chunk.end;
+}
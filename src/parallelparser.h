@@ -0,0 +1,92 @@
+#ifndef PARALLELPARSER_H
+#define PARALLELPARSER_H
+
+#include <memory>
+#include <vector>
+
+#include "parser.h"
+
+/*
+ * This class parses a large buffer (such as a mapped input file) on
+ * several threads, with the same result as the parser on one thread:
+ * the same instructions, the same register ids, and the same syntax
+ * errors, in the same order.
+ *
+ * The buffer is parsed a window at a time, of a chunk per thread. The
+ * chunks are split on whitespace (at a line break, when there is one
+ * nearby), so no token is split, and each chunk is parsed on its own
+ * thread, with its own symbols, as if an expression started at its
+ * first token. The chunks are then merged in order, on this thread:
+ * their names are interned again in the shared symbols (in the order
+ * the parser would have interned them), and their instructions are
+ * added with the ids of the shared symbols.
+ *   An expression does not always start at the first token of a chunk,
+ * since the parser does not care about lines, and expressions can be
+ * split by the edge of a chunk. So each chunk is parsed with a trace
+ * (see Parser::Trace), which tells where each of its expressions
+ * started; the merge knows where the expression it is at starts, and
+ * parses the expressions on this thread (one at a time, with the
+ * shared symbols) until it reaches one that the chunk also started
+ * with. From there on the chunk was parsed exactly as it would have
+ * been, and its instructions are used. (Parsing from a wrong start
+ * gets back in line within a few expressions in practice, so almost
+ * all of the work is done on the threads.)
+ */
+class ParallelParser {
+
+private:
+
+    // Size of the chunk parsed by each thread
+    static const size_t CHUNK = 4 << 20;
+
+    // How far past the chunk size a line break is looked for
+    static const size_t LINE_SEARCH = 64 << 10;
+
+    // A chunk of the buffer, and what it was parsed into
+    struct Chunk {
+        char *begin;
+        char *end;
+        Symbols symbols;
+        Instructions instructions;
+        Parser::Trace trace;
+
+        Chunk() : begin(nullptr), end(nullptr), symbols(false) {}
+    };
+
+    // The shared symbols, and a parser using them, for the expressions
+    // that the chunks did not parse the same way
+    Symbols &symbols;
+    Parser parser;
+    unsigned threads;
+
+    // Ids in the shared symbols of the names of a chunk (while merging)
+    std::vector<RegisterId> ids;
+
+public:
+
+    /* Create a parser, interning the register names in the given
+     * symbols object, and parsing on the given number of threads. */
+    ParallelParser(Symbols &symbols, unsigned threads);
+
+    /* Parse a window of the characters in [begin, end) (a chunk per
+     * thread), adding the instructions to the given list. Returns where
+     * the parsing stopped (the end, or the start of an expression), so
+     * that it can continue from there. */
+    char *parse(Instructions &instructions, char *begin, char *end);
+
+private:
+
+    /* Return where a chunk starting at 'begin' should end. */
+    static char *split(char *begin, char *end);
+
+    /* Parse a chunk on its own. */
+    static void parseChunk(Chunk &chunk);
+
+    /* Add the instructions of a chunk, for an expression starting at
+     * 'at' (and a buffer ending at 'end'). Returns where the next
+     * chunk has to continue. */
+    char *merge(Instructions &instructions, Chunk &chunk, char *at, char *end);
+
+};
+
+#endif // PARALLELPARSER_H
@@ -1,95 +1,190 @@
+#include <cstring>
+
 #include "parser.h"
+#include "stats.h"
+
+Parser::Parser(Symbols &symbols) : symbols(symbols), trace(nullptr), snapshotCount(0) {
+}
+
+void Parser::setTrace(Trace *trace) {
+    this->trace = trace;
+}
 
 void Parser::parse(Instructions &instructions, std::istream &inputstream) {
+    // Read the whole stream into the buffer, and parse it.
+    buffer.assign(std::istreambuf_iterator<char>(inputstream), std::istreambuf_iterator<char>());
+    parse(instructions, &buffer[0], &buffer[0] + buffer.size());
+}
+
+void Parser::parse(Instructions &instructions, char *begin, char *end) {
+    parse(instructions, begin, end, SIZE_MAX);
+}
+
+char *Parser::parse(Instructions &instructions, char *begin, char *end, size_t limit) {
+
+    Stats::Timer timer(Stats::PARSE_TIME);
+
+    // Read all tokens in the input (or until enough instructions are added)
+    Lexer lexer(begin, end);
+    size_t added = instructions.size();
+    parseExpressions(instructions, lexer, limit);
+    Stats::add(Stats::TOKENS, lexer.tokens());
+    Stats::add(Stats::INSTRUCTIONS, instructions.size() - added);
+    return lexer.position();
+}
+
+void Parser::parseLines(Instructions &instructions, char *begin, char *end) {
+
+    Stats::Timer timer(Stats::PARSE_TIME);
 
-    // Read all tokens in the input
-    std::string input;
-    while ( readToken(inputstream, input) ) {
+    // Give each line a lexer of its own, so that no expression can
+    // read past the end of its line
+    size_t added = instructions.size();
+    size_t tokens = 0;
+    while (begin < end) {
+        char *lineEnd = static_cast<char *>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        Lexer lexer(begin, lineEnd);
+        parseExpressions(instructions, lexer, SIZE_MAX);
+        tokens += lexer.tokens();
+        begin = lineEnd < end ? lineEnd + 1 : end;
+    }
+    Stats::add(Stats::TOKENS, tokens);
+    Stats::add(Stats::INSTRUCTIONS, instructions.size() - added);
+}
+
+void Parser::parseExpressions(Instructions &instructions, Lexer &lexer, size_t limit) {
+    Token input;
+    size_t added = instructions.size();
+    // (A failed read within an expression means the buffer ended in it,
+    // see readToken, so the first token is read from the lexer directly)
+    while ( instructions.size() - added < limit && lexer.next(input) ) {
+        if (trace) {
+            trace->starts.push_back(input.text);
+            trace->instructions.push_back(instructions.size());
+            trace->interned.push_back(trace->ids.size());
+        }
 
         // Determine which type of expression, there are three types:
         //  * Quit ('quit' keyword)
         //  * Print ('print' keyword followed by register)
+        //  * Explain ('explain' keyword followed by register)
+        //  * Save and restore ('save' or 'restore' keyword followed by file)
         //  * Operation on a register (register followed by operand and value)
-        if (Token::isQuitOperand(input)) {
+        if (input.kind == TOKEN_QUIT) {
             addInstruction(instructions, QUIT);
-        } else if (Token::isPrintOperand(input)) {
-            parsePrintInstruction(instructions, inputstream);
-        } else if (Token::isRegister(input)) {
-            parseArithmeticInstruction(instructions, inputstream, input);
+        } else if (input.kind == TOKEN_PRINT) {
+            parsePrintInstruction(instructions, lexer);
+        } else if (input.kind == TOKEN_EXPLAIN) {
+            parseExplainInstruction(instructions, lexer);
+        } else if (input.kind == TOKEN_SAVE) {
+            parseSnapshotInstruction(instructions, lexer, SAVE);
+        } else if (input.kind == TOKEN_RESTORE) {
+            parseSnapshotInstruction(instructions, lexer, RESTORE);
+        } else if (input.kind == TOKEN_REGISTER) {
+            parseArithmeticInstruction(instructions, lexer, input);
         } else {
-            std::cout << "Syntax Error: '" << input << "' is an invalid start of expression." << std::endl;
+            addError(instructions, "Syntax Error: '" + input.str() + "' is an invalid start of expression.");
         }
     }
 }
 
-void Parser::parsePrintInstruction(Instructions &instructions, std::istream &inputstream) {
+void Parser::parsePrintInstruction(Instructions &instructions, Lexer &lexer) {
     // Read the second token, the register name, and add the instruction
-    std::string reg;
-    if ( readRegister(inputstream, reg) ) {
+    RegisterId reg;
+    if ( readRegister(lexer, reg) ) {
         addInstruction(instructions, PRINT, reg);
     } else {
-        std::cout << "Syntax Error: 'print' must be followed by a register." << std::endl;
+        addError(instructions, "Syntax Error: 'print' must be followed by a register.");
     }
 }
 
-void Parser::parseArithmeticInstruction(Instructions &instructions, std::istream &inputstream, std::string reg) {
+void Parser::parseExplainInstruction(Instructions &instructions, Lexer &lexer) {
+    // Read the second token, the register name, and add the instruction
+    RegisterId reg;
+    if ( readRegister(lexer, reg) ) {
+        addInstruction(instructions, EXPLAIN, reg);
+    } else {
+        addError(instructions, "Syntax Error: 'explain' must be followed by a register.");
+    }
+}
+
+void Parser::parseSnapshotInstruction(Instructions &instructions, Lexer &lexer, Operand op) {
+    // Read the second token, the file name (passed on like a message,
+    // and read verbatim, since file names are case sensitive), and add
+    // the instruction
+    Token file;
+    if ( readToken(lexer, file, true) ) {
+        addInstruction(instructions, op, symbols.addMessage(file.str()));
+        ++snapshotCount;
+    } else if (op == SAVE) {
+        addError(instructions, "Syntax Error: 'save' must be followed by a file name.");
+    } else {
+        addError(instructions, "Syntax Error: 'restore' must be followed by a file name.");
+    }
+}
+
+void Parser::parseArithmeticInstruction(Instructions &instructions, Lexer &lexer, const Token &reg) {
     // Read the next two tokens (always read both of them).
-    // If successful, add the instruction, else print error messages.
+    // If successful, add the instruction, else add error messages.
 
     Operand op;
-    bool readOperandSucess = readArithmeticOperand(inputstream, op);
+    bool readOperandSucess = readArithmeticOperand(lexer, op);
 
-    std::string value;
-    bool readValueSuccess = readValue(inputstream, value);
+    ValueKind kind;
+    int64_t value;
+    bool readValueSuccess = readValue(lexer, kind, value);
 
     if (readOperandSucess && readValueSuccess) {
-        addInstruction(instructions, op, reg, value);
+        addInstruction(instructions, op, intern(reg), kind, value);
     }
 
     if (!readOperandSucess) {
-        std::cout << "Syntax Error: Missing or invalid operand after register '" << reg << "'." << std::endl;
+        addError(instructions, "Syntax Error: Missing or invalid operand after register '" + reg.str() + "'.");
     }
     if (!readValueSuccess) {
-        std::cout << "Syntax Error: Missing or invalid value after operand." << std::endl;
+        addError(instructions, "Syntax Error: Missing or invalid value after operand.");
     }
 }
 
-bool Parser::readToken(std::istream &inputstream, std::string &out) {
+bool Parser::readToken(Lexer &lexer, Token &out, bool verbatim) {
     // Read a token and return if it is was successful or not.
-    std::string token;
-    if ( inputstream >> token ) {
-        // The syntax is case insensitive, so change to lower case
-        std::transform(token.begin(), token.end(), token.begin(), ::tolower);
-        out = token;
-        return true;
+    // (The lexer takes care of the case insensitivity.)
+    if ( !(verbatim ? lexer.nextVerbatim(out) : lexer.next(out)) ) {
+        if (trace) {
+            trace->truncated = true;
+        }
+        return false;
     }
-    return false;
+    return true;
 }
 
-bool Parser::readQuitOperand(std::istream &inputstream) {
+bool Parser::readQuitOperand(Lexer &lexer) {
     // Read a token and return if it is a quit token or not.
-    std::string op;
-    return ( readToken(inputstream, op) && Token::isQuitOperand(op) );
+    Token op;
+    return ( readToken(lexer, op) && op.kind == TOKEN_QUIT );
 }
 
-bool Parser::readPrintOperand(std::istream &inputstream) {
+bool Parser::readPrintOperand(Lexer &lexer) {
     // Read a token and return if it is a print token or not.
-    std::string op;
-    return ( readToken(inputstream, op) && Token::isPrintOperand(op) );
+    Token op;
+    return ( readToken(lexer, op) && op.kind == TOKEN_PRINT );
 }
 
-bool Parser::readArithmeticOperand(std::istream &inputstream, Operand &out) {
+bool Parser::readArithmeticOperand(Lexer &lexer, Operand &out) {
     // Read a token and return if it is an arithmetic operation or not.
     // Also set the output value to the read operation.
-    std::string op;
-    if ( readToken(inputstream, op) ) {
-        if ( Token::isAddOperand(op) ) {
+    Token op;
+    if ( readToken(lexer, op) ) {
+        if ( op.kind == TOKEN_ADD ) {
             out = ADD;
             return true;
-        } else if ( Token::isSubtractOperand(op) ) {
+        } else if ( op.kind == TOKEN_SUBTRACT ) {
             out = SUBTRACT;
             return true;
-        } else if ( Token::isMultiplyOperand(op) ) {
+        } else if ( op.kind == TOKEN_MULTIPLY ) {
             out = MULTIPLY;
             return true;
         }
@@ -97,31 +192,71 @@ bool Parser::readArithmeticOperand(std::istream &inputstream, Operand &out) {
     return false;
 }
 
-bool Parser::readRegister(std::istream &inputstream, std::string &out) {
+bool Parser::readRegister(Lexer &lexer, RegisterId &out) {
     // Read a token and return if it is a register name or not.
-    // Also set the output value to the read register name.
-    std::string reg;
-    if ( readToken(inputstream, reg) && Token::isRegister(reg) ) {
-        out = reg;
+    // Also set the output value to the id of the read register name.
+    Token reg;
+    if ( readToken(lexer, reg) && reg.kind == TOKEN_REGISTER ) {
+        out = intern(reg);
         return true;
     }
     return false;
 }
 
-bool Parser::readValue(std::istream &inputstream, std::string &out) {
+bool Parser::readValue(Lexer &lexer, ValueKind &kind, int64_t &out) {
     // Read a token and return if it is a value token (a register name
     // or a number) or not.
-    // Also set the output value to the read value token.
-    std::string val;
-    if ( readToken(inputstream, val) && ( Token::isNumber(val) || Token::isRegister(val) ) ) {
-        out = val;
+    // Also set the output values to the parsed number, or the id of
+    // the register name.
+    Token val;
+    if ( !readToken(lexer, val) ) {
+        return false;
+    }
+    if ( val.kind == TOKEN_NUMBER ) {
+        // Numbers that do not fit in 64 bits are passed on as text
+        kind = LITERAL;
+        if ( !parseNumber(val, out) ) {
+            kind = BIG_LITERAL;
+            out = symbols.addNumber(val.text, val.length);
+        }
+        return true;
+    }
+    if ( val.kind == TOKEN_REGISTER ) {
+        kind = REFERENCE;
+        out = intern(val);
         return true;
     }
     return false;
 }
 
-void Parser::addInstruction(Instructions &instructions, Operand op, std::string reg, std::string val) {
-    Instruction ins = std::make_tuple(op, reg, val);
+bool Parser::parseNumber(const Token &token, int64_t &out) {
+    // Accumulate the digits, and fail if the value would overflow.
+    int64_t number = 0;
+    for (size_t i = 0; i < token.length; ++i) {
+        int64_t digit = token.text[i] - '0';
+        if (number > (INT64_MAX - digit) / 10) {
+            return false;
+        }
+        number = number * 10 + digit;
+    }
+    out = number;
+    return true;
+}
+
+RegisterId Parser::intern(const Token &token) {
+    RegisterId id = symbols.intern(token.text, token.length);
+    if (trace) {
+        trace->ids.push_back(id);
+    }
+    return id;
+}
+
+void Parser::addInstruction(Instructions &instructions, Operand op, RegisterId reg,
+                            ValueKind kind, int64_t val) {
+    Instruction ins = {static_cast<uint8_t>(op), static_cast<uint8_t>(kind), reg, val};
     instructions.push(ins);
 }
 
+void Parser::addError(Instructions &instructions, const std::string &message) {
+    addInstruction(instructions, ERROR, symbols.addMessage(message));
+}
@@ -3,16 +3,21 @@
 
 #include <iostream>
 #include <sstream>
-#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <vector>
 
-#include "definitions.h"
+#include "instructions.h"
+#include "symbols.h"
+#include "lexer.h"
 
 /*
  * This class represents a parser for parsing the calculator
  * input, and creating a list of instructions.
  * 
  * The parser will read from the input stream, and divide
- * it into tokens (separated by spaces or linebreaks).
+ * it into tokens (separated by spaces or linebreaks), using
+ * the lexer (see "lexer.h").
  *   The parser acts as a very simple state machine, and
  * since there are very few instructions to take care of,
  * this state machine can be implemented as else-if-statements.
@@ -27,22 +32,63 @@
  * by their first token.
  *   The quit operation only consists of the token 'quit' (keyword).
  *   The print operation starts with the token 'print' (keyword),
- * and must be followed by a register name.
+ * and must be followed by a register name. (So does the explain
+ * operation, with the token 'explain', see "explain.h".) The save
+ * and restore operations start with the tokens 'save' and 'restore'
+ * (keywords), followed by a file name (any token, see "snapshot.h").
  *   The arithmetic operations start with a register name,
  * followed by an arithpetic operand ('add', 'subtract', 'multiply'),
  * and lastly a value (another register name, or a numeric value).
- *   All other syntaxes will lead to an error message written
- * to the console.
+ *   All other syntaxes will lead to an error message. The error
+ * messages are added to the instruction list as error instructions,
+ * so that the evaluator prints them in order with its own output.
  * 
- * The instructions are stored as tuples with three values:
- * operand, register, value. The quit instruction has empty
- * register and value fileds, and the print instruction has
- * an empty value field.
+ * The instructions are stored as tuples with four values:
+ * operand, register, value kind, value. The register names
+ * are interned into integer ids (in the symbols object shared
+ * with the evaluator), and numeric values are parsed into
+ * integers, so the evaluator does not have to deal with any
+ * strings. The quit instruction has zero register and value
+ * fileds, and the print instruction has a zero value field.
  */
 class Parser {
 
 public:
 
+    /* A record of how a buffer was parsed, for parsing the chunks of a
+     * buffer in parallel (see "parallelparser.h"). A step is one
+     * expression: the instructions added for it (one, or two errors),
+     * starting at one token. */
+    struct Trace {
+        std::vector<const char *> starts;   // First token of each step
+        std::vector<size_t> instructions;   // Instructions added before each step
+        std::vector<size_t> interned;       // Names interned before each step
+        std::vector<RegisterId> ids;        // Ids of the interned names, in order
+        bool truncated;                     // Whether the buffer ended within the last step
+
+        Trace() : truncated(false) {}
+    };
+
+private:
+
+    // Symbols used for interning the register names
+    Symbols &symbols;
+
+    // Trace of the parsing (null when not tracing)
+    Trace *trace;
+
+    // Number of save and restore instructions added
+    size_t snapshotCount;
+
+    // Buffer holding the input read from a stream, while it is lexed
+    std::string buffer;
+
+public:
+
+    /* Create a parser, interning register names in the given
+     * symbols object. */
+    Parser(Symbols &symbols);
+
     /* This method is the interface for using the parser.
      * It will read from a stream, and parse it
      * to create a list of instructions. The instructions
@@ -56,6 +102,11 @@ public:
      *        print <register>
      *    > quit operations
      *        quit
+     *    > explain operations
+     *        explain <register>
+     *    > snapshot operations
+     *        save <file>
+     *        restore <file>
      * 
      * The <register> is a register name token. The <value>
      * is either a register name token or a numeric token.
@@ -71,56 +122,110 @@ public:
      * token is a register name, the two following tokens are read,
      * and assumed to be an operand and a value. An arithmetic
      * operation is then added to the instruction list.
-     * If the syntax is not followed, an error message will be
-     * written to the console, and no errenous instruction will
-     * be added to the instruction list. */
+     * If the syntax is not followed, an error instruction will be
+     * added to the instruction list (with the error message), and no
+     * errenous instruction will be added to the instruction list. */
     void parse(Instructions &instructions, std::istream &inputstream);
 
+    /* This method parses the characters in [begin, end), in the
+     * same way as when parsing a stream. The buffer is modified
+     * in place, since the lexer folds it to lower case. */
+    void parse(Instructions &instructions, char *begin, char *end);
+
+    /* Same as above, but stops after adding 'limit' instructions.
+     * Returns where in the buffer the parsing stopped, so that
+     * parsing can continue from there (a buffer can be parsed in
+     * smaller batches this way, with the same result). */
+    char *parse(Instructions &instructions, char *begin, char *end, size_t limit);
+
+    /* This method parses the lines in [begin, end) each on their own,
+     * with the same result as parsing each line as a separate stream
+     * (as the console does): an expression that is not complete at the
+     * end of its line is an error, and does not continue on the next. */
+    void parseLines(Instructions &instructions, char *begin, char *end);
+
+    /* Record how the following buffers are parsed in the given trace
+     * (or stop recording, if null). */
+    void setTrace(Trace *trace);
+
+    /* Return the number of save and restore instructions added so far.
+     * (These read all names, or intern names, when they are executed, so
+     * the parser must not run ahead of them on another thread, see
+     * "pipeline.h".) */
+    size_t snapshots() const { return snapshotCount; }
+
 private:
 
+    /* Parse the expressions read by the lexer, until it reaches the end
+     * of its buffer, or 'limit' instructions have been added. */
+    void parseExpressions(Instructions &instructions, Lexer &lexer, size_t limit);
+
     /* Helper functions for parsing the second token, for when a
      * print instruction has been encounterd. */
-    void parsePrintInstruction(Instructions &instructions, std::istream &inputstream);
+    void parsePrintInstruction(Instructions &instructions, Lexer &lexer);
+
+    /* Helper functions for parsing the second token, for when an
+     * explain instruction has been encounterd. */
+    void parseExplainInstruction(Instructions &instructions, Lexer &lexer);
+
+    /* Helper functions for parsing the second token, for when a save
+     * or restore instruction has been encounterd. */
+    void parseSnapshotInstruction(Instructions &instructions, Lexer &lexer, Operand op);
 
     /* Helper functions for parsing the second and third tokens,
      * for when an arithmetic instruction has been encounterd. */
-    void parseArithmeticInstruction(Instructions &instructions, std::istream &inputstream, std::string reg);
+    void parseArithmeticInstruction(Instructions &instructions, Lexer &lexer, const Token &reg);
 
     /* Read the next token, and return true if successful,
-     * otherwise return false. */
-    bool readToken(std::istream &inputstream, std::string &out);
+     * otherwise return false. (A verbatim token is not folded to
+     * lower case, see "lexer.h".) */
+    bool readToken(Lexer &lexer, Token &out, bool verbatim = false);
 
     /* Read the next token, and return true if it is a quit token,
      * otherwise return false. */
-    bool readQuitOperand(std::istream &inputstream);
+    bool readQuitOperand(Lexer &lexer);
 
     /* Read the next token, and return true if it is a print token,
      * otherwise return false. */
-    bool readPrintOperand(std::istream &inputstream);
+    bool readPrintOperand(Lexer &lexer);
 
     /* Read the next token, and return true if it is an arithmetic
      * operation token, otherwise return false.
      * The given output value will contain which token was read
      * (and will be unaltered if no arithmetic operation was read). */
-    bool readArithmeticOperand(std::istream &inputstream, Operand &out);
+    bool readArithmeticOperand(Lexer &lexer, Operand &out);
 
     /* Read the next token, and return true if it is a register name token,
      * otherwise return false.
-     * The given output value will contain the read token
+     * The given output value will contain the id of the read register name
      * (and will be unaltered if no register name token was read). */
-    bool readRegister(std::istream &inputstream, std::string &out);
+    bool readRegister(Lexer &lexer, RegisterId &out);
 
     /* Read the next token, and return true if it is a value token,
      * otherwise return false.
      * (A value token can be either a number, or a register name.)
-     * The given output value will contain the read token
-     * (and will be unaltered if no value token was read). */
-    bool readValue(std::istream &inputstream, std::string &out);
+     * The given output values will contain the kind of value, and
+     * the parsed number or the interned register id
+     * (and will be unaltered if no value token was read).
+     * Numbers that do not fit in 64 bits are big literals, and the
+     * output is the index of their digits (see "symbols.h"). */
+    bool readValue(Lexer &lexer, ValueKind &kind, int64_t &out);
+
+    /* Parse a number token into a number. Returns false if
+     * the number does not fit in 64 bits. */
+    bool parseNumber(const Token &token, int64_t &out);
+
+    /* Intern a register name token (recording its id, when tracing). */
+    RegisterId intern(const Token &token);
+
+    /* Adds an error instruction with the given message to the
+     * list of instructions. */
+    void addError(Instructions &instructions, const std::string &message);
 
     /* Adds an instruction to the list of instruction, with the
      * given tuple values. */
-    void addInstruction(Instructions &instructions,
-                        Operand op, std::string reg = "", std::string val = "");
+    void addInstruction(Instructions &instructions, Operand op, RegisterId reg = 0,
+                        ValueKind kind = LITERAL, int64_t val = 0);
 
 };
 
@@ -0,0 +1,83 @@
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "pipeline.h"
+#include "stats.h"
+
+const size_t Pipeline::BATCH;
+const size_t Pipeline::CAPACITY;
+
+Pipeline::Pipeline(Parser &parser, Evaluator &evaluator) : parser(parser), evaluator(evaluator) {
+}
+
+bool Pipeline::run(char *begin, char *end) {
+    if (std::thread::hardware_concurrency() > 1) {
+        return runConcurrent(begin, end);
+    }
+    return runSerial(begin, end);
+}
+
+bool Pipeline::runSerial(char *begin, char *end) {
+    // Parse a batch, execute it, and continue where the parser stopped
+    Instructions instructions;
+    char *position = begin;
+    while (position != end) {
+        position = parser.parse(instructions, position, end, BATCH);
+        if (!evaluator.execute(instructions)) {
+            return false;
+        }
+        Stats::poll();
+    }
+    return true;
+}
+
+bool Pipeline::runConcurrent(char *begin, char *end) {
+    Ring<Instruction> ring(CAPACITY);
+
+    // Number of instructions executed (or all of them, once the
+    // evaluator is done), for the parser thread to wait on
+    std::mutex lock;
+    std::condition_variable executedChanged;
+    size_t executed = 0;
+
+    // The parser thread parses batches into the ring, until the input
+    // ends or the evaluator cancels the ring (after a quit). After a
+    // batch with a save or restore, it waits for the batch to be executed.
+    std::thread producer([&] {
+        Instructions batch;
+        char *position = begin;
+        size_t parsed = 0;
+        while (position != end) {
+            size_t snapshots = parser.snapshots();
+            position = parser.parse(batch, position, end, BATCH);
+            parsed += batch.size();
+            if (!ring.push(batch)) break;
+            if (parser.snapshots() != snapshots) {
+                std::unique_lock<std::mutex> guard(lock);
+                executedChanged.wait(guard, [&] { return executed >= parsed; });
+            }
+        }
+        ring.close();
+    });
+
+    // Execute the instructions as they come out of the ring
+    Instructions instructions;
+    bool running = true;
+    while (running && ring.pop(instructions, BATCH)) {
+        size_t count = instructions.size();
+        running = evaluator.execute(instructions);
+        Stats::poll();
+        std::lock_guard<std::mutex> guard(lock);
+        executed += count;
+        executedChanged.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        executed = SIZE_MAX;
+        executedChanged.notify_one();
+    }
+    ring.cancel();
+    producer.join();
+    return running;
+}
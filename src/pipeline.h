@@ -0,0 +1,64 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "parser.h"
+#include "evaluator.h"
+#include "ring.h"
+
+/*
+ * This class runs the parser and the evaluator on a whole input
+ * buffer (such as a mapped input file) as a streaming pipeline.
+ *
+ * Instead of parsing the whole input before executing anything,
+ * the input is parsed in batches of instructions, and each batch
+ * is executed as soon as it has been parsed. This way only a few
+ * batches of instructions are in memory at any time, regardless
+ * of the size of the input, and the first output appears as soon
+ * as the first print has been parsed.
+ *   When there is more than one core, the parser and evaluator
+ * run on separate threads, connected by a bounded lock-free ring
+ * of instructions (see "ring.h"): the parser thread parses ahead
+ * while the evaluator executes. If the evaluator executes a quit
+ * instruction, the parser thread is stopped. After a save or restore
+ * instruction, the parser thread waits until it has been executed,
+ * since these read or intern the register names (see "snapshot.h").
+ * With only one core, the batches are parsed and executed in turn, on
+ * one thread.
+ *   The output is the same either way, since the syntax errors
+ * are passed through as instructions, in order.
+ */
+class Pipeline {
+
+private:
+
+    // Number of instructions parsed, or executed, at a time
+    static const size_t BATCH = 4096;
+
+    // Number of instructions that fit in the ring
+    static const size_t CAPACITY = 65536;
+
+    Parser &parser;
+    Evaluator &evaluator;
+
+public:
+
+    Pipeline(Parser &parser, Evaluator &evaluator);
+
+    /* Parse and execute the characters in [begin, end). Returns
+     * false if a quit instruction was executed. */
+    bool run(char *begin, char *end);
+
+    /* Parse and execute the characters in [begin, end), running the
+     * parser and evaluator in turn, on this thread. (For callers that
+     * already run many pipelines at once, see "batch.h".) */
+    bool runSerial(char *begin, char *end);
+
+private:
+
+    /* Run the parser on a separate thread, and the evaluator on
+     * this thread. */
+    bool runConcurrent(char *begin, char *end);
+
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,174 @@
+#ifndef RING_H
+#define RING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * This class is a bounded ring buffer, for passing items from one
+ * producer thread to one consumer thread (lock-free, unless one of
+ * them has to wait, see below).
+ *
+ * The producer only writes the tail index, and the consumer only
+ * writes the head index, so no locks or read-modify-write atomics
+ * are needed: the producer publishes an item by storing the tail
+ * (release), and the consumer hands a slot back by storing the head
+ * (release). The two indices are kept on separate cache lines, so
+ * the threads do not slow each other down by sharing one.
+ *   Items are moved in batches, to keep the traffic on the indices
+ * low. A thread that finds the ring full (or empty) yields, and
+ * tries again, up to SPINS times; then it goes to sleep on a
+ * condition variable, until the other thread wakes it. A sleeping
+ * thread first raises its flag, and checks the ring once more, while
+ * the other thread checks the flag after moving items (with a fence
+ * in between on both sides), so a wakeup cannot be missed, and
+ * while no one sleeps, all it costs is reading the flag.
+ *   The producer closes the ring when it has no more items, and the
+ * consumer can cancel it when it does not want any more items.
+ */
+template <typename T>
+class Ring {
+
+private:
+
+    // The slots (the capacity is a power of two)
+    std::vector<T> slots;
+    size_t mask;
+
+    // Index of the next item to consume, written by the consumer
+    alignas(64) std::atomic<size_t> head;
+
+    // Index of the next slot to produce into, written by the producer
+    alignas(64) std::atomic<size_t> tail;
+
+    // Set by the producer when done, and by the consumer when cancelling
+    alignas(64) std::atomic<bool> closed;
+    std::atomic<bool> cancelled;
+
+    // Number of times a thread yields before going to sleep
+    static const unsigned SPINS = 64;
+
+    // Whether the producer (consumer) sleeps, and where it does
+    std::atomic<bool> producerSleeping;
+    std::atomic<bool> consumerSleeping;
+    std::mutex lock;
+    std::condition_variable wake;
+
+public:
+
+    /* Create a ring with room for (at least) the given number of items. */
+    explicit Ring(size_t capacity)
+        : head(0), tail(0), closed(false), cancelled(false), producerSleeping(false), consumerSleeping(false) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    /* Producer: move all items from the given source (a queue) into
+     * the ring, waiting for room when it is full. Returns false if
+     * the consumer has cancelled the ring (the items left in the
+     * source are then not moved). */
+    template <typename Source>
+    bool push(Source &source) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        unsigned spins = 0;
+        while (!source.empty()) {
+            size_t room = slots.size() - (position - head.load(std::memory_order_acquire));
+            if (room == 0) {
+                if (cancelled.load(std::memory_order_relaxed)) return false;
+                if (++spins < SPINS) {
+                    std::this_thread::yield();
+                } else {
+                    sleep(producerSleeping, [&] {
+                        return position - head.load(std::memory_order_acquire) < slots.size() ||
+                               cancelled.load(std::memory_order_relaxed);
+                    });
+                }
+                continue;
+            }
+            spins = 0;
+            for (; room > 0 && !source.empty(); --room, ++position) {
+                slots[position & mask] = source.front();
+                source.pop();
+            }
+            tail.store(position, std::memory_order_release);
+            wakeUp(consumerSleeping);
+        }
+        return !cancelled.load(std::memory_order_relaxed);
+    }
+
+    /* Producer: signal that no more items will be added. */
+    void close() {
+        closed.store(true, std::memory_order_release);
+        wakeUp(consumerSleeping);
+    }
+
+    /* Consumer: move up to 'limit' items into the given output
+     * (a queue), waiting for items when the ring is empty.
+     * Returns false when the ring is closed and empty. */
+    template <typename Output>
+    bool pop(Output &out, size_t limit) {
+        size_t position = head.load(std::memory_order_relaxed);
+        unsigned spins = 0;
+        while (true) {
+            size_t available = tail.load(std::memory_order_acquire) - position;
+            if (available > 0) {
+                if (available > limit) available = limit;
+                for (size_t i = 0; i < available; ++i, ++position) {
+                    out.push(slots[position & mask]);
+                }
+                head.store(position, std::memory_order_release);
+                wakeUp(producerSleeping);
+                return true;
+            }
+            if (closed.load(std::memory_order_acquire)) {
+                // Items may have been added just before closing
+                if (tail.load(std::memory_order_acquire) != position) continue;
+                return false;
+            }
+            if (++spins < SPINS) {
+                std::this_thread::yield();
+            } else {
+                sleep(consumerSleeping, [&] {
+                    return tail.load(std::memory_order_acquire) != position ||
+                           closed.load(std::memory_order_acquire);
+                });
+            }
+        }
+    }
+
+    /* Consumer: signal that no more items are wanted. */
+    void cancel() {
+        cancelled.store(true, std::memory_order_relaxed);
+        wakeUp(producerSleeping);
+    }
+
+private:
+
+    /* Sleep until 'ready' returns true, with the given flag raised. */
+    template <typename Ready>
+    void sleep(std::atomic<bool> &sleeping, Ready ready) {
+        std::unique_lock<std::mutex> guard(lock);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake.wait(guard, ready);
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    /* Wake the other thread, if it sleeps with the given flag raised. */
+    void wakeUp(std::atomic<bool> &sleeping) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> guard(lock);
+            wake.notify_all();
+        }
+    }
+
+};
+
+#endif // RING_H
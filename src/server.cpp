@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "server.h"
+#include "stats.h"
+
+const size_t Server::HIGH_WATER;
+const size_t Server::LOW_WATER;
+const size_t Server::MAX_LINE;
+const size_t Server::READ_SIZE;
+
+namespace {
+
+// The server stopped by SIGINT and SIGTERM (while it is running)
+Server *running = nullptr;
+
+void onSignal(int) {
+    if (running) {
+        running->stop();
+    }
+}
+
+}
+
+Server::Session::Session(int socket, Symbols *sharedSymbols, SharedRegisters *sharedRegisters)
+    : socket(socket), parser(symbols), evaluator(symbols), sent(0), output(pending),
+      events(0), paused(false), ended(false), closing(false), broken(false) {
+    output.setPolicy(FLUSH_FULL);
+    evaluator.setOutput(output);
+    // (With shared registers, the names are interned in the shared
+    // symbols, and otherwise in the session's own)
+    if (sharedSymbols) {
+        symbols.shareNames(*sharedSymbols);
+    }
+    if (sharedRegisters) {
+        evaluator.share(*sharedRegisters);
+    }
+}
+
+Server::Server(const std::string &path, bool shared)
+    : path(path), listener(-1), poller(-1), shared(shared), chunk(new char[READ_SIZE]) {
+    wakeup[0] = -1;
+    wakeup[1] = -1;
+}
+
+#ifdef __linux__
+
+Server::~Server() {
+    for (std::pair<const int, std::unique_ptr<Session>> &entry : sessions) {
+        ::close(entry.first);
+    }
+    sessions.clear();
+    if (listener >= 0) {
+        ::close(listener);
+        unlink(path.c_str());
+    }
+    if (poller >= 0) ::close(poller);
+    if (wakeup[0] >= 0) ::close(wakeup[0]);
+    if (wakeup[1] >= 0) ::close(wakeup[1]);
+}
+
+bool Server::listen() {
+    Output &console = Output::console();
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        console << "Socket path is empty or too long: " << path << '\n';
+        console.sync();
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    sockaddr *generic = reinterpret_cast<sockaddr *>(&address);
+
+    // A socket left over from a server that is gone is replaced, but
+    // not the socket of a server that is still running.
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, generic, sizeof(address)) == 0;
+        if (probe >= 0) ::close(probe);
+        if (live) {
+            console << "Socket is already in use: " << path << '\n';
+            console.sync();
+            return false;
+        }
+        unlink(path.c_str());
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, generic, sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        console << "Could not listen on socket: " << path << " (" << std::strerror(errno) << ")" << '\n';
+        console.sync();
+        if (listener >= 0) {
+            ::close(listener);
+            listener = -1;
+        }
+        return false;
+    }
+
+    poller = epoll_create1(EPOLL_CLOEXEC);
+    if (poller < 0 || pipe2(wakeup, O_NONBLOCK | O_CLOEXEC) != 0) {
+        console << "Could not create the event loop (" << std::strerror(errno) << ")" << '\n';
+        console.sync();
+        return false;
+    }
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+    event.data.fd = wakeup[0];
+    epoll_ctl(poller, EPOLL_CTL_ADD, wakeup[0], &event);
+    return true;
+}
+
+void Server::run() {
+    running = this;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    bool serving = true;
+    while (serving) {
+        int count = epoll_wait(poller, events, MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            int socket = events[i].data.fd;
+            if (socket == wakeup[0]) {
+                serving = false;
+            } else if (socket == listener) {
+                accept();
+            } else {
+                // (The session may already be gone, if an earlier
+                // event of this round closed it)
+                std::unordered_map<int, std::unique_ptr<Session>>::iterator found = sessions.find(socket);
+                if (found != sessions.end()) {
+                    handle(*found->second, events[i].events);
+                }
+            }
+        }
+        Stats::poll();
+    }
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    running = nullptr;
+}
+
+void Server::stop() {
+    // (Only a write, so this is safe in a signal handler)
+    char byte = 0;
+    ssize_t written = ::write(wakeup[1], &byte, 1);
+    (void) written;
+}
+
+void Server::accept() {
+    // Accept until there are no more waiting (or no more descriptors,
+    // in which case the rest wait until a connection is closed)
+    while (true) {
+        int socket = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        std::unique_ptr<Session> session(shared ? new Session(socket, &sharedSymbols, &sharedRegisters)
+                                                : new Session(socket, nullptr, nullptr));
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = socket;
+        if (epoll_ctl(poller, EPOLL_CTL_ADD, socket, &event) != 0) {
+            ::close(socket);
+            continue;
+        }
+        session->events = EPOLLIN;
+        sessions[socket] = std::move(session);
+    }
+}
+
+void Server::handle(Session &session, uint32_t events) {
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        receive(session);
+    }
+    // Execute and send in turns, for as long as the client keeps
+    // taking the output (or there is nothing left to execute)
+    while (!session.broken) {
+        if (!session.paused) {
+            execute(session);
+        }
+        send(session);
+        if (session.paused && session.pending.size() - session.sent < LOW_WATER) {
+            session.paused = false;
+        } else {
+            break;
+        }
+    }
+    update(session);
+}
+
+void Server::receive(Session &session) {
+    if (session.ended || session.paused) {
+        return;
+    }
+    ssize_t received = recv(session.socket, chunk.get(), READ_SIZE, 0);
+    if (received > 0) {
+        session.input.append(chunk.get(), static_cast<size_t>(received));
+    } else if (received == 0) {
+        session.ended = true;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        session.broken = true;
+    }
+}
+
+void Server::execute(Session &session) {
+    // Execute the complete lines, one at a time, like the console does
+    // (their output reaches 'pending' when the buffer of the output is
+    // full, so the backpressure sees it, and all of it at the end)
+    size_t start = 0;
+    while (!session.closing) {
+        if (session.pending.size() - session.sent >= HIGH_WATER) {
+            session.paused = true;
+            break;
+        }
+        size_t end = session.input.find('\n', start);
+        if (end == std::string::npos) {
+            // (After the client is done, the rest is the last line)
+            if (!session.ended || start == session.input.size()) break;
+            end = session.input.size();
+        }
+        char *line = &session.input[0];
+        session.parser.parse(session.instructions, line + start, line + end);
+        if (!session.evaluator.execute(session.instructions)) {
+            session.closing = true;
+        }
+        start = std::min(end + 1, session.input.size());
+    }
+    session.input.erase(0, start);
+
+    if (session.input.size() > MAX_LINE && !session.closing) {
+        session.output << "Input Error: Line is longer than " << static_cast<int64_t>(MAX_LINE) << " bytes." << '\n';
+        session.closing = true;
+    }
+    session.output.flush();
+    if (session.ended && session.input.empty()) {
+        session.closing = true;
+    }
+}
+
+void Server::send(Session &session) {
+    while (session.sent < session.pending.size()) {
+        ssize_t written = ::send(session.socket, session.pending.data() + session.sent,
+                                 session.pending.size() - session.sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                session.broken = true;
+            }
+            break;
+        }
+        session.sent += static_cast<size_t>(written);
+    }
+    // Drop what has been sent (once it is most of the buffer, so the
+    // copying stays linear in the output)
+    if (session.sent == session.pending.size()) {
+        session.pending.clear();
+        session.sent = 0;
+    } else if (session.sent > session.pending.size() / 2) {
+        session.pending.erase(0, session.sent);
+        session.sent = 0;
+    }
+}
+
+void Server::update(Session &session) {
+    bool unsent = session.sent < session.pending.size();
+    if (session.broken || (session.closing && !unsent)) {
+        close(session);
+        return;
+    }
+    uint32_t events = 0;
+    if (!session.ended && !session.closing && !session.paused) {
+        events |= EPOLLIN;
+    }
+    if (unsent) {
+        events |= EPOLLOUT;
+    }
+    if (events != session.events) {
+        epoll_event event;
+        event.events = events;
+        event.data.fd = session.socket;
+        epoll_ctl(poller, EPOLL_CTL_MOD, session.socket, &event);
+        session.events = events;
+    }
+}
+
+void Server::close(Session &session) {
+    int socket = session.socket;
+    epoll_ctl(poller, EPOLL_CTL_DEL, socket, nullptr);
+    ::close(socket);
+    sessions.erase(socket);
+}
+
+#else
+
+Server::~Server() {
+}
+
+bool Server::listen() {
+    Output &console = Output::console();
+    console << "Server mode is only available on Linux." << '\n';
+    console.sync();
+    return false;
+}
+
+void Server::run() {
+}
+
+void Server::stop() {
+}
+
+void Server::accept() {
+}
+
+void Server::handle(Session &, uint32_t) {
+}
+
+void Server::receive(Session &) {
+}
+
+void Server::execute(Session &) {
+}
+
+void Server::send(Session &) {
+}
+
+void Server::update(Session &) {
+}
+
+void Server::close(Session &) {
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "evaluator.h"
+#include "instructions.h"
+#include "output.h"
+#include "parser.h"
+#include "shared.h"
+#include "symbols.h"
+
+/*
+ * This class runs the calculator as a long-lived local service (server
+ * mode, with '--serve <path>'), listening on a Unix domain socket.
+ *
+ * Every connection is a session of its own, with its own symbols,
+ * parser and evaluator, and speaks the same line protocol as the
+ * console: each line that the client sends is parsed and executed on
+ * its own (exactly like a line typed into the calculator), and the
+ * output of the line (the results of its prints, and its errors) is
+ * sent back. A quit instruction ends the session, and the connection
+ * is closed once all of its output has been sent. When the client
+ * closes its end, the last line is executed even if it has no line
+ * break, as at the end of the console input.
+ *   With '--shared', the sessions share their registers instead (see
+ * "shared.h"): every session sees the operations of all sessions, and
+ * the register names are interned in one symbols object. (The error
+ * messages and big literals of a session are still its own, so they go
+ * away with it.)
+ *   All connections are served by one thread, with an epoll event
+ * loop, so thousands of clients only cost their sessions' memory.
+ * The sockets are non-blocking, and each session has backpressure of
+ * its own: when its output that has not been sent yet grows beyond
+ * HIGH_WATER (a client that sends without reading), the session stops
+ * executing lines and reading from its socket, until the output is
+ * down to LOW_WATER again. Lines are limited to MAX_LINE bytes, and a
+ * longer line ends the session with an error.
+ *   The server runs until it receives SIGINT or SIGTERM (or stop() is
+ * called), and then closes all connections and removes the socket.
+ *
+ * Server mode needs epoll, so it is only available on Linux.
+ */
+class Server {
+
+private:
+
+    // Bounds of the output waiting to be sent, for the backpressure
+    static const size_t HIGH_WATER = 1 << 20;
+    static const size_t LOW_WATER = 1 << 16;
+
+    // Longest line accepted, and the most read from a socket at once
+    static const size_t MAX_LINE = 1 << 20;
+    static const size_t READ_SIZE = 1 << 16;
+
+    // A connection, with its calculator session
+    struct Session {
+        int socket;
+        Symbols symbols;
+        Parser parser;
+        Evaluator evaluator;
+        Instructions instructions;
+        std::string input;      // Received, but not yet executed
+        std::string pending;    // Output, not yet sent (from 'sent' on)
+        size_t sent;
+        Output output;          // Appends to 'pending'
+        uint32_t events;        // Events the socket is registered for
+        bool paused;            // Output backed up: no reading or executing
+        bool ended;             // The client closed its end
+        bool closing;           // Close once the output is sent
+        bool broken;            // The connection failed: close it now
+
+        /* Create a session, with its own registers, or with the given
+         * shared register names and registers. */
+        Session(int socket, Symbols *sharedSymbols, SharedRegisters *sharedRegisters);
+    };
+
+    std::string path;
+    int listener;
+    int poller;
+
+    // Pipe waking up the event loop, to stop it
+    int wakeup[2];
+
+    // The sessions, by socket
+    std::unordered_map<int, std::unique_ptr<Session>> sessions;
+
+    // Whether the sessions share their registers, and the register
+    // names and registers they share
+    bool shared;
+    Symbols sharedSymbols;
+    SharedRegisters sharedRegisters;
+
+    // Buffer for reading from the sockets
+    std::unique_ptr<char[]> chunk;
+
+public:
+
+    /* Create a server for the socket at the given path, whose sessions
+     * have their own registers, or share them. */
+    explicit Server(const std::string &path, bool shared = false);
+
+    /* Close all connections, and remove the socket. */
+    ~Server();
+
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    /* Create the listening socket, the epoll instance and the wakeup
+     * pipe (clients can connect from then on). Returns false, after
+     * writing why to the console, if that failed. */
+    bool listen();
+
+    /* Serve the clients until stopped (after listen succeeded). */
+    void run();
+
+    /* Stop the event loop (from any thread, or a signal handler). */
+    void stop();
+
+private:
+
+    /* Accept all waiting connections. */
+    void accept();
+
+    /* Handle the events of the socket of a session. */
+    void handle(Session &session, uint32_t events);
+
+    /* Read what a client has sent (a chunk at a time). */
+    void receive(Session &session);
+
+    /* Execute the complete lines received from a client (as long as
+     * its output is not backed up). */
+    void execute(Session &session);
+
+    /* Send as much of the output to a client as its socket takes. */
+    void send(Session &session);
+
+    /* Register the socket of a session for the events it waits for
+     * now (or close it, if it is done). */
+    void update(Session &session);
+
+    /* Close the connection of a session, and remove the session. */
+    void close(Session &session);
+
+};
+
+#endif // SERVER_H
@@ -0,0 +1,312 @@
+#include <algorithm>
+
+#include "shared.h"
+
+const uint32_t SharedRegisters::FIRST_BLOCK;
+const uint32_t SharedRegisters::MAX_BLOCK;
+const size_t SharedRegisters::FIRST_SEGMENT;
+const unsigned SharedRegisters::SEGMENTS;
+
+SharedRegisters::Block::Block(uint32_t capacity)
+    : entries(new Entry[capacity]), capacity(capacity), used(0), next(nullptr) {
+}
+
+SharedRegisters::Register::Register() : first(nullptr), changed(0), cached(0), last(nullptr) {
+}
+
+SharedRegisters::SharedRegisters() : constantCount(0), version(0), sequence(0) {
+    for (unsigned i = 0; i < SEGMENTS; ++i) {
+        segments[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+SharedRegisters::~SharedRegisters() {
+    for (unsigned i = 0; i < SEGMENTS; ++i) {
+        Register *segment = segments[i].load(std::memory_order_relaxed);
+        if (!segment) continue;
+        for (size_t j = 0; j < (FIRST_SEGMENT << i); ++j) {
+            Block *block = segment[j].first.load(std::memory_order_relaxed);
+            while (block) {
+                Block *next = block->next.load(std::memory_order_relaxed);
+                delete block;
+                block = next;
+            }
+        }
+        delete[] segment;
+    }
+}
+
+void SharedRegisters::append(Operand op, RegisterId reg, ValueKind kind, int64_t value) {
+    std::lock_guard<std::mutex> guard(writing);
+    uint64_t at = version.load(std::memory_order_relaxed) + 1;
+
+    // Record the dependency, for the walks of later changes
+    Register &target = obtain(reg);
+    if (kind == REFERENCE) {
+        Register &used = obtain(static_cast<RegisterId>(value));
+        if (used.users.empty() || used.users.back() != reg) {
+            used.users.push_back(reg);
+        }
+    }
+
+    // Append the operation to the log (readers ignore it until its
+    // version is published)
+    Block *block = target.last;
+    if (block && block->used.load(std::memory_order_relaxed) < block->capacity) {
+        uint32_t index = block->used.load(std::memory_order_relaxed);
+        Entry entry = {at, value, static_cast<uint8_t>(op), static_cast<uint8_t>(kind)};
+        block->entries[index] = entry;
+        block->used.store(index + 1, std::memory_order_release);
+    } else {
+        Block *added = new Block(block ? std::min(block->capacity * 2, MAX_BLOCK) : FIRST_BLOCK);
+        Entry entry = {at, value, static_cast<uint8_t>(op), static_cast<uint8_t>(kind)};
+        added->entries[0] = entry;
+        added->used.store(1, std::memory_order_relaxed);
+        if (block) {
+            block->next.store(added, std::memory_order_release);
+        } else {
+            target.first.store(added, std::memory_order_release);
+        }
+        target.last = added;
+    }
+
+    // Mark what has changed, and publish the version (the sequence is
+    // odd in between, see Reader::evaluate)
+    sequence.fetch_add(1);
+    markChanged(reg, at);
+    version.store(at, std::memory_order_release);
+    sequence.fetch_add(1);
+}
+
+uint32_t SharedRegisters::addConstant(const Number &number) {
+    std::lock_guard<std::mutex> guard(writing);
+    unsigned segment;
+    size_t offset;
+    locate(constantCount, segment, offset);
+    if (!constants[segment]) {
+        constants[segment].reset(new Number[FIRST_SEGMENT << segment]);
+    }
+    constants[segment][offset] = number;
+    return static_cast<uint32_t>(constantCount++);
+}
+
+uint64_t SharedRegisters::published() const {
+    return version.load(std::memory_order_acquire);
+}
+
+void SharedRegisters::markChanged(RegisterId reg, uint64_t at) {
+    // Walk the reverse dependencies from the changed register. The
+    // users of a register that no reader has cached since its last
+    // change are stale already (no reader can have cached them since
+    // either, without caching the register first), so they are skipped.
+    // (Registers reached twice in the walk are already marked.)
+    pending.push_back(reg);
+    while ( !pending.empty() ) {
+        Register &current = *find(pending.back());
+        pending.pop_back();
+
+        uint64_t before = current.changed.load(std::memory_order_relaxed);
+        current.changed.store(at, std::memory_order_relaxed);
+        if (before == at || before > current.cached.load()) continue;
+
+        for (RegisterId user : current.users) {
+            pending.push_back(user);
+        }
+    }
+}
+
+SharedRegisters::Register *SharedRegisters::find(RegisterId reg) const {
+    unsigned segment;
+    size_t offset;
+    locate(reg, segment, offset);
+    Register *registers = segments[segment].load(std::memory_order_acquire);
+    return registers ? registers + offset : nullptr;
+}
+
+SharedRegisters::Register &SharedRegisters::obtain(RegisterId reg) {
+    unsigned segment;
+    size_t offset;
+    locate(reg, segment, offset);
+    Register *registers = segments[segment].load(std::memory_order_relaxed);
+    if (!registers) {
+        registers = new Register[FIRST_SEGMENT << segment];
+        segments[segment].store(registers, std::memory_order_release);
+    }
+    return registers[offset];
+}
+
+const Number &SharedRegisters::constant(uint32_t index) const {
+    unsigned segment;
+    size_t offset;
+    locate(index, segment, offset);
+    return constants[segment][offset];
+}
+
+void SharedRegisters::locate(size_t index, unsigned &segment, size_t &offset) {
+    // Segment k starts at index FIRST_SEGMENT * (2^k - 1)
+    size_t blocks = index / FIRST_SEGMENT + 1;
+    segment = 0;
+    while (blocks >>= 1) {
+        ++segment;
+    }
+    offset = index - FIRST_SEGMENT * ((static_cast<size_t>(1) << segment) - 1);
+}
+
+SharedRegisters::Reader::Reader(SharedRegisters &registers) : registers(registers) {
+}
+
+SharedRegisters::Status SharedRegisters::Reader::evaluate(RegisterId reg, Number &out, RegisterId &failed) {
+    // Read the sequence before the version, so a writer that starts
+    // after this is seen at the end (see below)
+    uint64_t sequence = registers.sequence.load();
+    uint64_t at = registers.version.load(std::memory_order_acquire);
+    reserve(reg);
+    if (isCached(reg, at)) {
+        out = values[reg];
+        return EVALUATED;
+    }
+    if (!isDefined(reg, at)) {
+        failed = reg;
+        return MISSING;
+    }
+
+    // Evaluate the register without recursion, the same way as the
+    // evaluator does (see "evaluator.h"), but reading the logs only
+    // up to the version of this print
+    Status status = EVALUATED;
+    Frame root = {reg, registers.find(reg)->first.load(std::memory_order_acquire), 0, Number()};
+    stack.push_back(std::move(root));
+    active[reg] = 1;
+    while ( !stack.empty() ) {
+        Frame &frame = stack.back();
+        RegisterId blocked;
+        if (!run(frame, at, blocked)) {
+            reserve(blocked);
+            if (!isDefined(blocked, at)) {
+                status = MISSING;
+            } else if (active[blocked]) {
+                status = CYCLE;
+            }
+            if (status != EVALUATED) {
+                failed = blocked;
+                abort();
+                break;
+            }
+            Frame next = {blocked, registers.find(blocked)->first.load(std::memory_order_acquire), 0, Number()};
+            active[blocked] = 1;
+            stack.push_back(std::move(next));  // (invalidates 'frame')
+            continue;
+        }
+        RegisterId done = frame.reg;
+        store(done, frame.value, at);
+        active[done] = 0;
+        stack.pop_back();
+    }
+
+    // The values cached by this print can be reused for later versions
+    // only if no writer was changing the registers meanwhile. (A writer
+    // that started later has seen what this print cached, since the
+    // cached versions were recorded before the sequence is read again.)
+    uint64_t after = registers.sequence.load();
+    if (after == sequence && (sequence & 1) == 0) {
+        for (RegisterId cached : stored) {
+            trusted[cached] = 1;
+        }
+    }
+    stored.clear();
+
+    if (status == EVALUATED) {
+        out = values[reg];
+    }
+    return status;
+}
+
+bool SharedRegisters::Reader::isCached(RegisterId reg, uint64_t at) const {
+    uint64_t cached = versions[reg];
+    if (cached == 0) {
+        return false;
+    }
+    if (cached == at) {
+        return true;
+    }
+    return trusted[reg] && registers.find(reg)->changed.load(std::memory_order_relaxed) <= cached;
+}
+
+bool SharedRegisters::Reader::isDefined(RegisterId reg, uint64_t at) const {
+    const Register *found = registers.find(reg);
+    if (!found) {
+        return false;
+    }
+    const Block *first = found->first.load(std::memory_order_acquire);
+    return first && first->entries[0].version <= at;
+}
+
+void SharedRegisters::Reader::reserve(RegisterId reg) {
+    if (reg < versions.size()) return;
+    size_t size = std::max(static_cast<size_t>(reg) + 1, versions.size() * 2);
+    values.resize(size);
+    versions.resize(size, 0);
+    trusted.resize(size, 0);
+    active.resize(size, 0);
+}
+
+bool SharedRegisters::Reader::run(Frame &frame, uint64_t at, RegisterId &blocked) {
+    while (frame.block) {
+        uint32_t used = frame.block->used.load(std::memory_order_acquire);
+        for (; frame.index < used; ++frame.index) {
+            const Entry &entry = frame.block->entries[frame.index];
+            if (entry.version > at) {
+                // (The rest of the log is newer than this print)
+                frame.block = nullptr;
+                return true;
+            }
+            Operand op = static_cast<Operand>(entry.op);
+            switch (static_cast<ValueKind>(entry.kind)) {
+                case LITERAL:
+                    frame.value.apply(op, Number(entry.value));
+                    break;
+                case BIG_LITERAL:
+                    frame.value.apply(op, registers.constant(static_cast<uint32_t>(entry.value)));
+                    break;
+                case REFERENCE: {
+                    RegisterId used = static_cast<RegisterId>(entry.value);
+                    if (used >= versions.size() || !isCached(used, at)) {
+                        blocked = used;
+                        return false;
+                    }
+                    frame.value.apply(op, values[used]);
+                    break;
+                }
+            }
+        }
+        // A block that is not full is the last one (so far)
+        if (used < frame.block->capacity) {
+            frame.block = nullptr;
+            return true;
+        }
+        frame.block = frame.block->next.load(std::memory_order_acquire);
+        frame.index = 0;
+    }
+    return true;
+}
+
+void SharedRegisters::Reader::store(RegisterId reg, Number &value, uint64_t at) {
+    values[reg] = std::move(value);
+    versions[reg] = at;
+    trusted[reg] = 0;
+    stored.push_back(reg);
+
+    // Record that the register has been cached at this version (before
+    // the sequence is read again, see evaluate)
+    std::atomic<uint64_t> &cached = registers.find(reg)->cached;
+    uint64_t seen = cached.load();
+    while (seen < at && !cached.compare_exchange_weak(seen, at)) {
+    }
+}
+
+void SharedRegisters::Reader::abort() {
+    for (const Frame &frame : stack) {
+        active[frame.reg] = 0;
+    }
+    stack.clear();
+}
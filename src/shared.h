@@ -0,0 +1,220 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "definitions.h"
+#include "number.h"
+
+/*
+ * This class is a register namespace that is shared between several
+ * evaluators, on any number of threads (see Evaluator::share). Writers
+ * add operations to the registers, and readers evaluate the registers
+ * for their prints, and the readers never wait for the writers (or
+ * for each other): reading takes no locks at all.
+ *
+ * Each register keeps a log of its operations, which is only ever
+ * appended to, in blocks that never move. Every operation is stamped
+ * with a version: the writers (one at a time, under a lock that only
+ * the writers take) append the operation with the next version, and
+ * then publish that version. A print first reads the published version,
+ * and evaluates every register it needs with only the operations up to
+ * that version, so it sees one consistent snapshot of all registers,
+ * even while the writers continue: the operations with later versions
+ * are simply ignored. Since nothing is ever removed or moved while the
+ * namespace lives, a reader can never find memory freed under it, and
+ * no reclamation scheme (such as RCU or epochs) is needed; the version
+ * is the epoch.
+ *
+ * Each reader keeps its own cache of register values, each with the
+ * version it was evaluated at. A cached value is always right for the
+ * version it was evaluated at, and it can be reused for later versions
+ * as long as neither the register nor any register it depends on has
+ * changed since then. To know that, the writers keep, for every
+ * register, the version of the last change to it or (transitively)
+ * to any register it depends on, and set it before publishing a new
+ * version, by walking the reverse dependencies from the changed
+ * register (like the invalidation of the evaluator). The walk skips
+ * the users of a register that has not been cached by any reader since
+ * its last change, since they are stale already; for that, the readers
+ * record the latest version at which they cached each register. (A
+ * reader that raced with a writer while caching, which it sees from a
+ * sequence counter that the writers bump around each change, keeps
+ * those values only for their own version.)
+ */
+class SharedRegisters {
+
+private:
+
+    // An operation in the log of a register
+    struct Entry {
+        uint64_t version;
+        int64_t value;
+        uint8_t op;         // Operand
+        uint8_t kind;       // ValueKind
+    };
+
+    // A block of log entries. The first block of a register holds a
+    // few entries, and each following block twice as many, up to
+    // MAX_BLOCK. Readers read the entries below 'used'.
+    struct Block {
+        std::unique_ptr<Entry[]> entries;
+        uint32_t capacity;
+        std::atomic<uint32_t> used;
+        std::atomic<Block *> next;
+
+        explicit Block(uint32_t capacity);
+    };
+    static const uint32_t FIRST_BLOCK = 4;
+    static const uint32_t MAX_BLOCK = 4096;
+
+    // A register: its log, and the versions of its last change (to it
+    // or a register it depends on) and of its last caching by a reader.
+    // The last block and the users (the registers using this one as a
+    // value) are only used by the writers.
+    struct Register {
+        std::atomic<Block *> first;
+        std::atomic<uint64_t> changed;
+        std::atomic<uint64_t> cached;
+        Block *last;
+        std::vector<RegisterId> users;
+
+        Register();
+    };
+
+    // The registers are stored in segments that never move (like the
+    // strings of "stringtable.h"): the first segment holds 1024
+    // registers, and each following segment is twice as large.
+    static const size_t FIRST_SEGMENT = 1024;
+    static const unsigned SEGMENTS = 22;
+    std::atomic<Register *> segments[SEGMENTS];
+
+    // The values of the big literals, stored the same way (the readers
+    // only read those that a published operation refers to)
+    std::unique_ptr<Number[]> constants[SEGMENTS];
+    size_t constantCount;
+
+    // The published version, and the sequence counter of the writers
+    // (odd while a writer is changing the registers)
+    std::atomic<uint64_t> version;
+    std::atomic<uint64_t> sequence;
+
+    // Lock taken by the writers, and the stack of their walks
+    std::mutex writing;
+    std::vector<RegisterId> pending;
+
+public:
+
+    /* Outcome of evaluating a register. */
+    enum Status {EVALUATED, MISSING, CYCLE};
+
+    /*
+     * A reader of the shared registers, with its own cache (so there
+     * is one reader per evaluator, and it is used by one thread only).
+     */
+    class Reader {
+
+    private:
+
+        // A register that is being evaluated: where it stopped in its
+        // log, and the value accumulated so far
+        struct Frame {
+            RegisterId reg;
+            const Block *block;
+            uint32_t index;
+            Number value;
+        };
+
+        SharedRegisters &registers;
+
+        // The cached values, the version each was evaluated at, and
+        // whether it may be reused for later versions
+        std::vector<Number> values;
+        std::vector<uint64_t> versions;
+        std::vector<uint8_t> trusted;
+
+        // Registers being evaluated, and the registers cached during
+        // the current print (kept to reuse their memory)
+        std::vector<uint8_t> active;
+        std::vector<Frame> stack;
+        std::vector<RegisterId> stored;
+
+    public:
+
+        explicit Reader(SharedRegisters &registers);
+
+        /* Evaluate a register, at the latest published version. On
+         * failure, 'failed' is the register that is missing, or that
+         * depends on itself. */
+        Status evaluate(RegisterId reg, Number &out, RegisterId &failed);
+
+    private:
+
+        /* Return whether the cached value of a register can be used
+         * for the given version. */
+        bool isCached(RegisterId reg, uint64_t at) const;
+
+        /* Return whether a register has any operations, at the given
+         * version. */
+        bool isDefined(RegisterId reg, uint64_t at) const;
+
+        /* Make sure the cache has room for the given register. */
+        void reserve(RegisterId reg);
+
+        /* Run the log of a frame from where it stopped, up to the given
+         * version. Returns false if it stopped at a register that is not
+         * cached (its id is then stored in 'blocked'). */
+        bool run(Frame &frame, uint64_t at, RegisterId &blocked);
+
+        /* Store the value of an evaluated register in the cache. */
+        void store(RegisterId reg, Number &value, uint64_t at);
+
+        /* Clear the stack after a failed evaluation. */
+        void abort();
+
+    };
+
+    SharedRegisters();
+    ~SharedRegisters();
+
+    SharedRegisters(const SharedRegisters &) = delete;
+    SharedRegisters &operator=(const SharedRegisters &) = delete;
+
+    /* Add an operation to a register, and publish it (from any thread,
+     * the writers take turns). The value is a literal, a register id,
+     * or the index of a big literal (see addConstant). */
+    void append(Operand op, RegisterId reg, ValueKind kind, int64_t value);
+
+    /* Add the value of a big literal, and return its index. */
+    uint32_t addConstant(const Number &number);
+
+    /* Return the published version (the number of operations added). */
+    uint64_t published() const;
+
+private:
+
+    /* Return a register, or null if its segment has not been created
+     * yet (by a writer). */
+    Register *find(RegisterId reg) const;
+
+    /* Return a register, creating its segment if needed (for writers). */
+    Register &obtain(RegisterId reg);
+
+    /* Return the value of the big literal with the given index. */
+    const Number &constant(uint32_t index) const;
+
+    /* Find the segment, and the offset in it, of an index. */
+    static void locate(size_t index, unsigned &segment, size_t &offset);
+
+    /* Set the version of the last change of a register, and of the
+     * registers using it (for writers). */
+    void markChanged(RegisterId reg, uint64_t at);
+
+};
+
+#endif // SHARED_H
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "snapshot.h"
+#include "mappedfile.h"
+
+const uint32_t Snapshot::VERSION;
+
+namespace {
+
+const char MAGIC[8] = {'R', 'E', 'G', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t ORDER_MARK = 0x01020304;
+
+// The header of a snapshot file
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t names;         // Number of names
+    uint64_t nameBytes;     // Number of characters of all names
+    uint64_t registers;     // Number of registers in the evaluator
+    uint64_t words;         // Number of program words of all registers
+    uint64_t constants;     // Number of big literals
+    uint64_t constantBytes; // Number of digits of all big literals
+    uint64_t wides;         // Number of cached values over 64 bits
+    uint64_t wideBytes;     // Number of digits of all those values
+};
+
+/* Collect numbers as text, for writing: offsets into one block. */
+void addText(const std::string &text, std::vector<uint64_t> &offsets, std::string &chars) {
+    chars += text;
+    offsets.push_back(chars.size());
+}
+
+/* Read the number with the given index from a block of text. */
+bool readNumber(const uint64_t *offsets, const char *chars, uint64_t bytes, uint64_t index, Number &out) {
+    if (offsets[index] > offsets[index + 1] || offsets[index + 1] > bytes) {
+        return false;
+    }
+    return Number::parse(chars + offsets[index], static_cast<size_t>(offsets[index + 1] - offsets[index]), out);
+}
+
+/* Copy the items of the registers of a snapshot, to the ids of their
+ * names in the session (if 'ids' is not null, see Snapshot::load),
+ * with 'fill' for the registers in between. */
+template <typename T>
+void place(const T *items, size_t count, const RegisterId *ids, size_t size, T fill, std::vector<T> &out) {
+    if (!ids) {
+        out.assign(items, items + count);
+        return;
+    }
+    out.assign(size, fill);
+    for (size_t i = 0; i < count; ++i) {
+        out[ids[i]] = items[i];
+    }
+}
+
+/* Round up to a multiple of 8 bytes. */
+size_t aligned(size_t bytes) {
+    return (bytes + 7) & ~size_t(7);
+}
+
+/* Write an array, padded to a multiple of 8 bytes. */
+template <typename T>
+void writeArray(std::ostream &out, const T *data, size_t count) {
+    static const char padding[8] = {0};
+    size_t bytes = count * sizeof(T);
+    out.write(reinterpret_cast<const char *>(data), bytes);
+    out.write(padding, aligned(bytes) - bytes);
+}
+
+/* Reads the arrays of a mapped snapshot, checking that they fit. */
+class Reader {
+private:
+    const char *cursor;
+    const char *end;
+public:
+    Reader(const char *begin, const char *end) : cursor(begin), end(end) {}
+
+    /* Return the next array of 'count' items, or null if the file
+     * is too short. */
+    template <typename T>
+    const T *array(uint64_t count) {
+        if (count > static_cast<uint64_t>(end - cursor) / sizeof(T)) return nullptr;
+        size_t bytes = aligned(static_cast<size_t>(count) * sizeof(T));
+        if (bytes > static_cast<size_t>(end - cursor)) return nullptr;
+        const T *data = reinterpret_cast<const T *>(cursor);
+        cursor += bytes;
+        return data;
+    }
+};
+
+}
+
+bool Snapshot::save(const std::string &filename, const Symbols &symbols, const Evaluator &evaluator) {
+    const Evaluator::SymbolTable &registers = evaluator.registers;
+    size_t count = registers.counts.size();
+
+    // The names, as offsets into one block of characters
+    std::vector<uint64_t> nameOffsets(1, 0);
+    std::string nameChars;
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        addText(symbols.name(static_cast<RegisterId>(i)), nameOffsets, nameChars);
+    }
+
+    // The big numbers, in decimal
+    std::vector<uint64_t> constantOffsets(1, 0);
+    std::string constantChars;
+    for (const Number &number : evaluator.constants) {
+        addText(number.str(), constantOffsets, constantChars);
+    }
+    std::vector<RegisterId> wideRegisters;
+    std::vector<uint64_t> wideOffsets(1, 0);
+    std::string wideChars;
+    for (size_t i = 0; i < count; ++i) {
+        if (registers.cached[i] == EVALUATED_WIDE) {
+            wideRegisters.push_back(static_cast<RegisterId>(i));
+            addText(registers.wideValues[i]->str(), wideOffsets, wideChars);
+        }
+    }
+
+    // The programs, with their opcodes as numbers
+    std::vector<uint64_t> programStarts(1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        programStarts.push_back(programStarts.back() + registers.programs[i].size());
+    }
+    std::vector<uint64_t> words(programStarts.back());
+    for (size_t i = 0; i < count; ++i) {
+        Bytecode::store(registers.programs[i], words.data() + programStarts[i]);
+    }
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = ORDER_MARK;
+    header.names = symbols.size();
+    header.nameBytes = nameChars.size();
+    header.registers = count;
+    header.words = words.size();
+    header.constants = evaluator.constants.size();
+    header.constantBytes = constantChars.size();
+    header.wides = wideRegisters.size();
+    header.wideBytes = wideChars.size();
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    writeArray(out, &header, 1);
+    writeArray(out, nameOffsets.data(), nameOffsets.size());
+    writeArray(out, nameChars.data(), nameChars.size());
+    writeArray(out, registers.counts.data(), count);
+    writeArray(out, registers.values.data(), count);
+    writeArray(out, registers.cached.data(), count);
+    writeArray(out, programStarts.data(), programStarts.size());
+    writeArray(out, words.data(), words.size());
+    writeArray(out, constantOffsets.data(), constantOffsets.size());
+    writeArray(out, constantChars.data(), constantChars.size());
+    writeArray(out, wideRegisters.data(), wideRegisters.size());
+    writeArray(out, wideOffsets.data(), wideOffsets.size());
+    writeArray(out, wideChars.data(), wideChars.size());
+    out.close();
+    return static_cast<bool>(out);
+}
+
+bool Snapshot::load(const std::string &filename, Symbols &symbols, Evaluator &evaluator) {
+    Evaluator::SymbolTable &registers = evaluator.registers;
+    Evaluator::Edges &edges = evaluator.edges;
+
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    Reader reader(file.begin(), file.end());
+
+    // Check the header
+    const Header *header = reader.array<Header>(1);
+    if (!header || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header->version != VERSION || header->byteOrder != ORDER_MARK ||
+        header->registers > header->names) {
+        return false;
+    }
+    uint64_t count = header->registers;
+    const Evaluator::Index NONE = Evaluator::NONE;
+
+    // Locate all arrays
+    const uint64_t *nameOffsets = reader.array<uint64_t>(header->names + 1);
+    const char *nameChars = reader.array<char>(header->nameBytes);
+    const uint64_t *counts = reader.array<uint64_t>(count);
+    const int64_t *values = reader.array<int64_t>(count);
+    const uint8_t *cached = reader.array<uint8_t>(count);
+    const uint64_t *programStarts = reader.array<uint64_t>(count + 1);
+    const uint64_t *words = reader.array<uint64_t>(header->words);
+    const uint64_t *constantOffsets = reader.array<uint64_t>(header->constants + 1);
+    const char *constantChars = reader.array<char>(header->constantBytes);
+    const RegisterId *wideRegisters = reader.array<RegisterId>(header->wides);
+    const uint64_t *wideOffsets = reader.array<uint64_t>(header->wides + 1);
+    const char *wideChars = reader.array<char>(header->wideBytes);
+    if (!nameOffsets || !nameChars || !counts || !values || !cached || !programStarts ||
+        !words || !constantOffsets || !constantChars || !wideRegisters || !wideOffsets || !wideChars) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        if (cached[i] > EVALUATED_WIDE) return false;
+    }
+
+    // Read the big numbers
+    std::vector<Number> constants(static_cast<size_t>(header->constants));
+    for (uint64_t i = 0; i < header->constants; ++i) {
+        if (!readNumber(constantOffsets, constantChars, header->constantBytes, i, constants[i])) {
+            return false;
+        }
+    }
+    // (Each register with a cached value over 64 bits has one)
+    std::vector<Number> wides(static_cast<size_t>(header->wides));
+    std::vector<uint8_t> hasWide(static_cast<size_t>(count), 0);
+    for (uint64_t i = 0; i < header->wides; ++i) {
+        RegisterId reg = wideRegisters[i];
+        if (reg >= count || cached[reg] != EVALUATED_WIDE || hasWide[reg]++ ||
+            !readNumber(wideOffsets, wideChars, header->wideBytes, i, wides[i])) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        if (cached[i] == EVALUATED_WIDE && !hasWide[i]) return false;
+    }
+
+    // Intern the names. A session that named its registers in the same
+    // order (such as a new one, or the one that saved the snapshot) has
+    // the same ids; otherwise the registers are moved to the ids of
+    // their names in this session. (This is the only step that changes
+    // the session before the end, and it only adds names.)
+    std::vector<RegisterId> ids(static_cast<size_t>(header->names));
+    bool same = true;
+    for (uint64_t i = 0; i < header->names; ++i) {
+        if (nameOffsets[i] > nameOffsets[i + 1] || nameOffsets[i + 1] > header->nameBytes) {
+            return false;
+        }
+        size_t length = static_cast<size_t>(nameOffsets[i + 1] - nameOffsets[i]);
+        ids[i] = symbols.intern(nameChars + nameOffsets[i], length);
+        same = same && ids[i] == i;
+    }
+    const RegisterId *translate = same ? nullptr : ids.data();
+    size_t size = static_cast<size_t>(count);
+    if (!same) {
+        // (A name that is in the file twice would merge two registers)
+        std::vector<uint8_t> taken(symbols.size(), 0);
+        size = 0;
+        for (uint64_t i = 0; i < header->names; ++i) {
+            if (taken[ids[i]]++) return false;
+            if (i < count) size = std::max(size, static_cast<size_t>(ids[i]) + 1);
+        }
+    }
+
+    // Translate the programs (a register has a program if and only if
+    // it has operations), and collect the registers they read, for the
+    // dependency graph. (A cached register only reads cached ones,
+    // which invalidating the registers relies on.)
+    std::vector<Program> programs(size);
+    std::vector<uint8_t> states;
+    place(cached, size_t(count), translate, size, uint8_t(NOT_EVALUATED), states);
+    std::vector<std::pair<RegisterId, RegisterId>> dependencies;
+    std::vector<RegisterId> reads;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t start = programStarts[i];
+        uint64_t stop = programStarts[i + 1];
+        RegisterId reg = same ? static_cast<RegisterId>(i) : ids[i];
+        if (start > stop || stop > header->words || (start == stop) != (counts[i] == 0) ||
+            !Bytecode::load(words + start, static_cast<size_t>(stop - start), static_cast<size_t>(count),
+                            constants.size(), translate, programs[reg])) {
+            return false;
+        }
+        reads.clear();
+        Bytecode::references(programs[reg], reads);
+        for (RegisterId used : reads) {
+            if (states[reg] != NOT_EVALUATED && states[used] == NOT_EVALUATED) return false;
+            dependencies.push_back(std::make_pair(reg, used));
+        }
+    }
+
+    // Replace the registers and the dependency graph of the session
+    place(counts, size_t(count), translate, size, uint64_t(0), registers.counts);
+    place(values, size_t(count), translate, size, int64_t(0), registers.values);
+    registers.cached.swap(states);
+    registers.active.assign(size, 0);
+    registers.programs.swap(programs);
+    registers.wideValues.clear();
+    registers.wideValues.resize(size);
+    for (uint64_t i = 0; i < header->wides; ++i) {
+        RegisterId reg = same ? wideRegisters[i] : ids[wideRegisters[i]];
+        registers.wideValues[reg].reset(new Number(std::move(wides[i])));
+    }
+    evaluator.constants.swap(constants);
+
+    // Build the dependency graph from the programs (it is not stored,
+    // so it always agrees with them)
+    registers.users.assign(size, NONE);
+    registers.uses.assign(size, NONE);
+    edges.targets.clear();
+    edges.next.clear();
+    for (const std::pair<RegisterId, RegisterId> &dependency : dependencies) {
+        evaluator.addDependency(dependency.first, dependency.second);
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+
+#include "symbols.h"
+#include "evaluator.h"
+
+/*
+ * This class saves the state of a calculator session (the register
+ * names, and the registers of the evaluator) to a binary snapshot
+ * file, and restores it, so a session can start where an earlier
+ * one stopped without replaying its input. This is done with the
+ * '--save-snapshot' and '--load-snapshot' options (when the session
+ * ends, and before it starts), or anywhere in the input with the
+ * commands 'save <file>' and 'restore <file>'. (The file name is a
+ * token, so it cannot contain whitespace, but it keeps its case.)
+ *
+ * The snapshot holds the state itself, not the history: the compiled
+ * program of each register (in which runs of constant operations are
+ * already folded, see "bytecode.h") and the cached values, so a
+ * restored session does not even have to evaluate the registers that
+ * were cached when the snapshot was saved.
+ *
+ * The file is a header followed by flat arrays, each starting at a
+ * multiple of 8 bytes, in the native byte order:
+ *     header       magic "REGSNAP", version, byte order mark, sizes
+ *     names        offsets (names + 1) and characters of the names
+ *     registers    operation counts, values, cached flags,
+ *                  program starts (registers + 1) and program words
+ *     numbers      offsets and digits of the big literals, and the
+ *                  registers, offsets and digits of the cached values
+ *                  that do not fit in 64 bits (see "number.h")
+ * The file is mapped into memory (see "mappedfile.h") and the arrays
+ * are copied straight into the evaluator, so loading does no parsing
+ * (other than of the big numbers): the work per entry is interning
+ * the names and translating the opcodes of the programs (which are
+ * stored as numbers). The cost of loading is thus proportional to the
+ * size of the state, and not to the length of the history, but it is
+ * paid up front: the registers are not materialized lazily from the
+ * mapping, since the evaluator grows and changes its arrays in place.
+ * The arrays are checked, so a damaged file is rejected instead of
+ * loaded: the sizes and offsets must fit in the file, the programs must
+ * be well formed (and a register has one if and only if it has
+ * operations), and a cached register must only read cached ones. The
+ * dependency graph is not in the file, but built again from the
+ * registers the programs read, so it always agrees with them.
+ *   Restoring replaces all registers of the session. The names of the
+ * snapshot that the session does not have yet are interned; when the
+ * session named its registers in another order than the one that saved
+ * the snapshot, the registers are moved to the ids of their names.
+ *   A file with another version number (or byte order) is rejected;
+ * the version is increased whenever the format changes.
+ */
+class Snapshot {
+
+public:
+
+    // Version of the snapshot format
+    static const uint32_t VERSION = 3;
+
+    /* Save the state of the session to the given file. Returns false
+     * if the file could not be written. */
+    static bool save(const std::string &filename, const Symbols &symbols, const Evaluator &evaluator);
+
+    /* Restore the state of a session from the given file, replacing
+     * its registers. Returns false if the file could not be read, or
+     * is not a valid snapshot (the registers are then unchanged,
+     * though some of the names may have been interned). The names
+     * must not be interned by another thread meanwhile. */
+    static bool load(const std::string &filename, Symbols &symbols, Evaluator &evaluator);
+
+};
+
+#endif // SNAPSHOT_H
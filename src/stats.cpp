@@ -0,0 +1,154 @@
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "stats.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// The counters of one thread. Only the owning thread writes them,
+// but a report may read them from another thread, hence the atomics.
+struct Block {
+    std::atomic<uint64_t> values[Stats::COUNTERS];
+    Block() {
+        for (std::atomic<uint64_t> &value : values) value.store(0);
+    }
+};
+
+// All blocks ever created (they are kept after their thread ends)
+std::mutex registryLock;
+std::vector<std::unique_ptr<Block>> &registry() {
+    static std::vector<std::unique_ptr<Block>> blocks;
+    return blocks;
+}
+
+// The block of the current thread
+thread_local Block *localBlock = nullptr;
+
+Block &currentBlock() {
+    if (!localBlock) {
+        std::lock_guard<std::mutex> guard(registryLock);
+        registry().emplace_back(new Block());
+        localBlock = registry().back().get();
+    }
+    return *localBlock;
+}
+
+// Reporting state
+bool enabled = false;
+Stats::Format reportFormat = Stats::TEXT;
+volatile std::sig_atomic_t requested = 0;
+
+void onSignal(int) {
+    requested = 1;
+}
+
+// Names of the counters, as used in the reports
+const char *const counterNames[Stats::COUNTERS] = {
+    "tokens", "instructions", "prints", "evaluations", "registers_evaluated",
+    "lookups", "cache_hits", "symbols", "operations", "output_writes",
+    "read_seconds", "parse_seconds", "evaluate_seconds"
+};
+
+bool isTime(int counter) {
+    return counter >= Stats::READ_TIME;
+}
+
+/* Current and peak resident memory of the process, in kilobytes. */
+void memoryUse(long &current, long &peak) {
+    current = 0;
+    peak = 0;
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peak = usage.ru_maxrss;
+    }
+    std::ifstream statm("/proc/self/statm");
+    long size, resident;
+    if (statm >> size >> resident) {
+        current = resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+#endif
+}
+
+}
+
+namespace Stats {
+
+void add(Counter counter, uint64_t amount) {
+    std::atomic<uint64_t> &value = currentBlock().values[counter];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+uint64_t total(Counter counter) {
+    std::lock_guard<std::mutex> guard(registryLock);
+    uint64_t sum = 0;
+    for (const std::unique_ptr<Block> &block : registry()) {
+        sum += block->values[counter].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void report(std::ostream &out, Format format) {
+    long current, peak;
+    memoryUse(current, peak);
+
+    if (format == JSON) {
+        out << "{";
+        for (int counter = 0; counter < COUNTERS; ++counter) {
+            out << "\"" << counterNames[counter] << "\":";
+            if (isTime(counter)) {
+                out << total(static_cast<Counter>(counter)) / 1e9;
+            } else {
+                out << total(static_cast<Counter>(counter));
+            }
+            out << ",";
+        }
+        out << "\"memory_kb\":" << current << ",\"peak_memory_kb\":" << peak << "}" << std::endl;
+        return;
+    }
+
+    out << "Statistics:" << std::endl;
+    for (int counter = 0; counter < COUNTERS; ++counter) {
+        std::string name = counterNames[counter];
+        out << "  " << name << std::string(name.size() < 20 ? 20 - name.size() : 1, ' ');
+        if (isTime(counter)) {
+            out << total(static_cast<Counter>(counter)) / 1e9 << std::endl;
+        } else {
+            out << total(static_cast<Counter>(counter)) << std::endl;
+        }
+    }
+    out << "  memory_kb           " << current << std::endl;
+    out << "  peak_memory_kb      " << peak << std::endl;
+}
+
+void enable(Format format) {
+    enabled = true;
+    reportFormat = format;
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, onSignal);
+#endif
+}
+
+void reportAtExit() {
+    if (enabled) {
+        report(std::cerr, reportFormat);
+    }
+}
+
+void poll() {
+    if (enabled && requested) {
+        requested = 0;
+        report(std::cerr, reportFormat);
+    }
+}
+
+}
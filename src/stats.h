@@ -0,0 +1,88 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+/*
+ * This file contains the runtime statistics of the calculator.
+ *
+ * The statistics are a fixed set of counters: counts of what the
+ * parser and evaluator have done, and the time spent in each phase
+ * (in nanoseconds). The counters are always kept, and are cheap
+ * enough for that: every thread has its own block of counters, so
+ * counting never takes a lock or an atomic read-modify-write (only
+ * a relaxed load and store of a counter that no other thread writes).
+ * The hot loops (like the lexer and the interpreter) count in local
+ * variables, and add their counts once per call. For the same reason
+ * the lexer has no time of its own: it runs a token at a time within
+ * the parser, and reading the clock per token would cost about as much
+ * as lexing the token, so lexing is timed as part of parsing.
+ *   A report adds up the blocks of all threads (including threads
+ * that have finished), and writes the totals as plain text or JSON,
+ * together with the memory use of the process.
+ *
+ * When enabled (with the '--stats' option), a report is written to
+ * stderr when the calculator exits, and on demand, when the process
+ * receives the SIGUSR1 signal (the report is then written the next
+ * time the calculator checks for it, between lines or batches).
+ */
+namespace Stats {
+
+/* The counters. */
+enum Counter {
+    TOKENS,                 // Tokens lexed
+    INSTRUCTIONS,           // Instructions parsed
+    PRINTS,                 // Print instructions executed
+    EVALUATIONS,            // Calls to evaluateValue
+    REGISTERS_EVALUATED,    // Register programs run to the end
+    LOOKUPS,                // Registers read by the programs
+    CACHE_HITS,             // Register values found in the cache
+    NAMES,                  // Register names interned (symbol table size)
+    OPERATIONS,             // Operations added to registers
+    OUTPUT_WRITES,          // Buffers written to the output
+    READ_TIME,              // Nanoseconds spent reading or mapping input
+    PARSE_TIME,             // Nanoseconds spent lexing and parsing
+    EVALUATE_TIME,          // Nanoseconds spent executing instructions
+    COUNTERS                // (Number of counters)
+};
+
+/* Report formats. */
+enum Format {TEXT, JSON};
+
+/* Add to a counter, of the current thread. */
+void add(Counter counter, uint64_t amount = 1);
+
+/* Return the total of a counter, over all threads. */
+uint64_t total(Counter counter);
+
+/* Write a report of all counters, and the memory use. */
+void report(std::ostream &out, Format format);
+
+/* Enable reporting (at exit, and on SIGUSR1) in the given format. */
+void enable(Format format);
+
+/* Write the exit report, if reporting is enabled. */
+void reportAtExit();
+
+/* Write a report, if reporting is enabled and one has been
+ * requested with SIGUSR1 since the last check. */
+void poll();
+
+/* Adds the time from its creation to its destruction to a counter. */
+class Timer {
+private:
+    Counter counter;
+    std::chrono::steady_clock::time_point start;
+public:
+    explicit Timer(Counter counter) : counter(counter), start(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+        add(counter, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+};
+
+}
+
+#endif // STATS_H
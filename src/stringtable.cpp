@@ -0,0 +1,42 @@
+#include "stringtable.h"
+
+const size_t StringTable::FIRST_SEGMENT;
+const unsigned StringTable::SEGMENTS;
+
+StringTable::StringTable() : count(0) {
+}
+
+uint32_t StringTable::push(const std::string &text) {
+    unsigned segment;
+    size_t offset;
+    locate(count, segment, offset);
+    if (!segments[segment]) {
+        segments[segment].reset(new std::string[FIRST_SEGMENT << segment]);
+    }
+    segments[segment][offset] = text;
+    return static_cast<uint32_t>(count++);
+}
+
+const std::string &StringTable::operator[](uint32_t index) const {
+    unsigned segment;
+    size_t offset;
+    locate(index, segment, offset);
+    return segments[segment][offset];
+}
+
+void StringTable::replace(uint32_t index, std::string text) {
+    unsigned segment;
+    size_t offset;
+    locate(index, segment, offset);
+    segments[segment][offset].swap(text);
+}
+
+void StringTable::locate(size_t index, unsigned &segment, size_t &offset) {
+    // Segment k starts at index FIRST_SEGMENT * (2^k - 1)
+    size_t blocks = index / FIRST_SEGMENT + 1;
+    segment = 0;
+    while (blocks >>= 1) {
+        ++segment;
+    }
+    offset = index - FIRST_SEGMENT * ((static_cast<size_t>(1) << segment) - 1);
+}
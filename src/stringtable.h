@@ -0,0 +1,59 @@
+#ifndef STRINGTABLE_H
+#define STRINGTABLE_H
+
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * This class is an append-only table of strings, indexed by the
+ * order they were added in.
+ *
+ * The strings are stored in segments that never move: the first
+ * segment holds 1024 strings, and each following segment is twice
+ * as large as the one before it. Adding strings never moves the
+ * strings that are already in the table, so one thread can keep
+ * adding strings while another thread reads strings it has been
+ * handed the index of (as long as the index was handed over with
+ * proper synchronization, such as through the instruction ring).
+ */
+class StringTable {
+
+private:
+
+    // Number of strings in the first segment, and number of segments
+    static const size_t FIRST_SEGMENT = 1024;
+    static const unsigned SEGMENTS = 32;
+
+    // The segments (allocated when first needed)
+    std::unique_ptr<std::string[]> segments[SEGMENTS];
+
+    // Number of strings in the table
+    size_t count;
+
+public:
+
+    StringTable();
+
+    /* Add a string to the table, and return its index. */
+    uint32_t push(const std::string &text);
+
+    /* Return the string with the given index. */
+    const std::string &operator[](uint32_t index) const;
+
+    /* Replace the string with the given index (freeing the memory of
+     * the old one). No other thread may read that string meanwhile. */
+    void replace(uint32_t index, std::string text);
+
+    /* Return the number of strings in the table. */
+    size_t size() const { return count; }
+
+private:
+
+    /* Find the segment, and the offset in it, of an index. */
+    static void locate(size_t index, unsigned &segment, size_t &offset);
+
+};
+
+#endif // STRINGTABLE_H
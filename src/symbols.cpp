@@ -0,0 +1,81 @@
+#include "symbols.h"
+#include "stats.h"
+
+RegisterId Symbols::intern(const std::string &name) {
+    if (owner != this) {
+        return owner->intern(name);
+    }
+
+    // Look the name up, and if it is not there, add it
+    // with the next free id.
+    std::unordered_map<std::string, RegisterId>::iterator found = ids.find(name);
+    if (found != ids.end()) {
+        return found->second;
+    }
+    RegisterId id = names.push(name);
+    ids.emplace(name, id);
+    if (counted) {
+        Stats::add(Stats::NAMES);
+    }
+    return id;
+}
+
+RegisterId Symbols::intern(const char *text, size_t length) {
+    // Copy the name into the reused key, so that looking up
+    // names that are already interned does not allocate.
+    key.assign(text, length);
+    return intern(key);
+}
+
+bool Symbols::find(const std::string &name, RegisterId &out) const {
+    if (owner != this) {
+        return owner->find(name, out);
+    }
+    std::unordered_map<std::string, RegisterId>::const_iterator found = ids.find(name);
+    if (found == ids.end()) {
+        return false;
+    }
+    out = found->second;
+    return true;
+}
+
+const std::string &Symbols::name(RegisterId id) const {
+    return owner->names[id];
+}
+
+size_t Symbols::size() const {
+    return owner->names.size();
+}
+
+uint32_t Symbols::addMessage(const std::string &message) {
+    // Reuse the index of a released message if there is one
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(releasedLock);
+        if (released.empty()) {
+            return messages.push(message);
+        }
+        index = released.back();
+        released.pop_back();
+    }
+    messages.replace(index, message);
+    return index;
+}
+
+const std::string &Symbols::message(uint32_t index) const {
+    return messages[index];
+}
+
+void Symbols::releaseMessage(uint32_t index) const {
+    // (Its text is freed when it is reused, by the parser thread)
+    std::lock_guard<std::mutex> lock(releasedLock);
+    released.push_back(index);
+}
+
+uint32_t Symbols::addNumber(const char *text, size_t length) {
+    return numbers.push(std::string(text, length));
+}
+
+const std::string &Symbols::number(uint32_t index) const {
+    return numbers[index];
+}
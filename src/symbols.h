@@ -0,0 +1,131 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "definitions.h"
+#include "stringtable.h"
+
+/*
+ * This class interns register names into dense integer ids.
+ *
+ * The parser interns every register name it reads, and passes
+ * only the ids on to the evaluator. This way the evaluator never
+ * has to hash or compare strings when evaluating registers, and
+ * can keep all per-register information in plain arrays indexed
+ * by the register id.
+ *   The ids are handed out in the order the names are first
+ * seen, starting from zero. The same name always maps to the
+ * same id, for the lifetime of the symbols object.
+ *   The names are kept so that the id can be turned back into
+ * a name, which is needed for error messages.
+ *
+ * The symbols object also holds the digits of the numeric literals
+ * that do not fit in 64 bits (which are rare), so that the parser
+ * can pass them on to the evaluator by index, like the registers.
+ *
+ * The symbols object also holds the text of the syntax error
+ * messages of the parser (and the file names of the save and restore
+ * instructions, see "snapshot.h"). These are passed to the evaluator as
+ * instructions (referring to the message by its index), so that
+ * they are printed in order with the output of the evaluator. Once
+ * printed, a message is released, and its index is reused for a
+ * later one, so the messages only take the memory of those that are
+ * on their way to the evaluator (however many errors the input has).
+ *
+ * A symbols object can also intern its names in another one (for the
+ * sessions of a server that share their registers), while keeping
+ * its own messages and big literals, which then go away with it.
+ *
+ * The names and messages are kept in string tables that never
+ * move their strings (see "stringtable.h"), so the evaluator
+ * can read them from another thread while the parser adds new
+ * ones. (Interning itself is only done by the parser thread.)
+ */
+class Symbols {
+
+private:
+
+    // Symbols object the names are interned in (this one, unless the
+    // names are shared with another one)
+    Symbols *owner;
+
+    // Hash map from register names to their ids
+    std::unordered_map<std::string, RegisterId> ids;
+
+    // Register names, indexed by their ids
+    StringTable names;
+
+    // Error messages, and the indexes of the released ones (which the
+    // evaluator adds to while the parser takes them, under the lock;
+    // releasing is the only change the evaluator makes to the symbols,
+    // so they are mutable)
+    StringTable messages;
+    mutable std::vector<uint32_t> released;
+    mutable std::mutex releasedLock;
+
+    // Digits of the big literals, indexed by the order they were added in
+    StringTable numbers;
+
+    // Reused key for looking up names given as character ranges
+    std::string key;
+
+    // Whether the interned names are counted in the statistics
+    bool counted;
+
+public:
+
+    /* Create an empty symbols object. The names of a temporary one
+     * (such as for a chunk of a parallel parse, see "parallelparser.h")
+     * are not counted in the statistics, since they are interned again. */
+    explicit Symbols(bool counted = true) : owner(this), counted(counted) {}
+
+    Symbols(const Symbols &) = delete;
+    Symbols &operator=(const Symbols &) = delete;
+
+    /* Intern the names in the given symbols object from now on (keeping
+     * only the messages and big literals in this one). This must be
+     * done before any name is interned. */
+    void shareNames(Symbols &names) { owner = &names; }
+
+    /* Return the id of the given register name. If the
+     * name has not been seen before, it is given the next
+     * free id. */
+    RegisterId intern(const std::string &name);
+
+    /* Same as above, for a name given as a character range
+     * (such as a token). */
+    RegisterId intern(const char *text, size_t length);
+
+    /* Look up the id of the given register name, without interning
+     * it. Returns false if the name has not been seen. */
+    bool find(const std::string &name, RegisterId &out) const;
+
+    /* Return the name of the register with the given id. */
+    const std::string &name(RegisterId id) const;
+
+    /* Return the number of interned names. */
+    size_t size() const;
+
+    /* Add an error message, and return its index. */
+    uint32_t addMessage(const std::string &message);
+
+    /* Return the error message with the given index. */
+    const std::string &message(uint32_t index) const;
+
+    /* Release the error message with the given index, once it has
+     * been printed, so that its index can be reused. */
+    void releaseMessage(uint32_t index) const;
+
+    /* Add the digits of a big literal, and return its index. */
+    uint32_t addNumber(const char *text, size_t length);
+
+    /* Return the digits of the big literal with the given index. */
+    const std::string &number(uint32_t index) const;
+
+};
+
+#endif // SYMBOLS_H
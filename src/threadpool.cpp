@@ -0,0 +1,123 @@
+#include "threadpool.h"
+
+namespace {
+
+// Index of the worker running on the current thread
+thread_local unsigned currentWorker = 0;
+
+}
+
+ThreadPool::ThreadPool(unsigned workers)
+    : function(nullptr), context(nullptr), pending(0), generation(0), stopping(false) {
+    if (workers == 0) workers = 1;
+    for (unsigned i = 0; i < workers; ++i) {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (unsigned i = 1; i < workers; ++i) {
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(queues.size());
+}
+
+void ThreadPool::run(Function function, void *context, const std::vector<uint32_t> &items) {
+    if (items.empty()) return;
+
+    // Deal the initial items out to the queues, and start the job
+    this->function = function;
+    this->context = context;
+    pending.store(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        Queue &queue = *queues[i % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.items.push_back(items[i]);
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ++generation;
+    }
+    wakeup.notify_all();
+
+    // Work on the job as worker 0, until all tasks are done.
+    // (The calling thread may itself be a worker of another pool.)
+    unsigned outerWorker = currentWorker;
+    currentWorker = 0;
+    work(0);
+    while (pending.load() != 0) {
+        std::this_thread::yield();
+    }
+    currentWorker = outerWorker;
+}
+
+void ThreadPool::spawn(uint32_t item) {
+    pending.fetch_add(1);
+    Queue &queue = *queues[currentWorker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.items.push_back(item);
+}
+
+void ThreadPool::workerLoop(unsigned worker) {
+    currentWorker = worker;
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeup.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        work(worker);
+    }
+}
+
+void ThreadPool::work(unsigned worker) {
+    // Run tasks while there are any left. A worker that finds all
+    // queues empty keeps looking as long as other workers are still
+    // running tasks, since those may spawn new ones.
+    uint32_t item;
+    while (pending.load() != 0) {
+        if (take(worker, item)) {
+            function(context, item);
+            pending.fetch_sub(1);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ThreadPool::take(unsigned worker, uint32_t &item) {
+    // Newest task from the own queue
+    {
+        Queue &queue = *queues[worker];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.items.empty()) {
+            item = queue.items.back();
+            queue.items.pop_back();
+            return true;
+        }
+    }
+    // Oldest task from one of the other queues
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue &queue = *queues[(worker + offset) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.items.empty()) {
+            item = queue.items.front();
+            queue.items.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,97 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * This class is a work-stealing thread pool, for running jobs made
+ * up of many small tasks that may spawn more tasks.
+ *
+ * A task is just an integer item, handed to the function of the job
+ * that is running (together with a context pointer), so running a
+ * task never allocates. Each worker has its own double-ended queue
+ * of tasks. Tasks spawned by a worker go onto its own queue, and
+ * are taken from the back (most recently spawned first, which keeps
+ * related work on the same core). A worker that runs out of tasks
+ * steals from the front of the other workers' queues.
+ *
+ * The thread calling run() takes part as one of the workers, so a
+ * pool with one thread simply runs the job on the calling thread.
+ * The other threads sleep while no job is running.
+ */
+class ThreadPool {
+
+public:
+
+    // Function that runs a task, given the job context and the task item
+    typedef void (*Function)(void *context, uint32_t item);
+
+private:
+
+    // Queue of tasks, owned by one worker
+    struct Queue {
+        std::mutex lock;
+        std::deque<uint32_t> items;
+    };
+
+    // One queue for each worker (the calling thread being worker 0)
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    // The running job
+    Function function;
+    void *context;
+
+    // Number of spawned tasks that have not finished yet
+    std::atomic<size_t> pending;
+
+    // Wakes up the sleeping workers when a job starts (or the pool stops)
+    std::mutex lock;
+    std::condition_variable wakeup;
+    uint64_t generation;
+    bool stopping;
+
+public:
+
+    /* Create a pool with the given number of workers (including
+     * the thread calling run()). */
+    ThreadPool(unsigned workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /* Return the number of workers. */
+    unsigned size() const;
+
+    /* Run a job: the given function is called for each of the
+     * initial items, and for each item spawned by the tasks.
+     * Returns when all tasks have finished. */
+    void run(Function function, void *context, const std::vector<uint32_t> &items);
+
+    /* Spawn a new task of the running job. Must only be called
+     * from within a task. */
+    void spawn(uint32_t item);
+
+private:
+
+    /* The loop of the pool threads, waiting for jobs to help with. */
+    void workerLoop(unsigned worker);
+
+    /* Run tasks of the current job until there are none left. */
+    void work(unsigned worker);
+
+    /* Take a task from the worker's own queue, or steal one from
+     * the other queues. Returns false if all queues are empty. */
+    bool take(unsigned worker, uint32_t &item);
+
+};
+
+#endif // THREADPOOL_H